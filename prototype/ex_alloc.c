@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Compare move matrix allocation backends: first touch time, random reads
+ * and minor page faults, then normal against non-temporal writes.
+ *
+ * usage: ex_alloc.proto <size in MB>
+ */
+
+#define HUGE_PAGE_SIZE	(2UL << 20)
+
+enum {
+	A_MALLOC,
+	A_MMAP,
+	A_POPULATE,
+	A_THP,
+	A_HUGETLB,
+};
+
+static const char* names[] = {
+	"malloc", "mmap", "populate", "thp", "hugetlb"
+};
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long minor_faults(void) {
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_minflt;
+}
+
+static char* alloc(int kind, size_t size, size_t* mapped) {
+	char* ptr;
+	*mapped = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+	switch (kind) {
+	    case A_MALLOC:
+		ptr = malloc(size);
+		return ptr ? ptr : MAP_FAILED;
+	    case A_MMAP:
+		return mmap(NULL, size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	    case A_POPULATE:
+		return mmap(NULL, size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	    case A_THP:
+		ptr = mmap(NULL, *mapped, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr != MAP_FAILED) {
+			madvise(ptr, *mapped, MADV_HUGEPAGE);
+		}
+		return ptr;
+	    case A_HUGETLB:
+		return mmap(NULL, *mapped, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+	return MAP_FAILED;
+}
+
+static void release(int kind, char* ptr, size_t size, size_t mapped) {
+	if (kind == A_MALLOC) {
+		free(ptr);
+	}
+	else if (kind == A_THP || kind == A_HUGETLB) {
+		munmap(ptr, mapped);
+	}
+	else {
+		munmap(ptr, size);
+	}
+}
+
+static void stream(char* dst, const char* src, size_t n) {
+#ifdef __SSE2__
+	while (((size_t) dst & 15) && n > 0) {
+		*dst++ = *src++;
+		n--;
+	}
+	while (n >= 16) {
+		_mm_stream_si128((__m128i*) dst,
+				 _mm_loadu_si128((const __m128i*) src));
+		dst += 16;
+		src += 16;
+		n -= 16;
+	}
+#endif
+	memcpy(dst, src, n);
+}
+
+static void bench_alloc(int kind, size_t size) {
+	size_t mapped;
+	long faults = minor_faults();
+	double t0 = now();
+
+	char* ptr = alloc(kind, size, &mapped);
+	if (ptr == MAP_FAILED) {
+		printf("%-10s unavailable\n", names[kind]);
+		return;
+	}
+	double t1 = now();
+
+	/* First touch, as the kernel writes the move matrix */
+	for (size_t i = 0; i < size; i++) {
+		ptr[i] = i & 7;
+	}
+	double t2 = now();
+
+	/* Random reads, as the traceback does */
+	unsigned long r = 42;
+	long sum = 0;
+	for (size_t i = 0; i < size / 16; i++) {
+		r = r * 6364136223846793005UL + 1442695040888963407UL;
+		sum += ptr[(r >> 16) % size];
+	}
+	double t3 = now();
+	faults = minor_faults() - faults;
+
+	printf("%-10s alloc %8.3f ms  touch %8.3f ms  random %8.3f ms  "
+	       "faults %8ld  (%ld)\n",
+	       names[kind], (t1 - t0) * 1e3, (t2 - t1) * 1e3, (t3 - t2) * 1e3,
+	       faults, sum);
+
+	release(kind, ptr, size, mapped);
+}
+
+static void bench_stores(size_t size) {
+	char chunk[256];
+	for (size_t i = 0; i < sizeof(chunk); i++) {
+		chunk[i] = i & 7;
+	}
+
+	char* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (ptr == MAP_FAILED) {
+		printf("couldn't map memory\n");
+		return;
+	}
+
+	double t0 = now();
+	for (size_t off = 0; off + sizeof(chunk) <= size; off += sizeof(chunk)) {
+		memcpy(ptr + off, chunk, sizeof(chunk));
+	}
+	double t1 = now();
+	for (size_t off = 0; off + sizeof(chunk) <= size; off += sizeof(chunk)) {
+		stream(ptr + off, chunk, sizeof(chunk));
+	}
+#ifdef __SSE2__
+	_mm_sfence();
+#endif
+	double t2 = now();
+
+	printf("normal stores %8.3f ms, non-temporal stores %8.3f ms\n",
+	       (t1 - t0) * 1e3, (t2 - t1) * 1e3);
+
+	munmap(ptr, size);
+}
+
+int main(int argc, char** argv)
+{
+	size_t size = 256;
+	if (argc > 1 && sscanf(argv[1], "%zu", &size) != 1) {
+		printf("usage: %s <size in MB>\n", argv[0]);
+		return 1;
+	}
+	size <<= 20;
+	printf("allocating %f MB\n", size / (1024.0f * 1024.0f));
+
+	for (int kind = A_MALLOC; kind <= A_HUGETLB; kind++) {
+		bench_alloc(kind, size);
+	}
+	bench_stores(size);
+
+	return 0;
+}
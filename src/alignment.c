@@ -9,10 +9,30 @@
  * Doing that, deep-folding it from root to leaves will allow to build each
  * computed alignments.
  */
+/* With affine gaps, a path also goes through gap states: a gap is either
+ * opened from the best score of the next case, or extended from its gap
+ * state. Hence up to five childs for a node in the best score state.
+ */
+enum {
+	AT_TOP,			/* vertical move to the best score state */
+	AT_LEFT,		/* horizontal move to the best score state */
+	AT_TOP_LEFT,		/* diagonal move */
+	AT_TOP_EXT,		/* vertical move, staying in a vertical gap */
+	AT_LEFT_EXT,		/* horizontal move, staying in a horizontal gap */
+	AT_CHILDS,
+};
+
+/* Traceback states */
+enum {
+	ST_H,			/* best score */
+	ST_E,			/* in a horizontal gap */
+	ST_F,			/* in a vertical gap */
+};
+
 typedef struct altree {
-	char		up[3];
-	char		down[3];
-	struct altree*	childs[3];	/* One child per direction */
+	char		up[AT_CHILDS];
+	char		down[AT_CHILDS];
+	struct altree*	childs[AT_CHILDS];	/* One child per move */
 	struct altree*	parent;		/* Could be useful for path
 					 * reconstitution */
 } altree_t;
@@ -41,7 +61,7 @@ void altree_clear(altree_t* tree) {
 		return;
 	}
 
-	for (int i = 0; i < 3; i++) {
+	for (int i = 0; i < AT_CHILDS; i++) {
 		altree_clear(tree->childs[i]);
 	}
 	altree_delete(tree);
@@ -53,16 +73,12 @@ int altree_count_leaves(const altree_t* tree) {
 		return 0;
 	}
 
-	if (!tree->childs[0] && !tree->childs[1] && !tree->childs[2]) {
-		return 1;
-	}
-
 	int count = 0;
-	for (int i = 0; i < 3; i++) {
+	for (int i = 0; i < AT_CHILDS; i++) {
 		count += altree_count_leaves(tree->childs[i]);
 	}
 
-	return count;
+	return count ? count : 1;
 }
 
 /* Count tree max depth */
@@ -72,7 +88,7 @@ int altree_depth(const altree_t* tree) {
 	}
 
 	int depth = altree_depth(tree->childs[0]);
-	for (int i = 1; i < 3; i++) {
+	for (int i = 1; i < AT_CHILDS; i++) {
 		int d = altree_depth(tree->childs[i]);
 		if (d > depth) {
 			depth = d;
@@ -89,7 +105,7 @@ int altree_get_leaves(altree_t* tree, altree_t** leaves, int bound) {
 	}
 
 	int count = 0;
-	for (int i = 0; i < 3; i++) {
+	for (int i = 0; i < AT_CHILDS; i++) {
 		int atocount = altree_get_leaves(tree->childs[i], leaves, bound);
 		leaves += atocount;
 		count += atocount;
@@ -104,62 +120,29 @@ int altree_get_leaves(altree_t* tree, altree_t** leaves, int bound) {
 	return count;
 }
 
-static int _bound = 0;
+/* Tree building, one per matrix layout */
 
-/* Build a tree node */
-static altree_t* __altree_build_node(const algo_arg_t* args,
-				     const matrix_t* move_matrix,
-				     int x, int y,
-				     altree_t* parent)
-{
-	if (x < 0 || y < 0 || _bound == 0) {
-		return NULL;
-	}
+#define KERNEL(f)		f##_diagonal
+#define OFFSET(m, x, y)		matrix_diagonal_offset(m, x, y)
+#include "traceback_kernel.h"
 
-	altree_t* node = altree_new(parent);
-	if (node == NULL) {
-		printf("error during node allocation\n");
-		return NULL;
-	}
-
-	if (x == 0 && y == 0) {
-		_bound--;
-		return node;
-	}
-
-	size_t offset = matrix_coord_offset(move_matrix, x, y);
-	if (move_matrix->v.c[offset] & MOVE_TOP) {
-		node->up[0]	= '-';
-		node->down[0]	= args->seq_b[y - 1];
-		node->childs[0] = __altree_build_node(args, move_matrix,
-						      x, y - 1,
-						      node);
-	}
-	if (move_matrix->v.c[offset] & MOVE_LEFT) {
-		node->up[1]	= args->seq_a[x - 1];
-		node->down[1]	= '-';
-		node->childs[1] = __altree_build_node(args, move_matrix,
-						      x - 1, y,
-						      node);
-	}
-	if (move_matrix->v.c[offset] & MOVE_TOP_LEFT) {
-		node->up[2]	= args->seq_a[x - 1];
-		node->down[2]	= args->seq_b[y - 1];
-		node->childs[2] = __altree_build_node(args, move_matrix,
-						      x - 1, y - 1,
-						      node);
-	}
-
-	return node;
-}
+#define KERNEL(f)		f##_tiled
+#define OFFSET(m, x, y)		matrix_tiled_offset(m, x, y)
+#include "traceback_kernel.h"
 
 /* Build the tree */
 altree_t* altree_build(const algo_arg_t* args,
-		       const matrix_t* move_matrix)
+		       const matrix_t* move_matrix,
+		       int bound)
 {
-	return __altree_build_node(args, move_matrix,
-				   args->len_a, args->len_b,
-				   NULL);
+	if (move_matrix->layout == MATRIX_LAYOUT_DIAGONAL) {
+		return __altree_build_node_diagonal(args, move_matrix,
+						    args->len_a, args->len_b,
+						    ST_H, NULL, &bound);
+	}
+	return __altree_build_node_tiled(args, move_matrix,
+					 args->len_a, args->len_b, ST_H,
+					 NULL, &bound);
 }
 
 /* Allocates an alignment */
@@ -175,27 +158,29 @@ int alignment_init(alignment_t* al, size_t size) {
 }
 
 void alignment_wipe(alignment_t* al) {
-	if (al->up) {
-		free(al->up);
+	/* up and down share the same buffer, the first being its start */
+	char* buf = (al->down && al->down < al->up) ? al->down : al->up;
+	if (buf) {
+		free(buf);
 	}
 }
 
+void alignment_swap(alignment_t* al) {
+	char* tmp = al->up;
+	al->up = al->down;
+	al->down = tmp;
+}
+
 /* Build an alignment giving a tree leaf */
 static void __build_alignment(const altree_t* tree, alignment_t* al)
 {
 	int off = 0;
 	while (tree->parent != NULL) {
-		if (tree == tree->parent->childs[0]) {
-			al->up[off] = tree->parent->up[0];
-			al->down[off] = tree->parent->down[0];
-		}
-		else if (tree == tree->parent->childs[1]) {
-			al->up[off] = tree->parent->up[1];
-			al->down[off] = tree->parent->down[1];
-		}
-		else if (tree == tree->parent->childs[2]) {
-			al->up[off] = tree->parent->up[2];
-			al->down[off] = tree->parent->down[2];
+		for (int i = 0; i < AT_CHILDS; i++) {
+			if (tree == tree->parent->childs[i]) {
+				al->up[off] = tree->parent->up[i];
+				al->down[off] = tree->parent->down[i];
+			}
 		}
 		tree = tree->parent;
 		off++;
@@ -251,14 +236,8 @@ int compute_alignments(const algo_arg_t* args,
 		       alignment_t** alignments,
 		       int bound)
 {
-	if (bound <= 0) {
-		_bound = INT_MAX;
-	}
-	else {
-		_bound = bound;
-	}
-
-	altree_t* tree = altree_build(args, move_matrix);
+	altree_t* tree = altree_build(args, move_matrix,
+				      (bound <= 0) ? INT_MAX : bound);
 	if (tree == NULL) {
 		printf("couldn't build alignment tree.\n");
 		return -1;
@@ -274,24 +253,146 @@ int compute_alignments(const algo_arg_t* args,
 	return nalignments;
 }
 
+int compute_alignments_each(const algo_arg_t* args,
+			    const matrix_t* move_matrix, int bound,
+			    alignment_emit_t emit, void* data)
+{
+	altree_t* tree = altree_build(args, move_matrix,
+				      (bound <= 0) ? INT_MAX : bound);
+	if (tree == NULL) {
+		printf("couldn't build alignment tree.\n");
+		return -1;
+	}
+
+	int nalignments = altree_count_leaves(tree);
+	altree_t** leaves = malloc(nalignments * sizeof(altree_t*));
+	alignment_t al;
+	memset(&al, 0, sizeof(al));
+	if (!leaves || alignment_init(&al, altree_depth(tree) + 1)) {
+		printf("couldn't build alignments.\n");
+		nalignments = -1;
+		goto end;
+	}
+	altree_get_leaves(tree, leaves, nalignments);
+
+	for (int i = 0; i < nalignments; i++) {
+		__build_alignment(leaves[i], &al);
+		if (emit(&al, data)) {
+			nalignments = -1;
+			break;
+		}
+	}
+
+    end:
+	alignment_wipe(&al);
+	free(leaves);
+	altree_clear(tree);
+	return nalignments;
+}
+
 void print_alignment(const alignment_t* al) {
 	printf("%s\n%s\n", al->up, al->down);
 }
 
-int score_alignment(const alignment_t* al) {
-	int score = 0;
-	//printf("la taille est de %d\n",al->size);
-	for (int i = 0; i < al->size-2; ++i)
-	{
-		if ((al->up[i] == '-') && (al->down[i] == '-'))
+int score_alignment(const alignment_t* al, const scoring_t* sc) {
+	return scoring_alignment(sc ? sc : &scoring_default, al->up, al->down);
+}
+
+static inline int __column_op(char up, char down) {
+	if (up == '-') {
+		return AL_OP_INS;
+	}
+	else if (down == '-') {
+		return AL_OP_DEL;
+	}
+	return AL_OP_MATCH;
+}
+
+static size_t __put_varint(uint8_t* buf, size_t size, size_t off,
+			   uint64_t v)
+{
+	do {
+		uint8_t byte = v & 0x7f;
+		v >>= 7;
+		if (v) {
+			byte |= 0x80;
+		}
+		if (off < size) {
+			buf[off] = byte;
+		}
+		off++;
+	} while (v);
+	return off;
+}
+
+size_t alignment_encode(const alignment_t* al, uint8_t* buf, size_t size) {
+	size_t off = 0;
+
+	for (size_t i = 0; al->up[i] != '\0';) {
+		int op = __column_op(al->up[i], al->down[i]);
+		size_t run = 1;
+		while (al->up[i + run] != '\0'
+		&&     __column_op(al->up[i + run], al->down[i + run]) == op)
+		{
+			run++;
+		}
+		off = __put_varint(buf, size, off, (run << 2) | op);
+		i += run;
+	}
+
+	return off;
+}
+
+int alignment_decode(const algo_arg_t* args, const uint8_t* ops, size_t size,
+		     int swap, alignment_t* al)
+{
+	const char* seq_a = swap ? args->seq_b : args->seq_a;
+	const char* seq_b = swap ? args->seq_a : args->seq_b;
+	size_t len_a = swap ? args->len_b : args->len_a;
+	size_t len_b = swap ? args->len_a : args->len_b;
+
+	if (alignment_init(al, len_a + len_b + 1)) {
+		return 1;
+	}
+
+	size_t x = 0, y = 0, col = 0;
+	size_t off = 0;
+	while (off < size) {
+		uint64_t v = 0;
+		int shift = 0;
+		do {
+			if (off >= size || shift > 63) {
+				goto error;
+			}
+			v |= (uint64_t) (ops[off] & 0x7f) << shift;
+			shift += 7;
+		} while (ops[off++] & 0x80);
+
+		int op = v & 3;
+		size_t run = v >> 2;
+		if (x + ((op != AL_OP_INS) ? run : 0) > len_a
+		||  y + ((op != AL_OP_DEL) ? run : 0) > len_b)
 		{
-			--score;
+			goto error;
 		}
 
-		else if(al->up[i] == al->down[i] /*&& ((al->up[i] != '-') && (al->down[i] != '-'))*/ )
-			++score;
-		else
-			--score;
+		for (size_t i = 0; i < run; i++, col++) {
+			al->up[col] = (op == AL_OP_INS) ? '-' : seq_a[x++];
+			al->down[col] = (op == AL_OP_DEL) ? '-' : seq_b[y++];
+		}
+	}
+	if (x != len_a || y != len_b) {
+		goto error;
+	}
+	al->up[col] = '\0';
+	al->down[col] = '\0';
+
+	if (swap) {
+		alignment_swap(al);
 	}
-	return score;
+	return 0;
+
+    error:
+	alignment_wipe(al);
+	return 1;
 }
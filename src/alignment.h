@@ -1,8 +1,11 @@
 #ifndef _alignment_h_
 #define _alignment_h_
 
+#include <stdint.h>
+
 #include "common.h"
 #include "matrix.h"
+#include "scoring.h"
 
 typedef struct alignment {
 	char*	up;
@@ -20,9 +23,46 @@ int compute_alignments(const algo_arg_t* args,
 		       alignment_t** alignments,
 		       int bound);
 
+/* Alignments handed out one by one, non zero to stop */
+typedef int (*alignment_emit_t)(const alignment_t* al, void* data);
+
+/* Same alignments as `compute_alignments`, each one given to `emit` as
+ * soon as it is built, in a buffer reused for the next one.
+ * Returns the number of alignments, -1 on error or if `emit` stopped.
+ */
+int compute_alignments_each(const algo_arg_t* args,
+			    const matrix_t* move_matrix, int bound,
+			    alignment_emit_t emit, void* data);
+
 void print_alignment(const alignment_t* al);
 
-int score_alignment(const alignment_t* al);
+/* Score of an alignment, with the historical scoring if `sc` is NULL */
+int score_alignment(const alignment_t* al, const scoring_t* sc);
+
+/* Alignment operations.
+ * An alignment can be stored as a run-length encoded list of operations,
+ * each run being a varint of `(length << 2) | op`.
+ */
+enum {
+	AL_OP_MATCH	= 0,	/* a character of both sequences */
+	AL_OP_INS	= 1,	/* a character of seq_b only (hole up) */
+	AL_OP_DEL	= 2,	/* a character of seq_a only (hole down) */
+};
+
+/* Encode `al` into `buf` of `size` bytes.
+ * Returns the size of the encoded alignment, which can be greater than `size`
+ * in which case the output is truncated.
+ */
+size_t alignment_encode(const alignment_t* al, uint8_t* buf, size_t size);
+
+/* Build an alignment of args sequences from its encoded operations.
+ * If `swap` is set, operations are relative to (seq_b, seq_a).
+ */
+int alignment_decode(const algo_arg_t* args, const uint8_t* ops, size_t size,
+		     int swap, alignment_t* al);
+
+/* Exchange the up and down sequences of an alignment */
+void alignment_swap(alignment_t* al);
 
 
 #endif
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "fasta.h"
+#include "qgram.h"
+#include "score.h"
+#include "allvsall.h"
+
+static const char* __format_names[] = {
+	[AVA_FORMAT_TSV]	= "tsv",
+	[AVA_FORMAT_BINARY]	= "binary",
+};
+
+void ava_cfg_default(ava_cfg_t* cfg) {
+	cfg->scoring = NULL;
+	cfg->format = AVA_FORMAT_TSV;
+	cfg->prune = 0;
+	cfg->min_score = 0;
+}
+
+int ava_find_format(const char* name) {
+	for (int i = 0; i < countof(__format_names); i++) {
+		if (!strcmp(name, __format_names[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Index of the score of (i, j) in the upper triangle, i <= j */
+static inline size_t __tri(size_t n, size_t i, size_t j) {
+	return i * n - i * (i - 1) / 2 + (j - i);
+}
+
+static const fasta_t* __sort_fasta;
+
+static int __by_length(const void* a, const void* b) {
+	int la = __sort_fasta->lens[*(const int*) a];
+	int lb = __sort_fasta->lens[*(const int*) b];
+	return (la != lb) ? lb - la : *(const int*) a - *(const int*) b;
+}
+
+/* Scores of the pairs of the block [first, last) of sorted sequences with
+ * all the following ones.
+ */
+static int __process_block(const fasta_t* fa, const int* order,
+			   uint8_t* const* codes, const score_alphabet_t* ab,
+			   const ava_cfg_t* cfg, const scoring_t* sc,
+			   int first, int last, int32_t* scores)
+{
+	int count = last - first;
+	int ret = 1;
+	score_profile_t* profiles = calloc(count, sizeof(score_profile_t));
+	qgram_profile_t* grams = NULL;
+	int* buf = malloc(2 * (fa->lens[order[first]] + 1) * sizeof(int));
+
+	if (cfg->prune) {
+		grams = malloc((count + 1) * sizeof(qgram_profile_t));
+	}
+	if (!profiles || !buf || (cfg->prune && !grams)) {
+		printf("couldn't allocate block profiles\n");
+		goto end;
+	}
+
+	for (int k = 0; k < count; k++) {
+		int i = order[first + k];
+		if (score_profile_init(profiles + k, ab, sc, fa->seqs[i],
+				       fa->lens[i]))
+		{
+			goto end;
+		}
+		if (grams) {
+			qgram_profile(grams + k, fa->seqs[i], fa->lens[i]);
+		}
+	}
+
+	for (int pj = first; pj < fa->n; pj++) {
+		int j = order[pj];
+		if (grams) {
+			qgram_profile(grams + count, fa->seqs[j], fa->lens[j]);
+		}
+		for (int k = 0; k < count && first + k <= pj; k++) {
+			int i = order[first + k];
+			int32_t s;
+			if (grams && qgram_score_bound(grams + k, grams + count,
+						       sc) < cfg->min_score)
+			{
+				s = INT32_MIN;
+			}
+			else {
+				s = score_profile_align(profiles + k, sc, codes[j],
+							fa->lens[j], buf);
+				if (cfg->prune && s < cfg->min_score) {
+					s = INT32_MIN;
+				}
+			}
+			scores[__tri(fa->n, min(i, j), max(i, j))] = s;
+		}
+	}
+	ret = 0;
+
+    end:
+	for (int k = 0; profiles && k < count; k++) {
+		score_profile_wipe(profiles + k);
+	}
+	free(profiles);
+	free(grams);
+	free(buf);
+	return ret;
+}
+
+static int __write_tsv(const fasta_t* fa, const int32_t* scores, FILE* out) {
+	for (int i = 0; i < fa->n; i++) {
+		fprintf(out, "\t%s", fa->names[i]);
+	}
+	fprintf(out, "\n");
+
+	for (int i = 0; i < fa->n; i++) {
+		fprintf(out, "%s", fa->names[i]);
+		for (int j = 0; j < fa->n; j++) {
+			int32_t s = scores[__tri(fa->n, min(i, j), max(i, j))];
+			if (s == INT32_MIN) {
+				fprintf(out, "\t-");
+			}
+			else {
+				fprintf(out, "\t%d", s);
+			}
+		}
+		fprintf(out, "\n");
+	}
+	return ferror(out);
+}
+
+static int __write_binary(const fasta_t* fa, const int32_t* scores,
+			  FILE* out)
+{
+	char magic[8] = AVA_MAGIC;
+	uint32_t header[2] = { AVA_VERSION, fa->n };
+	fwrite(magic, sizeof(magic), 1, out);
+	fwrite(header, sizeof(header), 1, out);
+
+	for (int i = 0; i < fa->n; i++) {
+		uint32_t len = strlen(fa->names[i]);
+		fwrite(&len, sizeof(len), 1, out);
+		fwrite(fa->names[i], 1, len, out);
+	}
+
+	size_t count = __tri(fa->n, fa->n - 1, fa->n - 1) + 1;
+	fwrite(scores, sizeof(int32_t), count, out);
+	return ferror(out);
+}
+
+int all_vs_all(const char* fasta, FILE* out, const ava_cfg_t* cfg) {
+	const scoring_t* sc = cfg->scoring ? cfg->scoring : &scoring_default;
+	fasta_t fa;
+	score_alphabet_t ab;
+	int* order = NULL;
+	int* blocks = NULL;
+	uint8_t** codes = NULL;
+	uint8_t* codes_buf = NULL;
+	int32_t* scores = NULL;
+	int ret = 1;
+
+	if (score_check_scoring(sc)) {
+		printf("substitution scores must fit in 16 bits\n");
+		return 1;
+	}
+	if (fasta_load(&fa, fasta)) {
+		return 1;
+	}
+
+	/* Sequences are encoded once */
+	score_alphabet_init(&ab);
+	size_t total = 0;
+	for (int i = 0; i < fa.n; i++) {
+		score_alphabet_add(&ab, fa.seqs[i], fa.lens[i]);
+		total += fa.lens[i];
+	}
+	size_t npairs = __tri(fa.n, fa.n - 1, fa.n - 1) + 1;
+	order = malloc(fa.n * sizeof(int));
+	blocks = malloc((fa.n + 1) * sizeof(int));
+	codes = malloc(fa.n * sizeof(uint8_t*));
+	codes_buf = malloc(max(total, 1));
+	scores = malloc(npairs * sizeof(int32_t));
+	if (!order || !blocks || !codes || !codes_buf || !scores) {
+		printf("couldn't allocate all-vs-all scores\n");
+		goto end;
+	}
+	for (size_t i = 0, off = 0; i < fa.n; off += fa.lens[i], i++) {
+		codes[i] = codes_buf + off;
+		score_encode(&ab, fa.seqs[i], fa.lens[i], codes[i]);
+		order[i] = i;
+	}
+
+	/* Longest first, blocks of profiles fitting in the cache */
+	__sort_fasta = &fa;
+	qsort(order, fa.n, sizeof(int), __by_length);
+	int nblocks = 0;
+	size_t bytes = 0;
+	for (int p = 0; p < fa.n; p++) {
+		size_t size = (size_t) ab.size * fa.lens[order[p]]
+			    * sizeof(int16_t);
+		if (p == 0 || bytes + size > AVA_BLOCK_BYTES) {
+			blocks[nblocks++] = p;
+			bytes = 0;
+		}
+		bytes += size;
+	}
+	blocks[nblocks] = fa.n;
+	VERBOSE_FMT("%d sequences, %zu pairs in %d blocks\n",
+		    fa.n, npairs, nblocks);
+
+	int error = 0;
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int b = 0; b < nblocks; b++) {
+		if (!error && __process_block(&fa, order, codes, &ab, cfg, sc,
+					      blocks[b], blocks[b + 1], scores))
+		{
+			#pragma omp atomic write
+			error = 1;
+		}
+	}
+	if (error) {
+		goto end;
+	}
+
+	if (cfg->format == AVA_FORMAT_BINARY) {
+		ret = __write_binary(&fa, scores, out);
+	}
+	else {
+		ret = __write_tsv(&fa, scores, out);
+	}
+	if (ret) {
+		printf("couldn't write all-vs-all scores\n");
+	}
+
+    end:
+	free(order);
+	free(blocks);
+	free(codes);
+	free(codes_buf);
+	free(scores);
+	fasta_wipe(&fa);
+	return ret;
+}
+
@@ -0,0 +1,56 @@
+#ifndef _allvsall_h_
+#define _allvsall_h_
+
+#include <stdio.h>
+
+#include "scoring.h"
+
+/* All-vs-all global alignment scores of the sequences of a FASTA file.
+ *
+ * Only the upper triangle (diagonal included) is computed, with the score
+ * only kernel of score.h. Sequences are sorted by decreasing length and
+ * cut in blocks whose query profiles fit in the cache. A thread takes a
+ * block, builds its profiles once, and aligns them with every following
+ * sequence, each one staying hot while it meets all the block profiles.
+ * Blocks of the longest sequences are taken first.
+ *
+ * The TSV output is the full symmetric matrix, with a header line of the
+ * sequence names. The binary output is, in host byte order:
+ *
+ *	char	magic[8]	"NWAVA"
+ *	u32	version		1
+ *	u32	n		number of sequences
+ *	u32	length, name	for each sequence, in file order
+ *	i32	scores		upper triangle by rows, diagonal included:
+ *				(0, 0) (0, 1) ... (0, n - 1) (1, 1) ...
+ *
+ * With a minimum score, pairs below it are INT32_MIN ("-" in TSV).
+ */
+
+#define AVA_MAGIC	"NWAVA"
+#define AVA_VERSION	1
+
+/* Bytes of query profiles per block */
+#define AVA_BLOCK_BYTES	(256 << 10)
+
+enum {
+	AVA_FORMAT_TSV = 0,
+	AVA_FORMAT_BINARY,
+};
+
+typedef struct ava_cfg {
+	const scoring_t*	scoring;	/* the historical one if NULL */
+	int			format;
+	int			prune;		/* mark pairs below min_score */
+	int			min_score;
+} ava_cfg_t;
+
+void ava_cfg_default(ava_cfg_t* cfg);
+
+/* Returns the format of given name, -1 if unknown */
+int ava_find_format(const char* name);
+
+int all_vs_all(const char* fasta, FILE* out, const ava_cfg_t* cfg);
+
+#endif
+
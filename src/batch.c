@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "common.h"
+#include "alignment.h"
+#include "fasta.h"
+#include "qgram.h"
+#include "score.h"
+#include "striped.h"
+#include "tiny.h"
+#include "batch.h"
+
+void batch_cfg_default(batch_cfg_t* cfg) {
+	cfg->scoring = NULL;
+	cfg->bound = 0;
+	cfg->prune = 0;
+	cfg->min_score = 0;
+	cfg->striped = 0;
+}
+
+static const fasta_t* __sort_fasta;
+
+/* Lexicographic order, a prefix coming before its extensions */
+static int __by_sequence(const void* a, const void* b) {
+	int i = *(const int*) a;
+	int j = *(const int*) b;
+	int len = min(__sort_fasta->lens[i], __sort_fasta->lens[j]);
+	int c = memcmp(__sort_fasta->seqs[i], __sort_fasta->seqs[j], len);
+	if (c) {
+		return c;
+	}
+	if (__sort_fasta->lens[i] != __sort_fasta->lens[j]) {
+		return __sort_fasta->lens[i] - __sort_fasta->lens[j];
+	}
+	return i - j;
+}
+
+static inline int __common_prefix(const uint8_t* a, int len_a,
+				  const uint8_t* b, int len_b)
+{
+	int n = min(len_a, len_b);
+	int i = 0;
+	while (i < n && a[i] == b[i]) {
+		i++;
+	}
+	return i;
+}
+
+/* Scores of the queries order[first, last), walking down their trie with a
+ * stack of rows: row j of the stack is the one of the current query prefix
+ * of length j, as long as the next query shares that prefix.
+ */
+static int __process_range(const score_profile_t* p, const scoring_t* sc,
+			   const fasta_t* fa, uint8_t* const* codes,
+			   const int* order, int first, int last,
+			   int32_t* scores, size_t* rows)
+{
+	int depth = 0;
+	for (int k = first; k < last; k++) {
+		depth = max(depth, fa->lens[order[k]]);
+	}
+
+	size_t width = p->len + 1;
+	int* stack = malloc((depth + 1) * 2 * width * sizeof(int));
+	if (!stack) {
+		printf("couldn't allocate row stack\n");
+		return 1;
+	}
+
+	score_profile_first_row(p, sc, stack, stack + width);
+	int prev = -1;
+	for (int k = first; k < last; k++) {
+		int q = order[k];
+		int shared = 0;
+		if (prev >= 0) {
+			shared = __common_prefix(codes[prev], fa->lens[prev],
+						 codes[q], fa->lens[q]);
+		}
+		for (int j = shared + 1; j <= fa->lens[q]; j++) {
+			int* h_prev = stack + (j - 1) * 2 * width;
+			int* h = stack + j * 2 * width;
+			score_profile_row(p, sc, codes[q][j - 1], j,
+					  h_prev, h_prev + width, h, h + width);
+		}
+		*rows += fa->lens[q] - shared;
+		scores[q] = stack[fa->lens[q] * 2 * width + p->len];
+		prev = q;
+	}
+
+	free(stack);
+	return 0;
+}
+
+/* Scores of the queries order[first, last) with the striped kernel */
+static int __striped_range(const striped_profile_t* p, const scoring_t* sc,
+			   const fasta_t* fa, uint8_t* const* codes,
+			   const int* order, int first, int last,
+			   int32_t* scores, size_t* rows)
+{
+	void* buf = striped_buffer(p);
+	if (!buf) {
+		printf("couldn't allocate score columns\n");
+		return 1;
+	}
+
+	for (int k = first; k < last; k++) {
+		int q = order[k];
+		scores[q] = striped_align(p, sc, codes[q], fa->lens[q], buf);
+		*rows += fa->lens[q];
+	}
+
+	free(buf);
+	return 0;
+}
+
+/* Alignments of the reference with query `q`, written after its score */
+static int __write_alignments(const char* ref, int len, const fasta_t* fa,
+			      int q, const scoring_t* sc, int bound,
+			      FILE* out)
+{
+	algo_arg_t args;
+	memset(&args, 0, sizeof(args));
+	args.seq_a = (char*) ref;
+	args.seq_b = fa->seqs[q];
+	args.len_a = len;
+	args.len_b = fa->lens[q];
+	args.scoring = sc;
+
+	/* Tiny pairs skip the move matrix (see tiny.h) */
+	if (bound == 1 && tiny_fits(&args)) {
+		tiny_alignment_t al;
+		tiny_align(&args, &al);
+		fprintf(out, "%s\n%s\n", al.up, al.down);
+		return 0;
+	}
+
+	matrix_t m;
+	if (matrix_init(&m, len + 1, fa->lens[q] + 1, sizeof(char),
+			MATRIX_ALLOC_DEFAULT, MATRIX_LAYOUT_DIAGONAL))
+	{
+		printf("couldn't allocate move matrix\n");
+		return 1;
+	}
+
+	algo_res_t res;
+	memset(&res, 0, sizeof(res));
+	alignment_t* alignments = NULL;
+	int n = 0;
+	if (nw(&args, &res, &m) == ALGO_OK) {
+		n = compute_alignments(&args, &m, &alignments, bound);
+	}
+	matrix_wipe(&m);
+	if (n <= 0) {
+		printf("couldn't align %s\n", fa->names[q]);
+		return 1;
+	}
+
+	for (int i = 0; i < n; i++) {
+		fprintf(out, "%s\n%s\n", alignments[i].up, alignments[i].down);
+		alignment_wipe(alignments + i);
+	}
+	free(alignments);
+	return 0;
+}
+
+int batch_align(const char* ref, int len, const char* fasta, FILE* out,
+		const batch_cfg_t* cfg)
+{
+	const scoring_t* sc = cfg->scoring ? cfg->scoring : &scoring_default;
+	fasta_t fa;
+	score_alphabet_t ab;
+	score_profile_t profile;
+	striped_profile_t striped;
+	qgram_profile_t* grams = NULL;
+	int* order = NULL;
+	uint8_t** codes = NULL;
+	uint8_t* codes_buf = NULL;
+	int32_t* scores = NULL;
+	int ret = 1;
+
+	if (score_check_scoring(sc)) {
+		printf("substitution scores must fit in 16 bits\n");
+		return 1;
+	}
+	if (fasta_load(&fa, fasta)) {
+		return 1;
+	}
+	memset(&profile, 0, sizeof(profile));
+	memset(&striped, 0, sizeof(striped));
+
+	score_alphabet_init(&ab);
+	score_alphabet_add(&ab, ref, len);
+	size_t total = 0;
+	int longest = 0;
+	for (int i = 0; i < fa.n; i++) {
+		score_alphabet_add(&ab, fa.seqs[i], fa.lens[i]);
+		total += fa.lens[i];
+		longest = max(longest, fa.lens[i]);
+	}
+	order = malloc(fa.n * sizeof(int));
+	codes = malloc(fa.n * sizeof(uint8_t*));
+	codes_buf = malloc(max(total, 1));
+	scores = malloc(fa.n * sizeof(int32_t));
+	if (cfg->prune) {
+		grams = malloc(2 * sizeof(qgram_profile_t));
+	}
+	if (!order || !codes || !codes_buf || !scores
+	||  (cfg->prune && !grams))
+	{
+		printf("couldn't allocate batch scores\n");
+		goto end;
+	}
+	if (cfg->striped
+	    ? striped_profile_init(&striped, &ab, sc, ref, len, longest)
+	    : score_profile_init(&profile, &ab, sc, ref, len))
+	{
+		goto end;
+	}
+
+	/* Queries the prefilter rejects are left out of the trie */
+	int n = 0;
+	if (grams) {
+		qgram_profile(grams, ref, len);
+	}
+	for (size_t i = 0, off = 0; i < fa.n; off += fa.lens[i], i++) {
+		codes[i] = codes_buf + off;
+		score_encode(&ab, fa.seqs[i], fa.lens[i], codes[i]);
+		scores[i] = INT32_MIN;
+		if (grams) {
+			qgram_profile(grams + 1, fa.seqs[i], fa.lens[i]);
+			if (qgram_score_bound(grams, grams + 1, sc)
+			    < cfg->min_score)
+			{
+				continue;
+			}
+		}
+		order[n++] = i;
+	}
+
+	__sort_fasta = &fa;
+	qsort(order, n, sizeof(int), __by_sequence);
+
+	/* Each thread walks a contiguous part of the trie */
+	int error = 0;
+	size_t rows = 0;
+	#pragma omp parallel reduction(+:rows)
+	{
+		int t = omp_get_thread_num();
+		int nt = omp_get_num_threads();
+		int first = (size_t) n * t / nt;
+		int last = (size_t) n * (t + 1) / nt;
+		if (first < last
+		&&  (cfg->striped
+		     ? __striped_range(&striped, sc, &fa, codes, order, first,
+				       last, scores, &rows)
+		     : __process_range(&profile, sc, &fa, codes, order, first,
+				       last, scores, &rows)))
+		{
+			#pragma omp atomic write
+			error = 1;
+		}
+	}
+	if (error) {
+		goto end;
+	}
+	VERBOSE_FMT("%d queries (%d rejected), %zu rows computed for %zu "
+		    "characters\n", fa.n, fa.n - n, rows, total);
+
+	for (int i = 0; i < fa.n; i++) {
+		if (cfg->prune && scores[i] < cfg->min_score) {
+			scores[i] = INT32_MIN;
+		}
+		if (scores[i] == INT32_MIN) {
+			fprintf(out, "%s\t-\n", fa.names[i]);
+			continue;
+		}
+		fprintf(out, "%s\t%d\n", fa.names[i], scores[i]);
+		if (cfg->bound != 0
+		&&  __write_alignments(ref, len, &fa, i, sc, cfg->bound, out))
+		{
+			goto end;
+		}
+	}
+	ret = ferror(out);
+	if (ret) {
+		printf("couldn't write batch scores\n");
+	}
+
+    end:
+	score_profile_wipe(&profile);
+	striped_profile_wipe(&striped);
+	free(grams);
+	free(order);
+	free(codes);
+	free(codes_buf);
+	free(scores);
+	fasta_wipe(&fa);
+	return ret;
+}
+
@@ -0,0 +1,42 @@
+#ifndef _batch_h_
+#define _batch_h_
+
+#include <stdio.h>
+
+#include "scoring.h"
+
+/* Alignment of one reference with every query of a FASTA file.
+ *
+ * The score rows of the reference profile (see score.h) only depend on the
+ * query prefix they stand for, so queries sharing a prefix share its rows.
+ * Queries are sorted, which lays them out as the depth-first walk of their
+ * trie: a thread keeps the rows of the current path in a stack, and each
+ * query only computes the rows past its longest common prefix with the
+ * previous one, i.e. its own trie edges.
+ *
+ * The output has a `name<TAB>score` line per query, in file order, "-" as
+ * score for queries below the minimum score. With alignments, each score
+ * line is followed by the query alignments, recomputed by `nw` once its
+ * score is known.
+ *
+ * With `striped`, queries are instead scored one by one by the striped
+ * kernel (see striped.h), against a profile of the reference built once:
+ * faster when queries share little more than a few characters.
+ */
+
+typedef struct batch_cfg {
+	const scoring_t*	scoring;	/* the historical one if NULL */
+	int			bound;		/* alignments per query, 0 for
+						 * scores only */
+	int			prune;		/* skip queries below min_score */
+	int			min_score;
+	int			striped;	/* striped kernel, no trie */
+} batch_cfg_t;
+
+void batch_cfg_default(batch_cfg_t* cfg);
+
+int batch_align(const char* ref, int len, const char* fasta, FILE* out,
+		const batch_cfg_t* cfg);
+
+#endif
+
@@ -0,0 +1,506 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "scoring.h"
+#include "cache.h"
+
+#define CACHE_SEED_1		0x6e772d6361636865ULL
+#define CACHE_SEED_2		0x2d726573756c7473ULL
+
+#define CACHE_MAGIC		"NWCACHE"
+#define CACHE_VERSION		1
+#define CACHE_HEADER_SIZE	4096
+
+typedef struct cache_key {
+	uint64_t	h1;
+	uint64_t	h2;
+	int		swap;	/* query is (seq_b, seq_a) in canonical order */
+} cache_key_t;
+
+/* In memory entry, payload is:
+ *	i32 score, u32 number of alignments,
+ *	for each alignment: u32 size, encoded operations
+ */
+typedef struct cache_entry {
+	uint64_t		h1;
+	uint64_t		h2;
+	size_t			size;
+	struct cache_entry*	hnext;
+	struct cache_entry*	prev;
+	struct cache_entry*	next;
+	uint8_t			payload[];
+} cache_entry_t;
+
+/* File tier layout:
+ *	header (CACHE_HEADER_SIZE bytes)
+ *	slots
+ *	data (ring buffer of payloads)
+ */
+typedef struct cache_file_header {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	nslots;
+	uint64_t	data_offset;
+	uint64_t	data_size;
+	uint64_t	head;
+} cache_file_header_t;
+
+typedef struct cache_slot {
+	uint64_t	h1;
+	uint64_t	h2;
+	uint64_t	offset;
+	uint32_t	size;
+	uint32_t	check;	/* payload hash, detects overwritten data */
+} cache_slot_t;
+
+struct cache {
+	pthread_mutex_t		lock;
+
+	size_t			budget;
+	size_t			used;
+	size_t			nbuckets;
+	cache_entry_t**		buckets;
+	cache_entry_t*		lru_head;	/* most recently used */
+	cache_entry_t*		lru_tail;
+
+	int			fd;
+	uint8_t*		map;
+	size_t			map_size;
+	cache_file_header_t*	header;
+	cache_slot_t*		slots;
+	uint8_t*		data;
+};
+
+static void __make_key(const algo_arg_t* args, int algorithm, int bound,
+		       cache_key_t* key)
+{
+	uint64_t ha = hash64(args->seq_a, args->len_a, CACHE_SEED_1);
+	uint64_t hb = hash64(args->seq_b, args->len_b, CACHE_SEED_1);
+	uint64_t ha2 = hash64(args->seq_a, args->len_a, CACHE_SEED_2);
+	uint64_t hb2 = hash64(args->seq_b, args->len_b, CACHE_SEED_2);
+
+	key->swap = (hb < ha) || (hb == ha && args->len_b < args->len_a);
+
+	uint64_t params[5] = {
+		key->swap ? args->len_b : args->len_a,
+		key->swap ? args->len_a : args->len_b,
+		algorithm,
+		scoring_hash(args->scoring ? args->scoring : &scoring_default),
+		bound
+	};
+
+	key->h1 = hash64_mix(key->swap ? hb : ha, key->swap ? ha : hb);
+	key->h2 = hash64_mix(key->swap ? hb2 : ha2, key->swap ? ha2 : hb2);
+	for (int i = 0; i < countof(params); i++) {
+		key->h1 = hash64_mix(key->h1, params[i]);
+		key->h2 = hash64_mix(key->h2, ~params[i]);
+	}
+}
+
+/* Memory tier */
+
+static void __lru_unlink(cache_t* cache, cache_entry_t* e) {
+	if (e->prev) {
+		e->prev->next = e->next;
+	}
+	else {
+		cache->lru_head = e->next;
+	}
+	if (e->next) {
+		e->next->prev = e->prev;
+	}
+	else {
+		cache->lru_tail = e->prev;
+	}
+	e->prev = e->next = NULL;
+}
+
+static void __lru_push(cache_t* cache, cache_entry_t* e) {
+	e->prev = NULL;
+	e->next = cache->lru_head;
+	if (cache->lru_head) {
+		cache->lru_head->prev = e;
+	}
+	else {
+		cache->lru_tail = e;
+	}
+	cache->lru_head = e;
+}
+
+static cache_entry_t** __mem_bucket(cache_t* cache, uint64_t h1) {
+	return cache->buckets + (h1 & (cache->nbuckets - 1));
+}
+
+static cache_entry_t* __mem_find(cache_t* cache, const cache_key_t* key) {
+	cache_entry_t* e = *__mem_bucket(cache, key->h1);
+	while (e && (e->h1 != key->h1 || e->h2 != key->h2)) {
+		e = e->hnext;
+	}
+	return e;
+}
+
+static void __mem_remove(cache_t* cache, cache_entry_t* e) {
+	cache_entry_t** p = __mem_bucket(cache, e->h1);
+	while (*p != e) {
+		p = &(*p)->hnext;
+	}
+	*p = e->hnext;
+	__lru_unlink(cache, e);
+	cache->used -= sizeof(cache_entry_t) + e->size;
+	free(e);
+}
+
+static void __mem_insert(cache_t* cache, const cache_key_t* key,
+			 const uint8_t* payload, size_t size)
+{
+	size_t cost = sizeof(cache_entry_t) + size;
+	if (!cache->buckets || cost > cache->budget / 4) {
+		return;
+	}
+
+	cache_entry_t* e = __mem_find(cache, key);
+	if (e) {
+		__mem_remove(cache, e);
+	}
+	while (cache->used + cost > cache->budget && cache->lru_tail) {
+		__mem_remove(cache, cache->lru_tail);
+	}
+
+	e = malloc(cost);
+	if (!e) {
+		return;
+	}
+	e->h1 = key->h1;
+	e->h2 = key->h2;
+	e->size = size;
+	memcpy(e->payload, payload, size);
+
+	cache_entry_t** bucket = __mem_bucket(cache, key->h1);
+	e->hnext = *bucket;
+	*bucket = e;
+	__lru_push(cache, e);
+	cache->used += cost;
+}
+
+/* File tier */
+
+static int __file_open(cache_t* cache, const char* path, size_t file_size) {
+	cache->fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (cache->fd < 0) {
+		printf("couldn't open cache file %s: %s\n", path,
+		       strerror(errno));
+		return 1;
+	}
+
+	struct stat st;
+	if (fstat(cache->fd, &st)) {
+		printf("couldn't stat cache file %s\n", path);
+		return 1;
+	}
+
+	/* An existing cache keeps its geometry */
+	int fresh = (st.st_size < CACHE_HEADER_SIZE);
+	if (!fresh) {
+		file_size = st.st_size;
+	}
+	else if (ftruncate(cache->fd, file_size)) {
+		printf("couldn't resize cache file %s\n", path);
+		return 1;
+	}
+
+	cache->map = mmap(NULL, file_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED, cache->fd, 0);
+	if (cache->map == MAP_FAILED) {
+		cache->map = NULL;
+		printf("couldn't map cache file %s: %s\n", path,
+		       strerror(errno));
+		return 1;
+	}
+	cache->map_size = file_size;
+	cache->header = (cache_file_header_t*) cache->map;
+
+	cache_file_header_t* h = cache->header;
+	if (!fresh
+	&&  (memcmp(h->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC))
+	     || h->version != CACHE_VERSION
+	     || h->data_offset + h->data_size > file_size
+	     || CACHE_HEADER_SIZE + h->nslots * sizeof(cache_slot_t)
+		> h->data_offset))
+	{
+		printf("cache file %s is invalid, resetting it\n", path);
+		fresh = 1;
+	}
+
+	if (fresh) {
+		size_t slots_size = file_size / 16;
+		memset(h, 0, sizeof(*h));
+		memcpy(h->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+		h->version = CACHE_VERSION;
+		h->nslots = slots_size / sizeof(cache_slot_t);
+		h->data_offset = CACHE_HEADER_SIZE
+			       + h->nslots * sizeof(cache_slot_t);
+		if (h->nslots == 0 || h->data_offset >= file_size) {
+			printf("cache file size is too small\n");
+			return 1;
+		}
+		h->data_size = file_size - h->data_offset;
+		h->head = 0;
+		memset(cache->map + CACHE_HEADER_SIZE, 0,
+		       h->nslots * sizeof(cache_slot_t));
+	}
+
+	cache->slots = (cache_slot_t*) (cache->map + CACHE_HEADER_SIZE);
+	cache->data = cache->map + h->data_offset;
+	return 0;
+}
+
+static const uint8_t* __file_find(cache_t* cache, const cache_key_t* key,
+				  size_t* size)
+{
+	if (!cache->map) {
+		return NULL;
+	}
+
+	cache_slot_t* slot = cache->slots + key->h1 % cache->header->nslots;
+	if (slot->h1 != key->h1 || slot->h2 != key->h2
+	||  slot->offset + slot->size > cache->header->data_size)
+	{
+		return NULL;
+	}
+
+	const uint8_t* payload = cache->data + slot->offset;
+	if ((uint32_t) hash64(payload, slot->size, 0) != slot->check) {
+		return NULL;
+	}
+
+	*size = slot->size;
+	return payload;
+}
+
+static void __file_insert(cache_t* cache, const cache_key_t* key,
+			  const uint8_t* payload, size_t size)
+{
+	cache_file_header_t* h = cache->header;
+	if (!cache->map || size > h->data_size / 4) {
+		return;
+	}
+
+	if (h->head + size > h->data_size) {
+		h->head = 0;
+	}
+
+	cache_slot_t* slot = cache->slots + key->h1 % h->nslots;
+	memcpy(cache->data + h->head, payload, size);
+	slot->h1 = key->h1;
+	slot->h2 = key->h2;
+	slot->offset = h->head;
+	slot->size = size;
+	slot->check = hash64(payload, size, 0);
+	h->head += size;
+}
+
+/* Payloads */
+
+static uint8_t* __payload_build(int score, const alignment_t* alignments,
+				int nalignments, int swap, size_t* size)
+{
+	*size = 8;
+	for (int i = 0; i < nalignments; i++) {
+		*size += 4 + alignment_encode(alignments + i, NULL, 0);
+	}
+
+	uint8_t* payload = malloc(*size);
+	if (!payload) {
+		return NULL;
+	}
+
+	uint32_t v = score;
+	memcpy(payload, &v, 4);
+	v = nalignments;
+	memcpy(payload + 4, &v, 4);
+
+	size_t off = 8;
+	for (int i = 0; i < nalignments; i++) {
+		alignment_t al = alignments[i];
+		if (swap) {
+			alignment_swap(&al);
+		}
+		v = alignment_encode(&al, payload + off + 4, *size - off - 4);
+		memcpy(payload + off, &v, 4);
+		off += 4 + v;
+	}
+
+	return payload;
+}
+
+static int __payload_read(const algo_arg_t* args, const uint8_t* payload,
+			  size_t size, int swap,
+			  int* score, alignment_t** alignments,
+			  int* nalignments)
+{
+	uint32_t v;
+	if (size < 8) {
+		return 0;
+	}
+	memcpy(&v, payload, 4);
+	*score = (int32_t) v;
+	if (!alignments) {
+		return 1;
+	}
+
+	memcpy(&v, payload + 4, 4);
+	int n = v;
+	*alignments = malloc(max(n, 1) * sizeof(alignment_t));
+	if (!*alignments) {
+		return 0;
+	}
+
+	size_t off = 8;
+	for (int i = 0; i < n; i++) {
+		if (off + 4 > size) {
+			goto error;
+		}
+		memcpy(&v, payload + off, 4);
+		off += 4;
+		if (off + v > size
+		||  alignment_decode(args, payload + off, v, swap,
+				     *alignments + i))
+		{
+			n = i;
+			goto error;
+		}
+		off += v;
+	}
+
+	*nalignments = n;
+	return 1;
+
+    error:
+	for (int i = 0; i < n; i++) {
+		alignment_wipe(*alignments + i);
+	}
+	free(*alignments);
+	*alignments = NULL;
+	return 0;
+}
+
+/* Interface */
+
+cache_t* cache_new(size_t mem_budget, const char* path, size_t file_size) {
+	cache_t* cache = malloc(sizeof(cache_t));
+	if (!cache) {
+		printf("couldn't allocate cache\n");
+		return NULL;
+	}
+	memset(cache, 0, sizeof(cache_t));
+	cache->fd = -1;
+	pthread_mutex_init(&cache->lock, NULL);
+
+	if (mem_budget > 0) {
+		cache->budget = mem_budget;
+		cache->nbuckets = 1024;
+		while (cache->nbuckets < mem_budget / 256
+		&&     cache->nbuckets < (1 << 20))
+		{
+			cache->nbuckets <<= 1;
+		}
+		cache->buckets = calloc(cache->nbuckets,
+					sizeof(cache_entry_t*));
+		if (!cache->buckets) {
+			printf("couldn't allocate cache buckets\n");
+			goto error;
+		}
+	}
+
+	if (path && __file_open(cache, path, file_size)) {
+		goto error;
+	}
+
+	return cache;
+
+    error:
+	cache_delete(cache);
+	return NULL;
+}
+
+void cache_delete(cache_t* cache) {
+	if (!cache) {
+		return;
+	}
+	while (cache->lru_tail) {
+		__mem_remove(cache, cache->lru_tail);
+	}
+	free(cache->buckets);
+	if (cache->map) {
+		munmap(cache->map, cache->map_size);
+	}
+	if (cache->fd >= 0) {
+		close(cache->fd);
+	}
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+}
+
+int cache_lookup(cache_t* cache, const algo_arg_t* args,
+		 int algorithm, int bound,
+		 int* score, alignment_t** alignments, int* nalignments)
+{
+	cache_key_t key;
+	__make_key(args, algorithm, bound, &key);
+
+	int hit = 0;
+	pthread_mutex_lock(&cache->lock);
+	cache_entry_t* e = cache->buckets ? __mem_find(cache, &key) : NULL;
+	if (e) {
+		__lru_unlink(cache, e);
+		__lru_push(cache, e);
+		hit = __payload_read(args, e->payload, e->size, key.swap,
+				     score, alignments, nalignments);
+	}
+	else {
+		size_t size;
+		const uint8_t* payload = __file_find(cache, &key, &size);
+		if (payload) {
+			hit = __payload_read(args, payload, size, key.swap,
+					     score, alignments, nalignments);
+			if (hit) {
+				__mem_insert(cache, &key, payload, size);
+			}
+		}
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	VERBOSE_FMT("cache %s\n", hit ? "hit" : "miss");
+	return hit;
+}
+
+void cache_store(cache_t* cache, const algo_arg_t* args,
+		 int algorithm, int bound,
+		 int score, const alignment_t* alignments, int nalignments)
+{
+	cache_key_t key;
+	__make_key(args, algorithm, bound, &key);
+
+	size_t size;
+	uint8_t* payload = __payload_build(score, alignments, nalignments,
+					   key.swap, &size);
+	if (!payload) {
+		return;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	__mem_insert(cache, &key, payload, size);
+	__file_insert(cache, &key, payload, size);
+	pthread_mutex_unlock(&cache->lock);
+
+	free(payload);
+}
+
@@ -0,0 +1,48 @@
+#ifndef _cache_h_
+#define _cache_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "alignment.h"
+
+/* Alignment results cache.
+ *
+ * Results are keyed by a hash of (seq_a, seq_b, algorithm, scoring, bound)
+ * and hold the score and the run-length encoded alignments.
+ * Pairs are stored in a canonical order, so looking up (b, a) after storing
+ * (a, b) hits and returns the alignments with up and down exchanged.
+ *
+ * There are two tiers:
+ *  - an in memory LRU limited to a number of bytes,
+ *  - an optional file mapped in memory that survives restarts, used as a
+ *    ring buffer of entries indexed by a direct mapped table.
+ *
+ * A cache can be shared by threads, but its file must be used by a single
+ * process at a time.
+ */
+typedef struct cache cache_t;
+
+/* Create a cache, `path` can be NULL to disable the file tier.
+ * Returns NULL on error.
+ */
+cache_t* cache_new(size_t mem_budget, const char* path, size_t file_size);
+
+void cache_delete(cache_t* cache);
+
+/* Look for the results of aligning args sequences.
+ * On hit, returns 1 and gives the score and, if `alignments` is not NULL,
+ * an array of `nalignments` alignments to wipe and free by the caller.
+ * Returns 0 on miss.
+ */
+int cache_lookup(cache_t* cache, const algo_arg_t* args,
+		 int algorithm, int bound,
+		 int* score, alignment_t** alignments, int* nalignments);
+
+void cache_store(cache_t* cache, const algo_arg_t* args,
+		 int algorithm, int bound,
+		 int score, const alignment_t* alignments, int nalignments);
+
+#endif
+
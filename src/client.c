@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "protocol.h"
+
+/* Minimal client of the alignment server (nw --serve), mostly useful to test
+ * the server locally.
+ */
+
+static const char* status_names[] = {
+	"ok",
+	"cancelled",
+	"timeout",
+	"error",
+	"below threshold",
+};
+
+void help() {
+	printf("usage: nw-client [options] socket sequence1 sequence2\n\n"
+
+	       "send alignment requests to a `nw --serve` server.\n\n"
+
+	       "options are:\n"
+	       " -h			print this help\n"
+	       " -a <algo>		algorithm to use (default iterative)\n"
+	       " -m <max>		max alignments to receive (0 for score)\n"
+	       " -d <ms>		request deadline in milliseconds\n"
+	       " -n <count>		send the request `count` times at once\n"
+	       " -C			cancel the requests right after sending\n");
+}
+
+static int connect_server(const char* path) {
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("socket path too long: %s\n", path);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		printf("couldn't create socket: %s\n", strerror(errno));
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr*) &addr, sizeof(addr))) {
+		printf("couldn't connect to %s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int main(int argc, char** argv) {
+	nwp_align_t req;
+	int count = 1;
+	int cancel = 0;
+
+	memset(&req, 0, sizeof(req));
+	strcpy(req.algorithm, "iterative");
+	req.bound = -1;
+
+	int opt_c;
+	while ((opt_c = getopt(argc, argv, "ha:m:d:n:C")) > 0) {
+		switch (opt_c) {
+		    case 'h':
+			help();
+			return 0;
+
+		    case 'a':
+			if (strlen(optarg) >= sizeof(req.algorithm)) {
+				printf("invalid algorithm\n");
+				return 1;
+			}
+			strcpy(req.algorithm, optarg);
+			break;
+
+		    case 'm':
+			if (sscanf(optarg, "%d", &req.bound) != 1) {
+				printf("invalid max parameter\n");
+				return 1;
+			}
+			break;
+
+		    case 'd':
+			if (sscanf(optarg, "%u", &req.deadline_ms) != 1) {
+				printf("invalid deadline\n");
+				return 1;
+			}
+			break;
+
+		    case 'n':
+			if (sscanf(optarg, "%d", &count) != 1 || count < 1) {
+				printf("invalid count\n");
+				return 1;
+			}
+			break;
+
+		    case 'C':
+			cancel = 1;
+			break;
+
+		    default:
+			help();
+			return 1;
+		}
+	}
+
+	if (argc - optind < 3) {
+		help();
+		return 1;
+	}
+
+	req.seq_a = argv[optind + 1];
+	req.seq_b = argv[optind + 2];
+	req.len_a = strlen(req.seq_a);
+	req.len_b = strlen(req.seq_b);
+
+	int fd = connect_server(argv[optind]);
+	if (fd < 0) {
+		return 1;
+	}
+
+	/* Pipeline all the requests, the server can batch them */
+	for (int i = 0; i < count; i++) {
+		if (nwp_send_align(fd, i, &req)) {
+			printf("couldn't send request %d\n", i);
+			close(fd);
+			return 1;
+		}
+		if (cancel && nwp_send(fd, NWP_CANCEL, i, NULL, 0)) {
+			printf("couldn't cancel request %d\n", i);
+			close(fd);
+			return 1;
+		}
+	}
+
+	int ret = 0;
+	int remaining = count;
+	nwp_frame_t frame;
+	while (remaining > 0 && nwp_recv(fd, &frame) == 0) {
+		if (count > 1) {
+			printf("[%u] ", frame.id);
+		}
+
+		switch (frame.type) {
+		    case NWP_SCORE:
+			printf("alignment score: %d\n",
+			       (int32_t) nwp_get_u32(frame.payload));
+			break;
+
+		    case NWP_ALIGNMENT: {
+			uint32_t len = nwp_get_u32(frame.payload + 4);
+			const char* up = (const char*) frame.payload + 8;
+			printf("alignment %u:\n", nwp_get_u32(frame.payload) + 1);
+			printf("%.*s\n%.*s\n", (int) len, up,
+			       (int) len, up + len);
+			break;
+		    }
+
+		    case NWP_DONE: {
+			uint8_t status = frame.payload[0];
+			printf("done: %s, %u alignment(s)\n",
+			       (status < 5) ? status_names[status] : "unknown",
+			       nwp_get_u32(frame.payload + 1));
+			if (status != NWP_OK && status != NWP_BELOW) {
+				ret = 1;
+			}
+			remaining--;
+			break;
+		    }
+
+		    default:
+			printf("unexpected frame type %d\n", frame.type);
+			break;
+		}
+		nwp_frame_wipe(&frame);
+	}
+
+	if (remaining > 0) {
+		printf("connection closed with %d pending request(s)\n",
+		       remaining);
+		ret = 1;
+	}
+
+	close(fd);
+	return ret;
+}
+
@@ -0,0 +1,628 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "common.h"
+#include "alignment.h"
+#include "protocol.h"
+#include "hash.h"
+#include "nw_case.h"
+#include "cluster.h"
+
+/* Traceback states, as in alignment.c */
+enum {
+	ST_H,
+	ST_E,
+	ST_F,
+};
+
+typedef struct rank {
+	const algo_arg_t*	args;
+	const scoring_t*	sc;
+	int			affine;
+	int			rank;
+	int			n;
+	int			x0;		/* first column of the block */
+	int			x1;		/* past its last column */
+	int			left;		/* sockets, -1 if none */
+	int			right;
+	matrix_t		moves;		/* (x1 - x0) x (len_b + 1) */
+} rank_t;
+
+static cluster_cfg_t __cfg = { .processes = 1 };
+
+void cluster_cfg_default(cluster_cfg_t* cfg) {
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->processes = 1;
+}
+
+int cluster_parse_peers(cluster_cfg_t* cfg, const char* list) {
+	cfg->npeers = 0;
+	while (*list) {
+		size_t len = strcspn(list, ",");
+		if (cfg->npeers == CLUSTER_MAX_PEERS
+		||  len == 0 || len >= sizeof(cfg->peers[0]))
+		{
+			return 1;
+		}
+		memcpy(cfg->peers[cfg->npeers], list, len);
+		cfg->peers[cfg->npeers][len] = '\0';
+		if (!strrchr(cfg->peers[cfg->npeers], ':')) {
+			return 1;
+		}
+		cfg->npeers++;
+		list += len + (list[len] == ',');
+	}
+	return cfg->npeers == 0;
+}
+
+void cluster_setup(const cluster_cfg_t* cfg) {
+	__cfg = *cfg;
+}
+
+/* Split "host:port" of `peer` in `host` and returns the port */
+static const char* __split_peer(const char* peer, char* host, size_t size) {
+	const char* port = strrchr(peer, ':');
+	size_t len = min((size_t) (port - peer), size - 1);
+	memcpy(host, peer, len);
+	host[len] = '\0';
+	return port + 1;
+}
+
+static void __nodelay(int fd) {
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static int __listen(const char* peer) {
+	char host[128];
+	const char* port = __split_peer(peer, host, sizeof(host));
+	struct addrinfo hints, *ai;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if (getaddrinfo(NULL, port, &hints, &ai)) {
+		printf("couldn't resolve port %s\n", port);
+		return -1;
+	}
+
+	int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	int one = 1;
+	if (fd >= 0) {
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	}
+	if (fd < 0 || bind(fd, ai->ai_addr, ai->ai_addrlen)
+	||  listen(fd, 1))
+	{
+		printf("couldn't listen on port %s: %s\n", port,
+		       strerror(errno));
+		if (fd >= 0) {
+			close(fd);
+		}
+		fd = -1;
+	}
+	freeaddrinfo(ai);
+	return fd;
+}
+
+/* Connect to the next host, which may not be listening yet */
+static int __connect(const char* peer) {
+	char host[128];
+	const char* port = __split_peer(peer, host, sizeof(host));
+	struct addrinfo hints, *ai;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &ai)) {
+		printf("couldn't resolve %s\n", peer);
+		return -1;
+	}
+
+	int fd = -1;
+	for (int tries = 0; tries < 10 * CLUSTER_CONNECT_TIMEOUT; tries++) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0 || !connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+		usleep(100 * 1000);
+	}
+	freeaddrinfo(ai);
+
+	if (fd < 0) {
+		printf("couldn't connect to %s\n", peer);
+		return -1;
+	}
+	__nodelay(fd);
+	return fd;
+}
+
+/* Receive a frame of given type */
+static int __recv(int fd, uint8_t type, nwp_frame_t* frame, size_t size) {
+	if (nwp_recv(fd, frame)) {
+		printf("cluster peer disconnected\n");
+		return 1;
+	}
+	if (frame->type != type || frame->size < size) {
+		printf("unexpected frame from cluster peer\n");
+		nwp_frame_wipe(frame);
+		return 1;
+	}
+	return 0;
+}
+
+/* Check the previous process aligns the same sequences */
+static int __hello(rank_t* r) {
+	const algo_arg_t* args = r->args;
+	uint64_t hash_a = hash64(args->seq_a, args->len_a, 0);
+	uint64_t hash_b = hash64(args->seq_b, args->len_b, 0);
+	uint8_t buf[28];
+	if (r->right >= 0) {
+		nwp_put_u32(buf, r->n);
+		nwp_put_u32(buf + 4, args->len_a);
+		nwp_put_u32(buf + 8, args->len_b);
+		nwp_put_u64(buf + 12, hash_a);
+		nwp_put_u64(buf + 20, hash_b);
+		struct iovec part = { buf, sizeof(buf) };
+		if (nwp_send(r->right, NWP_HELLO, 0, &part, 1)) {
+			printf("couldn't reach the next cluster process\n");
+			return 1;
+		}
+	}
+	if (r->left >= 0) {
+		nwp_frame_t frame;
+		if (__recv(r->left, NWP_HELLO, &frame, sizeof(buf))) {
+			return 1;
+		}
+		int processes = nwp_get_u32(frame.payload) == (uint32_t) r->n;
+		int same = nwp_get_u32(frame.payload + 4) == args->len_a
+			&& nwp_get_u32(frame.payload + 8) == args->len_b
+			&& nwp_get_u64(frame.payload + 12) == hash_a
+			&& nwp_get_u64(frame.payload + 20) == hash_b;
+		nwp_frame_wipe(&frame);
+		if (!processes) {
+			printf("cluster processes have different peers\n");
+			return 1;
+		}
+		if (!same) {
+			printf("cluster processes have different sequences\n");
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int __send_boundary(rank_t* r, uint8_t* buf, int first, int rows) {
+	nwp_put_u32(buf, first);
+	nwp_put_u32(buf + 4, rows);
+	struct iovec part = { buf, 8 + 8 * rows };
+	if (nwp_send(r->right, NWP_BOUNDARY, 0, &part, 1)) {
+		printf("couldn't send boundary to the next cluster process\n");
+		return 1;
+	}
+	return 0;
+}
+
+/* Compute the block row by row, receiving the column on its left and
+ * sending its last one by chunks of rows.
+ */
+static int __compute(rank_t* r, int* score) {
+	const algo_arg_t* args = r->args;
+	int w = r->x1 - r->x0;
+	int ret = 1;
+	int* row = calloc(3 * w, sizeof(int));
+	uint8_t* out = malloc(8 + 8 * CLUSTER_CHUNK);
+	nwp_frame_t in;
+	memset(&in, 0, sizeof(in));
+	if (!row || !out) {
+		printf("couldn't allocate cluster rows\n");
+		goto end;
+	}
+	int* row_h = row;
+	int* row_e = row + w;
+	int* row_f = row + 2 * w;
+
+	int first = 0;		/* first row of the received chunk */
+	int diag_h = 0;		/* left column score of the previous row */
+	for (int y = 0; y <= args->len_b; y++) {
+		int left_h = 0;
+		int left_e = 0;
+		if (r->left >= 0) {
+			int rows = min(CLUSTER_CHUNK, args->len_b + 1 - y);
+			if (y % CLUSTER_CHUNK == 0) {
+				nwp_frame_wipe(&in);
+				if (__recv(r->left, NWP_BOUNDARY, &in,
+					   8 + 8 * rows))
+				{
+					goto end;
+				}
+				first = nwp_get_u32(in.payload);
+				if (first != y
+				||  nwp_get_u32(in.payload + 4) != rows)
+				{
+					printf("unexpected boundary rows\n");
+					goto end;
+				}
+			}
+			const uint8_t* p = in.payload + 8 + 8 * (y - first);
+			left_h = (int32_t) nwp_get_u32(p);
+			left_e = (int32_t) nwp_get_u32(p + 4);
+		}
+
+		int diag = diag_h;
+		diag_h = left_h;
+		for (int i = 0; i < w; i++) {
+			int top_h = row_h[i];
+			char move = nw_case(r->sc, r->affine, args->seq_a,
+					    args->seq_b, r->x0 + i, y, diag,
+					    left_h, left_e, top_h, row_f[i],
+					    row_h + i, row_e + i, row_f + i);
+			size_t off = matrix_coord_offset(&r->moves, i, y);
+			r->moves.v.c[off] = move;
+			diag = top_h;
+			left_h = row_h[i];
+			left_e = row_e[i];
+		}
+
+		if (r->right >= 0) {
+			int k = y % CLUSTER_CHUNK;
+			nwp_put_u32(out + 8 + 8 * k, row_h[w - 1]);
+			nwp_put_u32(out + 8 + 8 * k + 4, row_e[w - 1]);
+			if ((k == CLUSTER_CHUNK - 1 || y == args->len_b)
+			&&  __send_boundary(r, out, y - k, k + 1))
+			{
+				goto end;
+			}
+		}
+	}
+	*score = row_h[w - 1];
+	ret = 0;
+
+    end:
+	nwp_frame_wipe(&in);
+	free(row);
+	free(out);
+	return ret;
+}
+
+/* Follow the path in the block, from the cursor to the block on the left,
+ * appending it to `up` and `down` (reversed). Moves are taken in the order
+ * of the first alignment of compute_alignments.
+ */
+static void __walk(const rank_t* r, int* px, int* py, int* pstate,
+		   char* up, char* down, size_t* len)
+{
+	const char* a = r->args->seq_a;
+	const char* b = r->args->seq_b;
+	int x = *px, y = *py, state = *pstate;
+
+	while (x >= r->x0 && (x > 0 || y > 0)) {
+		char move = r->moves.v.c[matrix_coord_offset(&r->moves,
+							     x - r->x0, y)];
+		int top = 0, left = 0, diag = 0;
+		if (state == ST_H) {
+			if (move & MOVE_TOP) {
+				top = move & (MOVE_F_OPEN | MOVE_F_EXT);
+				top = top ? top : MOVE_F_OPEN;
+			}
+			if (move & MOVE_LEFT) {
+				left = move & (MOVE_E_OPEN | MOVE_E_EXT);
+				left = left ? left : MOVE_E_OPEN;
+			}
+			diag = move & MOVE_TOP_LEFT;
+		}
+		else if (state == ST_F) {
+			top = move & (MOVE_F_OPEN | MOVE_F_EXT);
+		}
+		else {
+			left = move & (MOVE_E_OPEN | MOVE_E_EXT);
+		}
+
+		if (top & MOVE_F_OPEN) {
+			up[*len] = '-';
+			down[*len] = b[--y];
+			state = ST_H;
+		}
+		else if (left & MOVE_E_OPEN) {
+			up[*len] = a[--x];
+			down[*len] = '-';
+			state = ST_H;
+		}
+		else if (diag) {
+			up[*len] = a[--x];
+			down[*len] = b[--y];
+			state = ST_H;
+		}
+		else if (top & MOVE_F_EXT) {
+			up[*len] = '-';
+			down[*len] = b[--y];
+			state = ST_F;
+		}
+		else {
+			up[*len] = a[--x];
+			down[*len] = '-';
+			state = ST_E;
+		}
+		(*len)++;
+	}
+
+	*px = x;
+	*py = y;
+	*pstate = state;
+}
+
+static int __traceback(rank_t* r, int score, algo_res_t* res) {
+	const algo_arg_t* args = r->args;
+	size_t size = args->len_a + args->len_b + 1;
+	alignment_t* al = malloc(sizeof(alignment_t));
+	if (!al || alignment_init(al, size)) {
+		printf("couldn't allocate alignment\n");
+		free(al);
+		return ALGO_ERROR;
+	}
+
+	int x = args->len_a;
+	int y = args->len_b;
+	int state = ST_H;
+	size_t len = 0;
+
+	if (r->right >= 0) {
+		nwp_frame_t frame;
+		if (__recv(r->right, NWP_CURSOR, &frame, 13)) {
+			goto error;
+		}
+		score = (int32_t) nwp_get_u32(frame.payload);
+		y = nwp_get_u32(frame.payload + 4);
+		state = frame.payload[8];
+		len = nwp_get_u32(frame.payload + 9);
+		if (frame.size != 13 + 2 * len || len >= size) {
+			printf("unexpected cursor frame\n");
+			nwp_frame_wipe(&frame);
+			goto error;
+		}
+		memcpy(al->up, frame.payload + 13, len);
+		memcpy(al->down, frame.payload + 13 + len, len);
+		nwp_frame_wipe(&frame);
+		x = r->x1 - 1;
+	}
+
+	__walk(r, &x, &y, &state, al->up, al->down, &len);
+
+	if (r->left >= 0) {
+		uint8_t fields[13];
+		nwp_put_u32(fields, score);
+		nwp_put_u32(fields + 4, y);
+		fields[8] = state;
+		nwp_put_u32(fields + 9, len);
+		struct iovec parts[3] = {
+			{ fields, sizeof(fields) },
+			{ al->up, len },
+			{ al->down, len },
+		};
+		int ret = nwp_send(r->left, NWP_CURSOR, 0, parts, 3);
+		alignment_wipe(al);
+		free(al);
+		if (ret) {
+			printf("couldn't send cursor to the previous cluster "
+			       "process\n");
+			return ALGO_ERROR;
+		}
+		res->score = score;
+		res->count = 0;
+		return ALGO_OK;
+	}
+
+	/* First process, the alignment was built from its end */
+	for (size_t i = 0; i < len / 2; i++) {
+		char c = al->up[i];
+		al->up[i] = al->up[len - 1 - i];
+		al->up[len - 1 - i] = c;
+		c = al->down[i];
+		al->down[i] = al->down[len - 1 - i];
+		al->down[len - 1 - i] = c;
+	}
+	al->up[len] = '\0';
+	al->down[len] = '\0';
+	res->score = score;
+	res->alignments = al;
+	res->count = 1;
+	return ALGO_OK;
+
+    error:
+	alignment_wipe(al);
+	free(al);
+	return ALGO_ERROR;
+}
+
+static int __run_rank(rank_t* r, algo_res_t* res) {
+	const algo_arg_t* args = r->args;
+
+	/* Columns are shared evenly */
+	size_t w = args->len_a + 1;
+	r->x0 = w * r->rank / r->n;
+	r->x1 = w * (r->rank + 1) / r->n;
+
+	if (matrix_init(&r->moves, r->x1 - r->x0, args->len_b + 1,
+			sizeof(char), MATRIX_ALLOC_DEFAULT,
+			MATRIX_LAYOUT_TILED))
+	{
+		printf("couldn't allocate move matrix\n");
+		return ALGO_ERROR;
+	}
+	VERBOSE_FMT("cluster process %d: columns %d to %d\n", r->rank,
+		    r->x0, r->x1 - 1);
+
+	int score = 0;
+	int ret = ALGO_ERROR;
+	if (!__hello(r) && !__compute(r, &score)) {
+		ret = __traceback(r, score, res);
+	}
+
+	matrix_wipe(&r->moves);
+	return ret;
+}
+
+/* Processes on several hosts, this one being `rank` */
+static int __run_peers(rank_t* r, algo_res_t* res) {
+	int listener = -1;
+	int ret = ALGO_ERROR;
+
+	r->rank = __cfg.rank;
+	r->n = __cfg.npeers;
+	if (r->rank < 0 || r->rank >= r->n) {
+		printf("cluster rank must be lower than the number of peers\n");
+		return ALGO_ERROR;
+	}
+	/* Every process owns at least a column */
+	if (r->n > r->args->len_a + 1) {
+		printf("cluster has more peers than columns (%d)\n",
+		       r->args->len_a + 1);
+		return ALGO_ERROR;
+	}
+
+	/* Listen before connecting, so that the chain can't deadlock */
+	if (r->rank > 0 && (listener = __listen(__cfg.peers[r->rank])) < 0) {
+		goto end;
+	}
+	if (r->rank < r->n - 1
+	&&  (r->right = __connect(__cfg.peers[r->rank + 1])) < 0)
+	{
+		goto end;
+	}
+	if (listener >= 0) {
+		r->left = accept(listener, NULL, NULL);
+		if (r->left < 0) {
+			printf("couldn't accept the previous cluster process\n");
+			goto end;
+		}
+		__nodelay(r->left);
+	}
+
+	ret = __run_rank(r, res);
+
+    end:
+	if (listener >= 0) {
+		close(listener);
+	}
+	if (r->left >= 0) {
+		close(r->left);
+	}
+	if (r->right >= 0) {
+		close(r->right);
+	}
+	return ret;
+}
+
+/* Local processes chained by socket pairs, this one being the first */
+static int __run_local(rank_t* r, algo_res_t* res) {
+	int n = r->n;
+	int links[n][2];
+	pid_t pids[n];
+	int ret = ALGO_ERROR;
+	int nlinks = 0;
+	int nchilds = 0;
+
+	for (; nlinks < n - 1; nlinks++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, links[nlinks])) {
+			printf("couldn't create cluster sockets\n");
+			goto end;
+		}
+	}
+
+	/* Buffered output would be printed again by the children */
+	fflush(stdout);
+	for (int k = 1; k < n; k++, nchilds++) {
+		pids[k] = fork();
+		if (pids[k] < 0) {
+			printf("couldn't fork cluster process\n");
+			goto end;
+		}
+		if (pids[k] > 0) {
+			continue;
+		}
+
+		for (int l = 0; l < nlinks; l++) {
+			if (l != k - 1) {
+				close(links[l][1]);
+			}
+			if (l != k) {
+				close(links[l][0]);
+			}
+		}
+		r->rank = k;
+		r->left = links[k - 1][1];
+		r->right = (k < n - 1) ? links[k][0] : -1;
+		algo_res_t child_res;
+		memset(&child_res, 0, sizeof(child_res));
+		int child_ret = __run_rank(r, &child_res);
+		fflush(stdout);
+		_exit(child_ret);
+	}
+
+	for (int l = 0; l < nlinks; l++) {
+		close(links[l][1]);
+		if (l > 0) {
+			close(links[l][0]);
+		}
+	}
+	nlinks = 0;
+	r->rank = 0;
+	r->right = (n > 1) ? links[0][0] : -1;
+	ret = __run_rank(r, res);
+	if (r->right >= 0) {
+		close(r->right);
+	}
+
+    end:
+	for (int l = 0; l < nlinks; l++) {
+		close(links[l][0]);
+		close(links[l][1]);
+	}
+	for (int k = 1; k <= nchilds; k++) {
+		int status;
+		if (waitpid(pids[k], &status, 0) < 0 || !WIFEXITED(status)
+		||  WEXITSTATUS(status) != ALGO_OK)
+		{
+			ret = ALGO_ERROR;
+		}
+	}
+	if (ret == ALGO_ERROR && res->alignments) {
+		alignment_wipe(res->alignments);
+		free(res->alignments);
+		res->alignments = NULL;
+		res->count = 0;
+	}
+	return ret;
+}
+
+int nw_cluster(const algo_arg_t* args, algo_res_t* res,
+	       matrix_t* move_matrix)
+{
+	(void) move_matrix;
+
+	rank_t r;
+	memset(&r, 0, sizeof(r));
+	r.args = args;
+	r.sc = args->scoring ? args->scoring : &scoring_default;
+	r.affine = scoring_is_affine(r.sc);
+	r.left = -1;
+	r.right = -1;
+
+	if (__cfg.npeers > 0) {
+		return __run_peers(&r, res);
+	}
+
+	/* Every process owns at least a column */
+	r.n = max(1, min(__cfg.processes, args->len_a + 1));
+	return __run_local(&r, res);
+}
+
@@ -0,0 +1,52 @@
+#ifndef _cluster_h_
+#define _cluster_h_
+
+#include "common.h"
+
+/* Distributed wavefront over processes (the clusterized algorithm).
+ *
+ * The columns of the matrix (characters of seq_a) are split in contiguous
+ * blocks, one per process, processes being chained from left to right.
+ * A process computes its block row by row, and streams the scores of its
+ * last column to its right neighbour by chunks of CLUSTER_CHUNK rows: the
+ * wavefront is pipelined, the process k starting its first rows as soon
+ * as k - 1 sent them.
+ *
+ * Each process keeps the moves of its block. The traceback starts in the
+ * last process, and the path cursor (row and gap state) goes left with the
+ * part of the alignment already built each time the path leaves a block.
+ * The first process puts the single alignment together.
+ *
+ * Processes are either forked locally (`-c`, connected by socket pairs)
+ * or started by hand on several hosts with the same sequences and the
+ * list of their `host:port` (connected by TCP, each process listening on
+ * its own port and connecting to the next one).
+ */
+
+#define CLUSTER_CHUNK		256	/* rows per boundary frame */
+#define CLUSTER_CONNECT_TIMEOUT	60	/* seconds to reach the next host */
+#define CLUSTER_MAX_PEERS	64
+
+typedef struct cluster_cfg {
+	int	processes;			/* local processes */
+	int	rank;				/* rank among peers */
+	int	npeers;				/* 0 for local processes */
+	char	peers[CLUSTER_MAX_PEERS][128];	/* host:port of each rank */
+} cluster_cfg_t;
+
+void cluster_cfg_default(cluster_cfg_t* cfg);
+
+/* Parse a comma separated list of host:port */
+int cluster_parse_peers(cluster_cfg_t* cfg, const char* list);
+
+/* Set the configuration of the next runs */
+void cluster_setup(const cluster_cfg_t* cfg);
+
+/* The algorithm. The first process computes the single alignment in
+ * res->alignments, other ranks return none. It doesn't use `move_matrix`.
+ */
+int nw_cluster(const algo_arg_t* args, algo_res_t* res,
+	       matrix_t* move_matrix);
+
+#endif
+
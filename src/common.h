@@ -1,6 +1,8 @@
 #ifndef _common_h_
 #define _common_h_
 
+#include <time.h>
+
 #include "matrix.h"
 
 
@@ -24,15 +26,61 @@ typedef struct algo_arg {
 	char*	seq_b;
 	int	len_a;
 	int	len_b;
+
+	/* Optional abort conditions, checked between diagonals */
+	volatile int*	cancel;		/* abort as soon as it is non zero */
+	struct timespec	deadline;	/* CLOCK_MONOTONIC, zero if none */
+
+	/* Write the move matrix with non-temporal stores */
+	int		nt_store;
+
+	/* Parallelized kernel: diagonals shorter than `par_cutoff` cases are
+	 * computed by a single thread, and threads take chunks of `omp_chunk`
+	 * cases, diagonals being split evenly if 0 (see tune.h).
+	 */
+	int		par_cutoff;
+	int		omp_chunk;
+
+	/* Sequences still being loaded (see stream.h), NULL if loaded */
+	struct stream*	stream_a;
+	struct stream*	stream_b;
+
+	/* Scoring (see scoring.h), the historical one if NULL */
+	const struct scoring*	scoring;
+
+	/* Only scores of at least `min_score` matter if `prune` is set: cases
+	 * which can't reach it anymore are skipped (see `nw`).
+	 */
+	int		prune;
+	int		min_score;
+
+	/* X-drop extension if positive: cases more than `xdrop` below the best
+	 * score so far are skipped, and the alignment ends at the best case
+	 * (see `nw`).
+	 */
+	int		xdrop;
 } algo_arg_t;
 
 /* Result of the run of the algorithm
  */
 typedef struct algo_res {
+	int	score;
 	int count;
 	char**	al_x;
 	char**	al_y;
 	int*	len;
+
+	/* The score is below args->min_score, and wasn't computed */
+	int	below;
+
+	/* End of the X-drop alignment: prefix lengths of seq_a and seq_b */
+	int	end_a;
+	int	end_b;
+
+	/* Alignments of the algorithms computing them without a move matrix
+	 * (ALGO_NO_MATRIX), `count` of them.
+	 */
+	struct alignment*	alignments;
 } algo_res_t;
 
 /* Needleman-Wunsch Algorithm function type.
@@ -40,23 +88,60 @@ typedef struct algo_res {
 typedef int (*algo_func_t)(const algo_arg_t*	args,
 			   algo_res_t*		res,
 			   matrix_t*		move_matrix);
+/* Algorithm function return values */
+enum {
+	ALGO_OK		= 0,
+	ALGO_ERROR	= 1,
+	ALGO_CANCELLED,
+	ALGO_TIMEOUT,
+};
+
+/* Algorithm flags */
+enum {
+	ALGO_NO_MATRIX	= 1,	/* no move matrix, alignments are in the result */
+	ALGO_SCORE_ONLY	= 2,	/* only the score is computed, alignments are
+				 * the iterative algorithm's */
+};
+
 typedef struct algo {
 	char		name[64];
 	char 		desc[256];
 	algo_func_t	func;
+	int		flags;
 } algo_t;
 
 /* Moves values
  */
+/* Moves values.
+ * The first three bits are the best moves to a case. With affine gaps, the
+ * others tell how the gap states were reached: a vertical gap (F) by
+ * opening it from the case above or by extending its gap, and the same for
+ * horizontal gaps (E) from the case on the left.
+ */
 enum {
 	MOVE_NONE	= 0,
 	MOVE_TOP	= 1,
 	MOVE_LEFT	= 2,
 	MOVE_TOP_LEFT	= 4,
+	MOVE_E_OPEN	= 8,
+	MOVE_E_EXT	= 16,
+	MOVE_F_OPEN	= 32,
+	MOVE_F_EXT	= 64,
 };
 
 
 
+/* Algorithms table, defined in main.c
+ */
+extern algo_t algorithms[];
+
+int find_algo_id(const char* name);
+
+/* Returns ALGO_CANCELLED or ALGO_TIMEOUT if the run must be aborted,
+ * ALGO_OK otherwise.
+ */
+int algo_should_abort(const algo_arg_t* args);
+
 /* Algorithms prototypes
  */
 int nw(const algo_arg_t* args, algo_res_t* res,
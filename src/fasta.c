@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "fasta.h"
+
+void fasta_wipe(fasta_t* fa) {
+	free(fa->names);
+	free(fa->seqs);
+	free(fa->lens);
+	free(fa->buf);
+}
+
+static int __fasta_push(fasta_t* fa, int* size, char* name) {
+	if (fa->n == *size) {
+		*size = *size ? 2 * *size : 64;
+		char** names = realloc(fa->names, *size * sizeof(char*));
+		if (names) {
+			fa->names = names;
+		}
+		char** seqs = realloc(fa->seqs, *size * sizeof(char*));
+		if (seqs) {
+			fa->seqs = seqs;
+		}
+		int* lens = realloc(fa->lens, *size * sizeof(int));
+		if (lens) {
+			fa->lens = lens;
+		}
+		if (!names || !seqs || !lens) {
+			printf("couldn't allocate sequences\n");
+			return 1;
+		}
+	}
+	fa->names[fa->n] = name;
+	fa->seqs[fa->n] = NULL;
+	fa->lens[fa->n] = 0;
+	fa->n++;
+	return 0;
+}
+
+int fasta_load(fasta_t* fa, const char* path) {
+	memset(fa, 0, sizeof(*fa));
+
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		printf("couldn't open fasta file %s\n", path);
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	fa->buf = malloc(size + 1);
+	if (!fa->buf || fread(fa->buf, 1, size, f) != (size_t) size) {
+		printf("couldn't read fasta file %s\n", path);
+		fclose(f);
+		fasta_wipe(fa);
+		return 1;
+	}
+	fa->buf[size] = '\0';
+	fclose(f);
+
+	int capacity = 0;
+	char* r = fa->buf;
+	char* w = NULL;
+	while (*r) {
+		if (*r == '>') {
+			if (w) {
+				*w = '\0';
+			}
+			char* name = ++r;
+			while (*r && !isspace((unsigned char) *r)) {
+				r++;
+			}
+			int eol = (*r == '\n');
+			if (*r) {
+				*r++ = '\0';
+			}
+			while (!eol && *r && *r != '\n') {
+				r++;
+			}
+			if (__fasta_push(fa, &capacity, name)) {
+				fasta_wipe(fa);
+				return 1;
+			}
+			w = r;
+			fa->seqs[fa->n - 1] = w;
+			continue;
+		}
+
+		if (!isspace((unsigned char) *r)) {
+			if (!w) {
+				printf("%s is not a fasta file\n", path);
+				fasta_wipe(fa);
+				return 1;
+			}
+			*w++ = *r;
+			fa->lens[fa->n - 1]++;
+		}
+		r++;
+	}
+	if (w) {
+		*w = '\0';
+	}
+
+	if (fa->n == 0) {
+		printf("no sequence in %s\n", path);
+		fasta_wipe(fa);
+		return 1;
+	}
+	return 0;
+}
+
@@ -0,0 +1,21 @@
+#ifndef _fasta_h_
+#define _fasta_h_
+
+/* Sequences of a FASTA file. Names are the first word of the headers,
+ * sequence lines are joined without their spaces.
+ */
+typedef struct fasta {
+	int	n;
+	char**	names;
+	char**	seqs;
+	int*	lens;
+	char*	buf;		/* file content, names and sequences point in */
+} fasta_t;
+
+/* Load a FASTA file, sequences are compacted in place in its buffer */
+int fasta_load(fasta_t* fa, const char* path);
+
+void fasta_wipe(fasta_t* fa);
+
+#endif
+
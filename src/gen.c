@@ -0,0 +1,480 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+#include <getopt.h>
+#include <omp.h>
+
+/* Synthetic workloads for nw: a random ancestor sequence, and copies of it
+ * mutated with substitutions and indels.
+ *
+ * Random numbers come from a counter-based generator: the k-th draw at
+ * position i of a stream is a hash of (seed, stream, chunk, i, k). Output
+ * is cut in chunks of GEN_CHUNK ancestor characters generated in parallel,
+ * and is the same whatever the number of threads. Events (repeats,
+ * deletions) don't cross chunk boundaries.
+ */
+
+#define GEN_CHUNK	(1 << 20)	/* ancestor characters per work unit */
+#define GEN_ROUND	64		/* work units generated before writing */
+#define GEN_DRAW_BITS	20		/* draws per position: 2^20 */
+#define GEN_MAX_INDEL	(1 << 16)	/* longest indel */
+#define GEN_MAX_UNIT	6		/* longest tandem repeat unit */
+#define GEN_MAX_COPIES	10		/* most tandem repeat copies */
+
+#define GEN_GOLDEN	0x9e3779b97f4a7c15ULL
+
+/* Draws of a position */
+enum {
+	DRAW_EVENT = 0,
+	DRAW_CHAR,
+	DRAW_LENGTH,
+	DRAW_COPIES,
+	DRAW_INSERT,		/* and following ones, one per character */
+};
+
+static const char* alphabets[][2] = {
+	{ "dna",	"ACGT" },
+	{ "protein",	"ACDEFGHIKLMNPQRSTVWY" },
+};
+
+typedef struct gen_cfg {
+	size_t		length;
+	int		copies;
+	int		fasta;
+	uint64_t	seed;
+	const char*	alphabet;
+	int		size;			/* of the alphabet */
+	double		substitution;		/* rates per position */
+	double		indel;
+	double		indel_length;		/* mean */
+	double		repeats;
+} gen_cfg_t;
+
+/* Generated characters of a work unit */
+typedef struct gen_buf {
+	char*	v;
+	size_t	len;
+	size_t	cap;
+} gen_buf_t;
+
+void help() {
+	printf("usage: nw-gen [options] seq_a seq_b\n\n"
+
+	       "write a random sequence in `seq_a`, and a mutated copy of it in\n"
+	       "`seq_b`, or a fasta file of mutated copies with -n or -F.\n\n"
+
+	       "options are:\n"
+	       " -h			print this help\n"
+	       " -l <length>		length of seq_a (default 1000, K, M, G\n"
+	       "			suffixes allowed)\n"
+	       " -n <count>		number of mutated copies (default 1)\n"
+	       " -F			write the copies as fasta, even a single one\n"
+	       " -S <seed>		random seed (default 0)\n"
+	       " -c <cores>		number of threads\n"
+	       " --alphabet <name>	dna (default) or protein\n"
+	       " --substitution <rate>	substitutions per position (default 0.01)\n"
+	       " --indel <rate>		indels per position (default 0.001), as\n"
+	       "			many insertions as deletions\n"
+	       " --indel-length <mean>	mean of the geometric indel lengths\n"
+	       "			(default 3)\n"
+	       " --repeats <rate>	tandem repeats per position of seq_a\n"
+	       "			(default 0), of up to %d characters copied\n"
+	       "			up to %d times\n",
+	       GEN_MAX_UNIT, GEN_MAX_COPIES);
+}
+
+/* Long only options */
+enum {
+	OPT_ALPHABET = 256,
+	OPT_SUBSTITUTION,
+	OPT_INDEL,
+	OPT_INDEL_LENGTH,
+	OPT_REPEATS,
+};
+
+static const struct option long_options[] = {
+	{ "help",		no_argument,		NULL,	'h' },
+	{ "length",		required_argument,	NULL,	'l' },
+	{ "count",		required_argument,	NULL,	'n' },
+	{ "fasta",		no_argument,		NULL,	'F' },
+	{ "Seed",		required_argument,	NULL,	'S' },
+	{ "core",		required_argument,	NULL,	'c' },
+	{ "alphabet",		required_argument,	NULL,	OPT_ALPHABET },
+	{ "substitution",	required_argument,	NULL,	OPT_SUBSTITUTION },
+	{ "indel",		required_argument,	NULL,	OPT_INDEL },
+	{ "indel-length",	required_argument,	NULL,	OPT_INDEL_LENGTH },
+	{ "repeats",		required_argument,	NULL,	OPT_REPEATS },
+	{ NULL,			0,			NULL,	0 },
+};
+
+/* Finalizer of splitmix64 */
+static inline uint64_t __mix(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* Key of the draws of a chunk of a stream, 0 being the ancestor and c + 1
+ * the copy c.
+ */
+static inline uint64_t __key(const gen_cfg_t* cfg, int stream, size_t chunk)
+{
+	return __mix(__mix(cfg->seed + stream * GEN_GOLDEN) + chunk);
+}
+
+static inline uint64_t __draw(uint64_t key, size_t i, int k) {
+	return __mix(key + (((uint64_t) i << GEN_DRAW_BITS) + k) * GEN_GOLDEN);
+}
+
+/* Uniform in [0, 1) */
+static inline double __unit(uint64_t r) {
+	return (r >> 11) * 0x1.0p-53;
+}
+
+static inline char __char(const gen_cfg_t* cfg, uint64_t r) {
+	return cfg->alphabet[r % cfg->size];
+}
+
+static size_t __indel_length(const gen_cfg_t* cfg, uint64_t r) {
+	if (cfg->indel_length <= 1) {
+		return 1;
+	}
+	double p = 1 / cfg->indel_length;
+	double len = 1 + floor(log(1 - __unit(r)) / log(1 - p));
+	return (len < GEN_MAX_INDEL) ? (size_t) len : GEN_MAX_INDEL;
+}
+
+static int __buf_reserve(gen_buf_t* buf, size_t n) {
+	if (buf->len + n <= buf->cap) {
+		return 0;
+	}
+	size_t cap = buf->cap ? buf->cap : GEN_CHUNK;
+	while (cap < buf->len + n) {
+		cap *= 2;
+	}
+	char* v = realloc(buf->v, cap);
+	if (!v) {
+		return 1;
+	}
+	buf->v = v;
+	buf->cap = cap;
+	return 0;
+}
+
+/* Fill the ancestor characters [first, last) of a chunk */
+static void __ancestor(const gen_cfg_t* cfg, char* seq, size_t chunk,
+		       size_t first, size_t last)
+{
+	uint64_t key = __key(cfg, 0, chunk);
+	size_t i = first;
+	while (i < last) {
+		if (cfg->repeats > 0
+		&&  __unit(__draw(key, i, DRAW_EVENT)) < cfg->repeats)
+		{
+			int unit = 1 + __draw(key, i, DRAW_LENGTH) % GEN_MAX_UNIT;
+			int copies = 2 + __draw(key, i, DRAW_COPIES)
+					 % (GEN_MAX_COPIES - 1);
+			size_t end = i + (size_t) unit * copies;
+			end = (end < last) ? end : last;
+			for (size_t j = i; j < end; j++) {
+				seq[j] = (j - i < unit)
+				       ? __char(cfg, __draw(key, i,
+							    DRAW_INSERT + j - i))
+				       : seq[j - unit];
+			}
+			i = end;
+			continue;
+		}
+		seq[i] = __char(cfg, __draw(key, i, DRAW_CHAR));
+		i++;
+	}
+}
+
+/* Append the mutated ancestor characters [first, last) of a chunk */
+static int __mutate(const gen_cfg_t* cfg, const char* seq, int copy,
+		    size_t chunk, size_t first, size_t last, gen_buf_t* out)
+{
+	uint64_t key = __key(cfg, copy + 1, chunk);
+	double indel = cfg->indel;
+	double sub = indel + cfg->substitution;
+
+	out->len = 0;
+	if (__buf_reserve(out, last - first)) {
+		return 1;
+	}
+	for (size_t i = first; i < last; i++) {
+		double event = __unit(__draw(key, i, DRAW_EVENT));
+		if (event >= sub) {
+			out->v[out->len++] = seq[i];
+			continue;
+		}
+		if (event >= indel) {
+			/* Any other character of the alphabet */
+			const char* c = strchr(cfg->alphabet, seq[i]);
+			int code = c ? c - cfg->alphabet : 0;
+			code += 1 + __draw(key, i, DRAW_CHAR) % (cfg->size - 1);
+			out->v[out->len++] = cfg->alphabet[code % cfg->size];
+			continue;
+		}
+
+		size_t len = __indel_length(cfg, __draw(key, i, DRAW_LENGTH));
+		if (event < indel / 2) {
+			i += len - 1;
+			continue;
+		}
+		if (__buf_reserve(out, len + 1 + (last - i))) {
+			return 1;
+		}
+		for (size_t j = 0; j < len; j++) {
+			out->v[out->len++] = __char(cfg, __draw(key, i,
+								DRAW_INSERT + j));
+		}
+		out->v[out->len++] = seq[i];
+	}
+	return 0;
+}
+
+static int __parse_size(const char* str, size_t* size) {
+	char unit = '\0';
+	unsigned long long v;
+	int n = sscanf(str, "%llu%c", &v, &unit);
+	if (n < 1) {
+		return 1;
+	}
+	switch (unit) {
+	    case 'G': case 'g': v <<= 10;	/* fall through */
+	    case 'M': case 'm': v <<= 10;	/* fall through */
+	    case 'K': case 'k': v <<= 10;	/* fall through */
+	    case '\0':
+		break;
+	    default:
+		return 1;
+	}
+	*size = v;
+	return 0;
+}
+
+static int __parse_rate(const char* str, double* rate) {
+	return sscanf(str, "%lf", rate) != 1 || *rate < 0 || *rate > 1;
+}
+
+/* Write the copies by rounds of GEN_ROUND work units */
+static int __write_copies(const gen_cfg_t* cfg, const char* seq, FILE* out)
+{
+	size_t nchunks = (cfg->length + GEN_CHUNK - 1) / GEN_CHUNK;
+	size_t nunits = (size_t) cfg->copies * (nchunks ? nchunks : 1);
+	gen_buf_t bufs[GEN_ROUND];
+	int ret = 1;
+
+	memset(bufs, 0, sizeof(bufs));
+	for (size_t round = 0; round < nunits; round += GEN_ROUND) {
+		int count = (nunits - round < GEN_ROUND) ? nunits - round
+							 : GEN_ROUND;
+		int error = 0;
+
+		#pragma omp parallel for schedule(dynamic, 1)
+		for (int u = 0; u < count; u++) {
+			size_t unit = round + u;
+			size_t chunk = nchunks ? unit % nchunks : 0;
+			size_t first = chunk * GEN_CHUNK;
+			size_t last = first + GEN_CHUNK;
+			last = (last < cfg->length) ? last : cfg->length;
+			if (__mutate(cfg, seq, nchunks ? unit / nchunks : unit,
+				     chunk, first, last, bufs + u))
+			{
+				#pragma omp atomic write
+				error = 1;
+			}
+		}
+		if (error) {
+			printf("couldn't allocate mutated sequences\n");
+			goto end;
+		}
+
+		for (int u = 0; u < count; u++) {
+			size_t unit = round + u;
+			size_t chunk = nchunks ? unit % nchunks : 0;
+			if (cfg->fasta && chunk == 0) {
+				fprintf(out, "%s>seq%zu\n", unit ? "\n" : "",
+					nchunks ? unit / nchunks : unit);
+			}
+			fwrite(bufs[u].v, 1, bufs[u].len, out);
+		}
+	}
+	if (cfg->fasta) {
+		fprintf(out, "\n");
+	}
+	ret = ferror(out);
+	if (ret) {
+		printf("couldn't write mutated sequences\n");
+	}
+
+    end:
+	for (int u = 0; u < GEN_ROUND; u++) {
+		free(bufs[u].v);
+	}
+	return ret;
+}
+
+int main(int argc, char** argv) {
+	gen_cfg_t cfg;
+	int ret = 1;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.length = 1000;
+	cfg.copies = 1;
+	cfg.alphabet = alphabets[0][1];
+	cfg.substitution = 0.01;
+	cfg.indel = 0.001;
+	cfg.indel_length = 3;
+
+	int opt_c;
+	while ((opt_c = getopt_long(argc, argv, "hl:n:FS:c:",
+				    long_options, NULL)) > 0)
+	{
+		switch (opt_c) {
+		    case 'h':
+			help();
+			return 0;
+
+		    case 'l':
+			if (__parse_size(optarg, &cfg.length)) {
+				printf("invalid length\n");
+				return 1;
+			}
+			break;
+
+		    case 'n':
+			if (sscanf(optarg, "%d", &cfg.copies) != 1
+			||  cfg.copies < 1)
+			{
+				printf("invalid count\n");
+				return 1;
+			}
+			break;
+
+		    case 'F':
+			cfg.fasta = 1;
+			break;
+
+		    case 'S':
+			if (sscanf(optarg, "%" SCNu64, &cfg.seed) != 1) {
+				printf("invalid seed\n");
+				return 1;
+			}
+			break;
+
+		    case 'c': {
+			int cores;
+			if (sscanf(optarg, "%d", &cores) != 1 || cores < 1) {
+				printf("invalid number of cores\n");
+				return 1;
+			}
+			omp_set_num_threads(cores);
+			break;
+		    }
+
+		    case OPT_ALPHABET:
+			cfg.alphabet = NULL;
+			for (int i = 0; i < sizeof(alphabets) / sizeof(*alphabets);
+			     i++)
+			{
+				if (!strcmp(optarg, alphabets[i][0])) {
+					cfg.alphabet = alphabets[i][1];
+				}
+			}
+			if (!cfg.alphabet) {
+				printf("alphabets are: dna, protein\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_SUBSTITUTION:
+			if (__parse_rate(optarg, &cfg.substitution)) {
+				printf("invalid substitution rate\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_INDEL:
+			if (__parse_rate(optarg, &cfg.indel)) {
+				printf("invalid indel rate\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_INDEL_LENGTH:
+			if (sscanf(optarg, "%lf", &cfg.indel_length) != 1
+			||  cfg.indel_length < 1)
+			{
+				printf("invalid indel length\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_REPEATS:
+			if (__parse_rate(optarg, &cfg.repeats)) {
+				printf("invalid repeat rate\n");
+				return 1;
+			}
+			break;
+
+		    default:
+			help();
+			return 1;
+		}
+	}
+
+	if (argc - optind < 2) {
+		help();
+		return 1;
+	}
+	if (cfg.substitution + cfg.indel > 1) {
+		printf("substitution and indel rates add up over 1\n");
+		return 1;
+	}
+	cfg.size = strlen(cfg.alphabet);
+	cfg.fasta |= cfg.copies > 1;
+
+	char* seq = malloc(cfg.length ? cfg.length : 1);
+	FILE* out_a = fopen(argv[optind], "w");
+	FILE* out_b = fopen(argv[optind + 1], "w");
+	if (!seq) {
+		printf("couldn't allocate sequence\n");
+		goto end;
+	}
+	if (!out_a || !out_b) {
+		printf("couldn't open output files\n");
+		goto end;
+	}
+
+	size_t nchunks = (cfg.length + GEN_CHUNK - 1) / GEN_CHUNK;
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (size_t chunk = 0; chunk < nchunks; chunk++) {
+		size_t first = chunk * GEN_CHUNK;
+		size_t last = first + GEN_CHUNK;
+		__ancestor(&cfg, seq, chunk, first,
+			   (last < cfg.length) ? last : cfg.length);
+	}
+
+	/* Raw sequences have no final new line, like the inputs of nw -f */
+	if (fwrite(seq, 1, cfg.length, out_a) != cfg.length) {
+		printf("couldn't write %s\n", argv[optind]);
+		goto end;
+	}
+	ret = __write_copies(&cfg, seq, out_b);
+
+    end:
+	if (out_a && fclose(out_a)) {
+		ret = 1;
+	}
+	if (out_b && fclose(out_b)) {
+		ret = 1;
+	}
+	free(seq);
+	return ret;
+}
+
@@ -0,0 +1,100 @@
+#include <string.h>
+
+#include "hash.h"
+
+#define P1	0x9E3779B185EBCA87ULL
+#define P2	0xC2B2AE3D27D4EB4FULL
+#define P3	0x165667B19E3779F9ULL
+#define P4	0x85EBCA77C2B2AE63ULL
+#define P5	0x27D4EB2F165667C5ULL
+
+static inline uint64_t __rotl(uint64_t v, int r) {
+	return (v << r) | (v >> (64 - r));
+}
+
+static inline uint64_t __read64(const uint8_t* p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t __read32(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t __round(uint64_t acc, uint64_t v) {
+	acc += v * P2;
+	acc = __rotl(acc, 31);
+	return acc * P1;
+}
+
+static inline uint64_t __merge(uint64_t h, uint64_t acc) {
+	h ^= __round(0, acc);
+	return h * P1 + P4;
+}
+
+uint64_t hash64(const void* data, size_t size, uint64_t seed) {
+	const uint8_t* p = data;
+	const uint8_t* end = p + size;
+	uint64_t h;
+
+	if (size >= 32) {
+		uint64_t acc[4] = {
+			seed + P1 + P2,
+			seed + P2,
+			seed,
+			seed - P1
+		};
+		while (p + 32 <= end) {
+			for (int i = 0; i < 4; i++) {
+				acc[i] = __round(acc[i], __read64(p + 8 * i));
+			}
+			p += 32;
+		}
+		h = __rotl(acc[0], 1) + __rotl(acc[1], 7)
+		  + __rotl(acc[2], 12) + __rotl(acc[3], 18);
+		for (int i = 0; i < 4; i++) {
+			h = __merge(h, acc[i]);
+		}
+	}
+	else {
+		h = seed + P5;
+	}
+
+	h += size;
+
+	while (p + 8 <= end) {
+		h ^= __round(0, __read64(p));
+		h = __rotl(h, 27) * P1 + P4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= __read32(p) * P1;
+		h = __rotl(h, 23) * P2 + P3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * P5;
+		h = __rotl(h, 11) * P1;
+		p++;
+	}
+
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t hash64_mix(uint64_t h, uint64_t v) {
+	h ^= __round(0, v);
+	h = __rotl(h, 27) * P1 + P4;
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	return h;
+}
+
@@ -0,0 +1,15 @@
+#ifndef _hash_h_
+#define _hash_h_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Fast non cryptographic 64 bits hash (xxHash64 construction).
+ */
+uint64_t hash64(const void* data, size_t size, uint64_t seed);
+
+/* Mix a 64 bits value into a hash */
+uint64_t hash64_mix(uint64_t h, uint64_t v);
+
+#endif
+
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "alignment.h"
+#include "hirschberg.h"
+
+typedef struct hb {
+	const algo_arg_t*	args;
+	const scoring_t*	sc;
+	int*			fwd;		/* len_a + 1 scores */
+	int*			rev;		/* len_a + 1 scores */
+	alignment_t*		al;
+	size_t			col;		/* next alignment column */
+} hb_t;
+
+/* Scores of aligning seq_b[y0, y1) with every prefix of seq_a[x0, x1),
+ * or with every suffix of it read backwards if `reverse` is set.
+ */
+static void __last_row(const hb_t* hb, int x0, int x1, int y0, int y1,
+		       int reverse, int* h)
+{
+	const char* a = hb->args->seq_a;
+	const char* b = hb->args->seq_b;
+	int gap = hb->sc->gap_extend;
+	int w = x1 - x0;
+
+	for (int x = 0; x <= w; x++) {
+		h[x] = x * gap;
+	}
+	for (int j = 1; j <= y1 - y0; j++) {
+		char cb = reverse ? b[y1 - j] : b[y0 + j - 1];
+		int diag = h[0];
+		h[0] = j * gap;
+		for (int x = 1; x <= w; x++) {
+			char ca = reverse ? a[x1 - x] : a[x0 + x - 1];
+			int up = h[x];
+			int best = diag + scoring_substitute(hb->sc, ca, cb);
+			best = max(best, max(up, h[x - 1]) + gap);
+			diag = up;
+			h[x] = best;
+		}
+	}
+}
+
+static void __append(hb_t* hb, const char* up, const char* down, size_t n) {
+	memcpy(hb->al->up + hb->col, up, n);
+	memcpy(hb->al->down + hb->col, down, n);
+	hb->col += n;
+}
+
+/* Full alignment of a small sub-problem */
+static int __align_base(hb_t* hb, int x0, int x1, int y0, int y1) {
+	algo_arg_t sub = *hb->args;
+	sub.seq_a = hb->args->seq_a + x0;
+	sub.seq_b = hb->args->seq_b + y0;
+	sub.len_a = x1 - x0;
+	sub.len_b = y1 - y0;
+
+	/* The minimum score and X-drop are about the whole pair */
+	sub.prune = 0;
+	sub.xdrop = 0;
+
+	matrix_t m;
+	if (matrix_init(&m, sub.len_a + 1, sub.len_b + 1, sizeof(char),
+			MATRIX_ALLOC_DEFAULT, MATRIX_LAYOUT_DIAGONAL))
+	{
+		printf("couldn't allocate move matrix\n");
+		return ALGO_ERROR;
+	}
+
+	algo_res_t res;
+	memset(&res, 0, sizeof(res));
+	int ret = nw(&sub, &res, &m);
+	if (ret == ALGO_OK) {
+		alignment_t* alignments = NULL;
+		if (compute_alignments(&sub, &m, &alignments, 1) <= 0) {
+			ret = ALGO_ERROR;
+		}
+		else {
+			__append(hb, alignments[0].up, alignments[0].down,
+				 strlen(alignments[0].up));
+			alignment_wipe(alignments);
+			free(alignments);
+		}
+	}
+
+	matrix_wipe(&m);
+	return ret;
+}
+
+static int __align(hb_t* hb, int x0, int x1, int y0, int y1) {
+	int w = x1 - x0;
+	if (y1 - y0 <= 1 || (size_t) (w + 1) * (y1 - y0 + 1)
+			    <= HIRSCHBERG_BASE_CASES)
+	{
+		return __align_base(hb, x0, x1, y0, y1);
+	}
+
+	int mid = y0 + (y1 - y0) / 2;
+	__last_row(hb, x0, x1, y0, mid, 0, hb->fwd);
+	__last_row(hb, x0, x1, mid, y1, 1, hb->rev);
+
+	int split = 0;
+	for (int x = 1; x <= w; x++) {
+		if (hb->fwd[x] + hb->rev[w - x]
+		    > hb->fwd[split] + hb->rev[w - split])
+		{
+			split = x;
+		}
+	}
+
+	int ret = __align(hb, x0, x0 + split, y0, mid);
+	if (ret != ALGO_OK) {
+		return ret;
+	}
+	return __align(hb, x0 + split, x1, mid, y1);
+}
+
+int nw_linear(const algo_arg_t* args, algo_res_t* res,
+	      matrix_t* move_matrix)
+{
+	(void) move_matrix;
+
+	hb_t hb = {
+		.args = args,
+		.sc = args->scoring ? args->scoring : &scoring_default,
+	};
+	if (scoring_is_affine(hb.sc)) {
+		printf("linear space alignment needs linear gaps\n");
+		return ALGO_ERROR;
+	}
+
+	hb.fwd = malloc((args->len_a + 1) * sizeof(int));
+	hb.rev = malloc((args->len_a + 1) * sizeof(int));
+	hb.al = malloc(sizeof(alignment_t));
+	if (!hb.fwd || !hb.rev || !hb.al
+	||  alignment_init(hb.al, args->len_a + args->len_b + 1))
+	{
+		printf("couldn't allocate linear space alignment\n");
+		free(hb.fwd);
+		free(hb.rev);
+		free(hb.al);
+		return ALGO_ERROR;
+	}
+
+	/* Sub-problems don't report their progression */
+	int saved_verbose = verbose;
+	verbose = 0;
+	int ret = __align(&hb, 0, args->len_a, 0, args->len_b);
+	verbose = saved_verbose;
+
+	free(hb.fwd);
+	free(hb.rev);
+	if (ret != ALGO_OK) {
+		alignment_wipe(hb.al);
+		free(hb.al);
+		return ret;
+	}
+
+	hb.al->up[hb.col] = '\0';
+	hb.al->down[hb.col] = '\0';
+	res->score = score_alignment(hb.al, hb.sc);
+	res->below = args->prune && res->score < args->min_score;
+	res->alignments = hb.al;
+	res->count = 1;
+	return ALGO_OK;
+}
+
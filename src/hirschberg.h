@@ -0,0 +1,28 @@
+#ifndef _hirschberg_h_
+#define _hirschberg_h_
+
+#include "common.h"
+
+/* Linear space alignment (Hirschberg).
+ *
+ * The middle row of seq_b is crossed by an optimal alignment at the
+ * column maximizing the sum of the scores of the top half, computed
+ * forwards, and of the bottom half, computed backwards. Both halves are
+ * then aligned recursively, small ones with `nw` and a move matrix. Only
+ * two rows of scores are kept, for twice the cases of a full `nw`.
+ *
+ * Only linear gaps are supported, and a single optimal alignment is
+ * computed.
+ */
+
+/* Sub-problems of at most this many cases are aligned by `nw` */
+#define HIRSCHBERG_BASE_CASES	(64 << 10)
+
+/* The algorithm. It computes its single alignment itself, in
+ * res->alignments, and doesn't use `move_matrix`.
+ */
+int nw_linear(const algo_arg_t* args, algo_res_t* res,
+	      matrix_t* move_matrix);
+
+#endif
+
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "nw_case.h"
+#include "incremental.h"
+
+static inline void __store_move(incr_t* inc, int x, int y, char move) {
+	inc->moves.v.c[matrix_coord_offset(&inc->moves, x, y)] = move;
+}
+
+static int __grow_array(int** array, int size) {
+	int* tmp = realloc(*array, size * sizeof(int));
+	if (!tmp) {
+		return 1;
+	}
+	*array = tmp;
+	return 0;
+}
+
+static int __grow_sequence(char** seq, int* cap, int len) {
+	if (len <= *cap) {
+		return 0;
+	}
+	int size = max(len, 2 * *cap);
+	char* tmp = realloc(*seq, size + 1);
+	if (!tmp) {
+		return 1;
+	}
+	*seq = tmp;
+	*cap = size;
+	return 0;
+}
+
+/* Move the tiles of the matrix to one of the current capacities. Tiles
+ * keep their content, only their rank changes.
+ */
+static int __grow_moves(incr_t* inc) {
+	matrix_t* old = &inc->moves;
+	if (old->w >= inc->cap_a + 1 && old->h >= inc->cap_b + 1) {
+		return 0;
+	}
+
+	matrix_t m;
+	if (matrix_init(&m, max(old->w, inc->cap_a + 1),
+			max(old->h, inc->cap_b + 1), sizeof(char),
+			MATRIX_ALLOC_DEFAULT, MATRIX_LAYOUT_TILED))
+	{
+		printf("couldn't grow move matrix\n");
+		return 1;
+	}
+
+	int tiles_h = (old->h + MATRIX_TILE - 1) >> MATRIX_TILE_SHIFT;
+	for (int ty = 0; ty < tiles_h; ty++) {
+		for (int tx = 0; tx < old->tiles_w; tx++) {
+			size_t src = old->tile_rank[ty * old->tiles_w + tx];
+			size_t dst = m.tile_rank[ty * m.tiles_w + tx];
+			memcpy(m.v.c + (dst << (2 * MATRIX_TILE_SHIFT)),
+			       old->v.c + (src << (2 * MATRIX_TILE_SHIFT)),
+			       MATRIX_TILE * MATRIX_TILE);
+		}
+	}
+
+	matrix_wipe(old);
+	*old = m;
+	return 0;
+}
+
+int incr_init(incr_t* inc, const scoring_t* sc) {
+	memset(inc, 0, sizeof(*inc));
+	inc->scoring = sc ? sc : &scoring_default;
+	inc->affine = scoring_is_affine(inc->scoring);
+	inc->cap_a = INCR_MIN_CAPACITY;
+	inc->cap_b = INCR_MIN_CAPACITY;
+
+	inc->seq_a = malloc(inc->cap_a + 1);
+	inc->seq_b = malloc(inc->cap_b + 1);
+	inc->row_h = malloc((inc->cap_a + 1) * sizeof(int));
+	inc->row_e = malloc((inc->cap_a + 1) * sizeof(int));
+	inc->row_f = malloc((inc->cap_a + 1) * sizeof(int));
+	inc->col_h = malloc((inc->cap_b + 1) * sizeof(int));
+	inc->col_e = malloc((inc->cap_b + 1) * sizeof(int));
+	inc->col_f = malloc((inc->cap_b + 1) * sizeof(int));
+	if (!inc->seq_a || !inc->seq_b || !inc->row_h || !inc->row_e
+	||  !inc->row_f || !inc->col_h || !inc->col_e || !inc->col_f)
+	{
+		printf("couldn't allocate incremental alignment\n");
+		goto error;
+	}
+	if (matrix_init(&inc->moves, inc->cap_a + 1, inc->cap_b + 1,
+			sizeof(char), MATRIX_ALLOC_DEFAULT,
+			MATRIX_LAYOUT_TILED))
+	{
+		printf("couldn't allocate move matrix\n");
+		goto error;
+	}
+
+	inc->seq_a[0] = '\0';
+	inc->seq_b[0] = '\0';
+	inc->row_h[0] = inc->col_h[0] = 0;
+	inc->row_e[0] = inc->col_e[0] = SCORE_NONE;
+	inc->row_f[0] = inc->col_f[0] = SCORE_NONE;
+	return 0;
+
+    error:
+	free(inc->seq_a);
+	free(inc->seq_b);
+	free(inc->row_h);
+	free(inc->row_e);
+	free(inc->row_f);
+	free(inc->col_h);
+	free(inc->col_e);
+	free(inc->col_f);
+	return 1;
+}
+
+void incr_wipe(incr_t* inc) {
+	matrix_wipe(&inc->moves);
+	free(inc->seq_a);
+	free(inc->seq_b);
+	free(inc->row_h);
+	free(inc->row_e);
+	free(inc->row_f);
+	free(inc->col_h);
+	free(inc->col_e);
+	free(inc->col_f);
+}
+
+long incr_append(incr_t* inc, const char* a, int na, const char* b, int nb)
+{
+	const scoring_t* sc = inc->scoring;
+	int old_a = inc->len_a;
+	int old_b = inc->len_b;
+	int len_a = old_a + na;
+	int len_b = old_b + nb;
+
+	if (__grow_sequence(&inc->seq_a, &inc->cap_a, len_a)
+	||  __grow_sequence(&inc->seq_b, &inc->cap_b, len_b)
+	||  __grow_array(&inc->row_h, inc->cap_a + 1)
+	||  __grow_array(&inc->row_e, inc->cap_a + 1)
+	||  __grow_array(&inc->row_f, inc->cap_a + 1)
+	||  __grow_array(&inc->col_h, inc->cap_b + 1)
+	||  __grow_array(&inc->col_e, inc->cap_b + 1)
+	||  __grow_array(&inc->col_f, inc->cap_b + 1))
+	{
+		printf("couldn't grow incremental alignment\n");
+		return -1;
+	}
+	if (__grow_moves(inc)) {
+		return -1;
+	}
+
+	memcpy(inc->seq_a + old_a, a, na);
+	memcpy(inc->seq_b + old_b, b, nb);
+	inc->seq_a[len_a] = '\0';
+	inc->seq_b[len_b] = '\0';
+	inc->len_a = len_a;
+	inc->len_b = len_b;
+
+	/* New columns of the old rows, updating the last column in place.
+	 * The last row gets their bottom case.
+	 */
+	for (int x = old_a + 1; x <= len_a; x++) {
+		int diag = inc->col_h[0];
+		for (int y = 0; y <= old_b; y++) {
+			int left_h = inc->col_h[y];
+			char move = nw_case(sc, inc->affine, inc->seq_a,
+					    inc->seq_b, x, y, diag,
+					    left_h, inc->col_e[y],
+					    y ? inc->col_h[y - 1] : 0,
+					    y ? inc->col_f[y - 1] : 0,
+					    inc->col_h + y, inc->col_e + y,
+					    inc->col_f + y);
+			__store_move(inc, x, y, move);
+			diag = left_h;
+		}
+		inc->row_h[x] = inc->col_h[old_b];
+		inc->row_e[x] = inc->col_e[old_b];
+		inc->row_f[x] = inc->col_f[old_b];
+	}
+
+	/* New rows, updating the last row in place. The last column gets
+	 * their rightmost case.
+	 */
+	for (int y = old_b + 1; y <= len_b; y++) {
+		int diag = inc->row_h[0];
+		for (int x = 0; x <= len_a; x++) {
+			int top_h = inc->row_h[x];
+			char move = nw_case(sc, inc->affine, inc->seq_a,
+					    inc->seq_b, x, y, diag,
+					    x ? inc->row_h[x - 1] : 0,
+					    x ? inc->row_e[x - 1] : 0,
+					    top_h, inc->row_f[x],
+					    inc->row_h + x, inc->row_e + x,
+					    inc->row_f + x);
+			__store_move(inc, x, y, move);
+			diag = top_h;
+		}
+		inc->col_h[y] = inc->row_h[len_a];
+		inc->col_e[y] = inc->row_e[len_a];
+		inc->col_f[y] = inc->row_f[len_a];
+	}
+
+	return (long) na * (old_b + 1) + (long) nb * (len_a + 1);
+}
+
+int incr_score(const incr_t* inc) {
+	return inc->row_h[inc->len_a];
+}
+
+int incr_alignments(const incr_t* inc, alignment_t** alignments, int bound)
+{
+	algo_arg_t args;
+	memset(&args, 0, sizeof(args));
+	args.seq_a = inc->seq_a;
+	args.seq_b = inc->seq_b;
+	args.len_a = inc->len_a;
+	args.len_b = inc->len_b;
+	args.scoring = inc->scoring;
+	return compute_alignments(&args, &inc->moves, alignments, bound);
+}
+
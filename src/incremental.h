@@ -0,0 +1,62 @@
+#ifndef _incremental_h_
+#define _incremental_h_
+
+#include "common.h"
+#include "alignment.h"
+#include "matrix.h"
+#include "scoring.h"
+
+/* Incremental alignment of growing sequences.
+ *
+ * Appending characters to the sequences doesn't change the cases already
+ * computed: only the new columns of the old rows and the new rows (an L
+ * shaped border) are. The scores of the last row and of the last column
+ * are kept to compute them, with their gap states for affine gaps.
+ *
+ * Moves are kept in a tiled matrix sized for a capacity of characters.
+ * When a sequence outgrows it, the capacity doubles and the tiles are
+ * copied whole, their layout not depending on the matrix size. The
+ * traceback is run again from the new end case after each update.
+ */
+
+#define INCR_MIN_CAPACITY	(MATRIX_TILE - 1)
+
+typedef struct incr {
+	const scoring_t*	scoring;	/* the historical one if NULL */
+	int			affine;
+
+	char*	seq_a;
+	char*	seq_b;
+	int	len_a;
+	int	len_b;
+	int	cap_a;			/* characters the buffers can hold */
+	int	cap_b;
+
+	/* Scores of the last row (y = len_b) and last column (x = len_a) */
+	int*	row_h;
+	int*	row_e;
+	int*	row_f;
+	int*	col_h;
+	int*	col_e;
+	int*	col_f;
+
+	matrix_t	moves;		/* (cap_a + 1) x (cap_b + 1), tiled */
+} incr_t;
+
+int incr_init(incr_t* inc, const scoring_t* sc);
+
+void incr_wipe(incr_t* inc);
+
+/* Append `na` characters to seq_a and `nb` to seq_b. Returns the number
+ * of cases computed, -1 on error.
+ */
+long incr_append(incr_t* inc, const char* a, int na, const char* b, int nb);
+
+/* Score of the alignment of the current sequences */
+int incr_score(const incr_t* inc);
+
+/* Alignments of the current sequences, see compute_alignments */
+int incr_alignments(const incr_t* inc, alignment_t** alignments, int bound);
+
+#endif
+
@@ -2,11 +2,31 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <getopt.h>
 
 #include "common.h"
 #include "alignment.h"
 #include "bench.h"
 #include "validate.h"
+#include "server.h"
+#include "cache.h"
+#include "matrix_file.h"
+#include "numa.h"
+#include "russians.h"
+#include "seed.h"
+#include "qgram.h"
+#include "allvsall.h"
+#include "batch.h"
+#include "incremental.h"
+#include "hirschberg.h"
+#include "plan.h"
+#include "cluster.h"
+#include "output.h"
+#include "tune.h"
+#include "stream.h"
+#include "striped.h"
+#include "tiny.h"
+#include "nwb.h"
 
 int verbose = 0;
 
@@ -17,6 +37,10 @@ enum {
 	ALGO_ITERATIVE,
 	ALGO_PARALLELIZED,
 	ALGO_CLUSTERIZED,
+	ALGO_RUSSIANS,
+	ALGO_SEEDED,
+	ALGO_LINEAR,
+	ALGO_STRIPED,
 };
 
 algo_t algorithms[] = {
@@ -38,7 +62,31 @@ algo_t algorithms[] = {
 	{
 		"clusterized",
 		"clusterized parallelized implementation",
-		NULL
+		&nw_cluster,
+		ALGO_NO_MATRIX
+	},
+	{
+		"russians",
+		"four-russians blocks (unit scoring, DNA)",
+		&nw_russians
+	},
+	{
+		"seeded",
+		"k-mer anchors chain, gaps aligned in parallel",
+		&nw_seeded,
+		ALGO_NO_MATRIX
+	},
+	{
+		"linear",
+		"linear space divide and conquer (linear gaps)",
+		&nw_linear,
+		ALGO_NO_MATRIX
+	},
+	{
+		"striped",
+		"striped SIMD kernel, score only",
+		&nw_striped,
+		ALGO_NO_MATRIX | ALGO_SCORE_ONLY
 	},
 };
 
@@ -69,17 +117,86 @@ void help() {
 	       "options are:\n"
 	       " -h, --help		print this help\n"
 	       " -s, --string		(default) sequences are program arguments\n"
-	       " -f, --file		sequences are read from files\n"
+	       " -f, --file		sequences are read from files, while the\n"
+	       "			algorithm runs (iterative, parallelized)\n"
+	       " --lengths <a>,<b>	lengths of the sequence files, for pipes\n"
 	       " -F, --Fingle 		sequences are from a single file (two lines)\n"
 	       " -R, --Random <size>    generate random sequences of given size\n"
 	       " -S, --Seed <seed>	use given seed for random numbers generation\n"
 	       " -u			use hard drive memory\n"
+	       " -M, --memory <size>	memory budget (default: available memory),\n"
+	       "			the move matrix goes to a file or is not\n"
+	       "			stored if it doesn't fit\n"
 	       " -a, --algorithm <algo>	use given algorithm for alignment\n"
 	       " -t, --time		print algorithm run time\n"
-	       " -c, --core 		specify the number of cores (iterative only)\n"
+	       " -c, --core 		specify the number of cores (parallelized only),\n"
+	       "			or of local processes (clusterized)\n"
 	       " -v, --validate <file>	validate computed alignment using `file`\n"
 	       " -o, --output <file>	print alignment(s) to a file instead of stdout\n"
-	       " -m, --max <max>	max alignments to print\n\n"
+	       " --async-output		write alignments from a separate thread\n"
+	       " --pair-format <format>	alignments format: text (default) or\n"
+	       "			binary, the indexed format of nwb.h. With\n"
+	       "			binary on stdout, other results go to\n"
+	       "			stderr\n"
+	       " -m, --max <max>	max alignments to print\n"
+	       " --serve <socket>	serve alignment requests on a unix socket\n"
+	       "			using `-c` workers\n"
+	       " --cache <size>		keep up to `size` bytes of results in memory\n"
+	       " --cache-file <file>	keep results in `file` across runs\n"
+	       " --cache-file-size <size>\n"
+	       "			size of a new cache file (default 64M)\n"
+	       " --matrix-file <file>	keep the move matrix in `file`, resuming its\n"
+	       "			computation if it was interrupted\n"
+	       " --checkpoint <sec>	seconds between matrix file checkpoints\n"
+	       "			(default 60)\n"
+	       " --traceback-only	only compute alignments from a complete\n"
+	       "			matrix file\n"
+	       " --alloc <backend>	move matrix allocation: default, hugetlb,\n"
+	       "			thp or populate\n"
+	       " --nt-store		write the move matrix with non-temporal\n"
+	       "			stores\n"
+	       " --affinity <policy>	pin threads on cores: none (default),\n"
+	       "			compact (fill numa nodes in order) or\n"
+	       "			spread (balance threads across numa nodes)\n"
+	       " --topology		print the numa topology and exit\n"
+	       " --tune			time the kernels on this machine, with up\n"
+	       "			to `-c` threads, and save the fastest\n"
+	       "			parameters for later runs\n"
+	       " --layout <layout>	move matrix layout: diagonal (default),\n"
+	       "			tiled, zorder, or auto to pick the fastest\n"
+	       " --match <score>	score of identical characters (default 1)\n"
+	       " --mismatch <score>	score of different characters (default -1)\n"
+	       " --substitution <file>	score characters with a substitution matrix\n"
+	       "			(BLOSUM, PAM) instead\n"
+	       " --gap-open <score>	score of opening a gap (default 0)\n"
+	       " --gap-extend <score>	score of each gap character (default -1)\n"
+	       " --block <size>		block size of the russians algorithm, 2 or 3\n"
+	       "			(default 3)\n"
+	       " --russians-table <file>\n"
+	       "			load the russians block table from `file`,\n"
+	       "			building and saving it if needed\n"
+	       " --min-score <score>	only report pairs scoring at least `score`,\n"
+	       "			giving up on others as soon as they can't\n"
+	       "			(also for the requests of --serve)\n"
+	       " --xdrop <x>		extend from the start of the sequences, giving\n"
+	       "			up on cases more than `x` below the best\n"
+	       "			score, and align up to the best case\n"
+	       " --all-vs-all <fasta>	print the scores of all the pairs of sequences\n"
+	       "			of `fasta`, using `-c` threads\n"
+	       " --format <format>	all-vs-all scores format: tsv (default) or\n"
+	       "			binary\n"
+	       " --batch <fasta>	align the reference sequence with every query\n"
+	       "			of `fasta`, using `-c` threads, printing\n"
+	       "			their scores, and `-m` alignments each\n"
+	       "			(default none), with the striped kernel\n"
+	       "			if `-a striped`\n"
+	       " --incremental		extend the sequences with the lines of stdin,\n"
+	       "			`<seq_a suffix> <seq_b suffix>` ('-' for\n"
+	       "			none), printing the alignments after each\n"
+	       " --peers <host:port,...>\n"
+	       "			run the clusterized algorithm on these hosts,\n"
+	       "			each one given the same sequences\n"
+	       " --rank <rank>		rank of this host in --peers (default 0)\n\n"
 
 	       "algorithm list:\n"
 	      );
@@ -87,6 +204,113 @@ void help() {
 	print_algo_list();
 }
 
+/* Long only options */
+enum {
+	OPT_SERVE = 256,
+	OPT_CACHE,
+	OPT_CACHE_FILE,
+	OPT_CACHE_FILE_SIZE,
+	OPT_MATRIX_FILE,
+	OPT_CHECKPOINT,
+	OPT_TRACEBACK_ONLY,
+	OPT_ALLOC,
+	OPT_NT_STORE,
+	OPT_AFFINITY,
+	OPT_TOPOLOGY,
+	OPT_LAYOUT,
+	OPT_MATCH,
+	OPT_MISMATCH,
+	OPT_SUBSTITUTION,
+	OPT_GAP_OPEN,
+	OPT_GAP_EXTEND,
+	OPT_BLOCK,
+	OPT_RUSSIANS_TABLE,
+	OPT_MIN_SCORE,
+	OPT_XDROP,
+	OPT_ALL_VS_ALL,
+	OPT_FORMAT,
+	OPT_BATCH,
+	OPT_INCREMENTAL,
+	OPT_PEERS,
+	OPT_RANK,
+	OPT_ASYNC_OUTPUT,
+	OPT_PAIR_FORMAT,
+	OPT_TUNE,
+	OPT_LENGTHS,
+};
+
+static const struct option long_options[] = {
+	{ "help",	no_argument,		NULL,	'h' },
+	{ "string",	no_argument,		NULL,	's' },
+	{ "file",	no_argument,		NULL,	'f' },
+	{ "Fingle",	no_argument,		NULL,	'F' },
+	{ "Random",	required_argument,	NULL,	'R' },
+	{ "Seed",	required_argument,	NULL,	'S' },
+	{ "algorithm",	required_argument,	NULL,	'a' },
+	{ "time",	no_argument,		NULL,	't' },
+	{ "core",	required_argument,	NULL,	'c' },
+	{ "validate",	required_argument,	NULL,	'v' },
+	{ "output",	required_argument,	NULL,	'o' },
+	{ "max",	required_argument,	NULL,	'm' },
+	{ "memory",	required_argument,	NULL,	'M' },
+	{ "serve",	required_argument,	NULL,	OPT_SERVE },
+	{ "cache",	required_argument,	NULL,	OPT_CACHE },
+	{ "cache-file",	required_argument,	NULL,	OPT_CACHE_FILE },
+	{ "cache-file-size", required_argument,	NULL,	OPT_CACHE_FILE_SIZE },
+	{ "matrix-file", required_argument,	NULL,	OPT_MATRIX_FILE },
+	{ "checkpoint",	required_argument,	NULL,	OPT_CHECKPOINT },
+	{ "traceback-only", no_argument,	NULL,	OPT_TRACEBACK_ONLY },
+	{ "alloc",	required_argument,	NULL,	OPT_ALLOC },
+	{ "nt-store",	no_argument,		NULL,	OPT_NT_STORE },
+	{ "affinity",	required_argument,	NULL,	OPT_AFFINITY },
+	{ "topology",	no_argument,		NULL,	OPT_TOPOLOGY },
+	{ "layout",	required_argument,	NULL,	OPT_LAYOUT },
+	{ "match",	required_argument,	NULL,	OPT_MATCH },
+	{ "mismatch",	required_argument,	NULL,	OPT_MISMATCH },
+	{ "substitution", required_argument,	NULL,	OPT_SUBSTITUTION },
+	{ "gap-open",	required_argument,	NULL,	OPT_GAP_OPEN },
+	{ "gap-extend",	required_argument,	NULL,	OPT_GAP_EXTEND },
+	{ "block",	required_argument,	NULL,	OPT_BLOCK },
+	{ "russians-table", required_argument,	NULL,	OPT_RUSSIANS_TABLE },
+	{ "min-score",	required_argument,	NULL,	OPT_MIN_SCORE },
+	{ "xdrop",	required_argument,	NULL,	OPT_XDROP },
+	{ "all-vs-all",	required_argument,	NULL,	OPT_ALL_VS_ALL },
+	{ "format",	required_argument,	NULL,	OPT_FORMAT },
+	{ "batch",	required_argument,	NULL,	OPT_BATCH },
+	{ "incremental", no_argument,		NULL,	OPT_INCREMENTAL },
+	{ "peers",	required_argument,	NULL,	OPT_PEERS },
+	{ "rank",	required_argument,	NULL,	OPT_RANK },
+	{ "async-output", no_argument,		NULL,	OPT_ASYNC_OUTPUT },
+	{ "pair-format", required_argument,	NULL,	OPT_PAIR_FORMAT },
+	{ "tune",	no_argument,		NULL,	OPT_TUNE },
+	{ "lengths",	required_argument,	NULL,	OPT_LENGTHS },
+	{ NULL,		0,			NULL,	0 },
+};
+
+/* Parse a size in bytes with an optional K, M or G suffix */
+static int parse_size(const char* str, size_t* size) {
+	char unit = '\0';
+	unsigned long long v;
+	int n = sscanf(str, "%llu%c", &v, &unit);
+	if (n < 1) {
+		return 1;
+	}
+	switch (unit) {
+	    case 'G': case 'g':
+		v <<= 10;
+	    case 'M': case 'm':
+		v <<= 10;
+	    case 'K': case 'k':
+		v <<= 10;
+	    case '\0':
+		break;
+	    default:
+		return 1;
+	}
+	*size = v;
+	return 0;
+}
+
 /* Load mode of sequences */
 enum {
 	LM_ARGUMENTS,
@@ -97,11 +321,11 @@ enum {
 
 int allocate_matrix(const algo_arg_t* args,
 		    matrix_t* move_matrix,
-		    int use_file)
+		    int alloc, int layout)
 {
 	if (matrix_init(move_matrix,
 			args->len_a + 1, args->len_b + 1,
-			sizeof(char), use_file))
+			sizeof(char), alloc, layout))
 	{
 		printf("couldn't allocate move matrix\n");
 		return 1;
@@ -109,6 +333,64 @@ int allocate_matrix(const algo_arg_t* args,
 	return 0;
 }
 
+/* Layouts are compared on prefixes of the sequences of this size */
+#define LAYOUT_SAMPLE	2048
+
+/* Pick the fastest layout, running the algorithm and a traceback on a
+ * sample of the sequences. Matrices fitting in the cache keep the
+ * diagonal layout.
+ */
+static int __pick_layout(const algo_arg_t* args, algo_func_t func) {
+	if ((args->len_a + 1) * (size_t) (args->len_b + 1) <= (1 << 20)) {
+		return MATRIX_LAYOUT_DIAGONAL;
+	}
+
+	algo_arg_t sample = *args;
+	sample.prune = 0;
+	sample.xdrop = 0;
+	sample.len_a = min(args->len_a, LAYOUT_SAMPLE);
+	sample.len_b = min(args->len_b, LAYOUT_SAMPLE);
+
+	int best = MATRIX_LAYOUT_DIAGONAL;
+	int best_us = -1;
+	for (int layout = 0; layout < MATRIX_LAYOUT_COUNT; layout++) {
+		matrix_t m;
+		algo_res_t res;
+		alignment_t* alignments = NULL;
+		bench_t b;
+
+		memset(&res, 0, sizeof(res));
+		if (allocate_matrix(&sample, &m, MATRIX_ALLOC_DEFAULT, layout)) {
+			continue;
+		}
+
+		bench_start(&b, matrix_layout_names[layout]);
+		int n = 0;
+		if (!func(&sample, &res, &m)) {
+			n = compute_alignments(&sample, &m, &alignments, 1);
+		}
+		bench_end(&b);
+
+		for (int i = 0; i < n; i++) {
+			alignment_wipe(alignments + i);
+		}
+		free(alignments);
+		matrix_wipe(&m);
+
+		if (n <= 0) {
+			continue;
+		}
+		VERBOSE_FMT("%s layout: %d us\n", matrix_layout_names[layout],
+			    bench_diff_us(&b));
+		if (best_us < 0 || bench_diff_us(&b) < best_us) {
+			best = layout;
+			best_us = bench_diff_us(&b);
+		}
+	}
+
+	return best;
+}
+
 static size_t __get_file_length(FILE* f) {
 	long init_pos = ftell(f);
 	fseek(f, 0, SEEK_END);
@@ -117,58 +399,277 @@ static size_t __get_file_length(FILE* f) {
 	return end_pos;
 }
 
+static int __load_sequence_file(const char* path, char** seq, int* len) {
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		printf("couldn't open sequence file %s\n", path);
+		return 1;
+	}
+
+	*len = __get_file_length(f);
+	*seq = malloc(*len + 1);
+	if (!*seq) {
+		printf("couldn't allocate sequence\n");
+		fclose(f);
+		return 1;
+	}
+	if (*len > 0 && fread(*seq, *len, 1, f) != 1) {
+		printf("couldn't read file %s\n", path);
+		free(*seq);
+		fclose(f);
+		return 1;
+	}
+	(*seq)[*len] = '\0';
+
+	fclose(f);
+	return 0;
+}
+
 int load_sequences_files(const char* path_a, const char* path_b,
 			 algo_arg_t* args)
 {
-	FILE* f_a = fopen(path_a, "r");
-	if (!f_a) {
-		printf("couldn't open sequence file %s\n", path_a);
-		goto error;
+	if (__load_sequence_file(path_a, &args->seq_a, &args->len_a)) {
+		return 1;
 	}
-	FILE* f_b = fopen(path_b, "r");
-	if (!f_b) {
-		printf("coundn't open sequence file %s\n", path_b);
-		goto error_1;	
+	if (__load_sequence_file(path_b, &args->seq_b, &args->len_b)) {
+		free(args->seq_a);
+		return 1;
 	}
+	return 0;
+}
 
-	args->len_a = __get_file_length(f_a);
-	args->len_b = __get_file_length(f_b);
+/* Wait for streamed sequence files to be loaded whole */
+static int __load_streams(stream_t streams[2]) {
+	int short_a = stream_close(&streams[0]);
+	int short_b = stream_close(&streams[1]);
+	if (short_a || short_b) {
+		printf("sequence files ended early\n");
+		return 1;
+	}
+	return 0;
+}
+
+/* Text output of computed alignments. They are written without copy, so
+ * they are only wiped once the output is closed.
+ */
+static int __write_text(const algo_arg_t* args,
+			const alignment_t* alignments, int nalignments,
+			const char* path, int async_output)
+{
+	output_t out;
+	if (output_open(&out, path, async_output)) {
+		return 1;
+	}
+	for (int i = 0; i < nalignments; i++) {
+		output_printf(&out, "alignment %d:\n", i + 1);
+
+		if (i == 0)
+		{
+			int w = score_alignment(alignments + i, args->scoring);
+			output_printf(&out, "alignment score: %d\n", w);
+		}
+		output_alignment(&out, alignments + i);
+	}
+	if (output_close(&out)) {
+		printf("couldn't write alignments\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int __emit_binary(const alignment_t* al, void* data) {
+	return nwb_writer_add(data, al);
+}
+
+/* Binary output of computed alignments */
+static int __write_binary(const algo_arg_t* args, int score,
+			  const alignment_t* alignments, int nalignments,
+			  const char* path)
+{
+	nwb_writer_t w;
+	if (nwb_writer_open(&w, path, args, score)) {
+		return 1;
+	}
+	for (int i = 0; i < nalignments; i++) {
+		__emit_binary(alignments + i, &w);
+	}
+	if (nwb_writer_close(&w)) {
+		printf("couldn't write alignments\n");
+		return 1;
+	}
+	return 0;
+}
 
-	args->seq_a = malloc(args->len_a + 1);
-	if (!args->seq_a) {
-		printf("couldn't allocate sequence a\n");
-		goto error_2; 
+/* Binary output of the alignments of a move matrix, written as the
+ * traceback builds them.
+ */
+static int __write_binary_traced(const algo_arg_t* args, int score,
+				 const matrix_t* move_matrix, int bound,
+				 const char* path)
+{
+	nwb_writer_t w;
+	if (nwb_writer_open(&w, path, args, score)) {
+		return 1;
 	}
-	args->seq_b = malloc(args->len_b + 1);
-	if (!args->seq_b) {
-		printf("couldn't allocate sequence b\n");
-		goto error_3;
+	VERBOSE_FMT("retrieving alignments (max %d)\n", bound);
+	int n = compute_alignments_each(args, move_matrix, bound,
+					__emit_binary, &w);
+	if (nwb_writer_close(&w) || n <= 0) {
+		printf("couldn't write alignments\n");
+		return 1;
 	}
+	return 0;
+}
+
+/* Align a tiny pair, printing what the default path would. A single
+ * alignment is printed directly, without the buffers of output.h.
+ */
+static int __tiny(const algo_arg_t* args, int bound, int do_bench,
+		  const char* output_path, int binary)
+{
+	tiny_alignment_t al;
+	alignment_t view;
+	bench_t bench_algo;
+	bench_t bench_align;
+	FILE* status = (binary && !output_path) ? stderr : stdout;
 
-	if (fread(args->seq_a, args->len_a, 1, f_a) != 1) {
-		printf("couldn't read file %s\n", path_a);
-		goto error_4;
+	if (do_bench) {
+		bench_start(&bench_algo, "algorithm runtime");
 	}
-	if (fread(args->seq_b, args->len_b, 1, f_b) != 1) {
-		printf("couldn't read file %s\n", path_b);
-		goto error_4;
+	int score = tiny_align(args, (bound != 0) ? &al : NULL);
+	if (do_bench) {
+		bench_end(&bench_algo);
+	}
+	if (bound != 0) {
+		view = tiny_alignment(&al);
 	}
 
-	args->seq_a[args->len_a] = '\0';
-	args->seq_b[args->len_b] = '\0';
+	if (args->prune && score < args->min_score) {
+		fprintf(status, "below threshold\n");
+		if (do_bench) {
+			fprintf(status, "algorithm runtime: %f\n",
+				bench_diff_s(&bench_algo));
+		}
+		return 0;
+	}
+	if (args->prune && bound == 0) {
+		fprintf(status, "alignment score: %d\n", score);
+	}
 
+	if (do_bench) {
+		bench_start(&bench_align, "alignment runtime");
+	}
+	if (binary) {
+		if (__write_binary(args, score, &view, bound != 0,
+				   output_path))
+		{
+			return 1;
+		}
+	}
+	else if (bound != 0) {
+		FILE* out = stdout;
+		if (output_path && !(out = fopen(output_path, "w"))) {
+			printf("couldn't open output file %s\n", output_path);
+			return 1;
+		}
+		fprintf(out, "alignment 1:\n");
+		fprintf(out, "alignment score: %d\n",
+			score_alignment(&view, args->scoring));
+		fprintf(out, "%s\n%s\n", view.up, view.down);
+		int ret = ferror(out);
+		if (out != stdout && fclose(out)) {
+			ret = 1;
+		}
+		if (ret) {
+			printf("couldn't write alignments\n");
+			return 1;
+		}
+	}
+	if (do_bench) {
+		bench_end(&bench_align);
+		fprintf(status, "algorithm runtime: %f\n",
+			bench_diff_s(&bench_algo));
+		fprintf(status, "alignment runtime: %f\n",
+			bench_diff_s(&bench_align));
+	}
+	return 0;
+}
+
+static int __incremental_update(incr_t* inc, const char* a, int na,
+				const char* b, int nb, int bound, int do_bench)
+{
+	bench_t bench;
+	if (do_bench) {
+		bench_start(&bench, "update runtime");
+	}
+	long cases = incr_append(inc, a, na, b, nb);
+	if (cases < 0) {
+		return 1;
+	}
+	VERBOSE_FMT("%ld cases computed\n", cases);
+
+	alignment_t* alignments = NULL;
+	int n = incr_alignments(inc, &alignments, bound);
+	if (n <= 0) {
+		printf("Error during alignment creation\n");
+		return 1;
+	}
+	if (do_bench) {
+		bench_end(&bench);
+		printf("update runtime: %f\n", bench_diff_s(&bench));
+	}
+
+	printf("alignment score: %d\n", incr_score(inc));
+	for (int i = 0; i < n; i++) {
+		printf("alignment %d:\n", i + 1);
+		print_alignment(alignments + i);
+		alignment_wipe(alignments + i);
+	}
+	free(alignments);
+	fflush(stdout);
 	return 0;
+}
+
+/* Align the initial sequences, then extend them with each line of stdin */
+static int __incremental(const algo_arg_t* init, const scoring_t* sc,
+			 int bound, int do_bench)
+{
+	incr_t inc;
+	char* line = NULL;
+	size_t size = 0;
+	int ret = 1;
+
+	if (incr_init(&inc, sc)) {
+		return 1;
+	}
+	if (__incremental_update(&inc, init->seq_a, init->len_a, init->seq_b,
+				 init->len_b, bound, do_bench))
+	{
+		goto end;
+	}
+
+	while (getline(&line, &size, stdin) > 0) {
+		char* a = strtok(line, " \t\r\n");
+		char* b = a ? strtok(NULL, " \t\r\n") : NULL;
+		if (!a) {
+			continue;
+		}
+		if (!b) {
+			printf("expected `<seq_a suffix> <seq_b suffix>`\n");
+			goto end;
+		}
+		int na = strcmp(a, "-") ? strlen(a) : 0;
+		int nb = strcmp(b, "-") ? strlen(b) : 0;
+		if (__incremental_update(&inc, a, na, b, nb, bound, do_bench)) {
+			goto end;
+		}
+	}
+	ret = 0;
 
-    error_4:
-	free(args->seq_b);
-    error_3:
-	free(args->seq_a);
-    error_2:
-	fclose(f_b);
-    error_1:
-	fclose(f_a);
-    error:
-	return 1;
+    end:
+	free(line);
+	incr_wipe(&inc);
+	return ret;
 }
 
 int main(int argc, char** argv) {
@@ -181,23 +682,60 @@ int main(int argc, char** argv) {
 	int load_mode = LM_ARGUMENTS;
 	int algorithm = ALGO_ITERATIVE;
 	int do_bench  = 0;
-	int core_number = 1;
+	int core_number = 0;
+	int affinity = NUMA_AFFINITY_NONE;
+	int layout = MATRIX_LAYOUT_DIAGONAL;
+	int layout_given = 0;
+	int tune = 0;
+	int lengths[2] = { -1, -1 };
+	stream_t streams[2];
+	scoring_t scoring;
 	int do_validation = 0;
 	char validation_file[512] = "";
 	int file_output = 0;
 	char output_path[512] = "";
+	int async_output = 0;
+	int binary_output = 0;
 	int random_size = 0;
 	int seed = 0;
-	int use_file = 0;
+	int alloc = MATRIX_ALLOC_DEFAULT;
+	plan_cfg_t plan_cfg;
 	int bound = -1;
+	int bound_given = 0;
+	char serve_path[512] = "";
+	size_t cache_budget = 0;
+	char cache_path[512] = "";
+	size_t cache_file_size = 64 << 20;
+	cache_t* cache = NULL;
+	char matrix_path[512] = "";
+	int checkpoint_interval = 60;
+	int traceback_only = 0;
+	int block = RUSSIANS_DEFAULT_BLOCK;
+	char russians_path[512] = "";
+	char ava_path[512] = "";
+	ava_cfg_t ava_cfg;
+	char batch_path[512] = "";
+	batch_cfg_t batch_cfg;
+	int incremental = 0;
+	cluster_cfg_t cluster_cfg;
 	algo_arg_t args;
 	algo_res_t res;
 	bench_t bench_algo;
 	bench_t bench_align;
 
+	memset(&args, 0, sizeof(args));
+	ava_cfg_default(&ava_cfg);
+	batch_cfg_default(&batch_cfg);
+	plan_cfg_default(&plan_cfg);
+	cluster_cfg_default(&cluster_cfg);
+	scoring_init(&scoring);
+	args.scoring = &scoring;
+
 	/* parsing options */
-	char opt_c = 0;
-	while ((opt_c = getopt(argc, argv, "hsfFR:S:tua:c:v:o:b:m:V")) > 0) {
+	int opt_c = 0;
+	while ((opt_c = getopt_long(argc, argv, "hsfFR:S:tuM:a:c:v:o:b:m:V",
+				    long_options, NULL)) > 0)
+	{
 		switch (opt_c) {
 		    case '?':
 		    case ':':
@@ -235,8 +773,15 @@ int main(int argc, char** argv) {
 			}
 			break;
 		
+		    case 'M':
+			if (parse_size(optarg, &plan_cfg.budget)) {
+				printf("invalid memory budget\n");
+				return 1;
+			}
+			break;
+
 		    case 'u':
-		    	use_file = 1;
+		    	alloc = MATRIX_ALLOC_FILE;
 			break;
 
 		    case 't':
@@ -274,14 +819,384 @@ int main(int argc, char** argv) {
 				printf("invalid max parameter\n");
 				return 1;
 			}
+			bound_given = 1;
 			break;
 
 		    case 'V':
 			verbose = 1;
 			break;
+
+		    case OPT_SERVE:
+			if (strlen(optarg) >= sizeof(serve_path)) {
+				printf("invalid socket path\n");
+				return 1;
+			}
+			strcpy(serve_path, optarg);
+			break;
+
+		    case OPT_CACHE:
+			if (parse_size(optarg, &cache_budget)) {
+				printf("invalid cache size\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_CACHE_FILE:
+			if (strlen(optarg) >= sizeof(cache_path)) {
+				printf("invalid cache file path\n");
+				return 1;
+			}
+			strcpy(cache_path, optarg);
+			break;
+
+		    case OPT_CACHE_FILE_SIZE:
+			if (parse_size(optarg, &cache_file_size)) {
+				printf("invalid cache file size\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_MATRIX_FILE:
+			if (strlen(optarg) >= sizeof(matrix_path)) {
+				printf("invalid matrix file path\n");
+				return 1;
+			}
+			strcpy(matrix_path, optarg);
+			break;
+
+		    case OPT_CHECKPOINT:
+			if (sscanf(optarg, "%d", &checkpoint_interval) != 1
+			||  checkpoint_interval < 0)
+			{
+				printf("invalid checkpoint interval\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_TRACEBACK_ONLY:
+			traceback_only = 1;
+			break;
+
+		    case OPT_ALLOC:
+			alloc = matrix_find_alloc(optarg);
+			if (alloc < 0 || alloc == MATRIX_ALLOC_FILE) {
+				printf("allocation backends are: default, "
+				       "hugetlb, thp, populate\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_NT_STORE:
+			args.nt_store = 1;
+			break;
+
+		    case OPT_AFFINITY:
+			affinity = numa_find_affinity(optarg);
+			if (affinity < 0) {
+				printf("affinities are: none, compact, spread\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_MATCH:
+			if (sscanf(optarg, "%d", &scoring.match) != 1) {
+				printf("invalid match score\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_MISMATCH:
+			if (sscanf(optarg, "%d", &scoring.mismatch) != 1) {
+				printf("invalid mismatch score\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_SUBSTITUTION:
+			if (scoring_load_matrix(&scoring, optarg)) {
+				return 1;
+			}
+			break;
+
+		    case OPT_GAP_OPEN:
+			if (sscanf(optarg, "%d", &scoring.gap_open) != 1) {
+				printf("invalid gap open score\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_GAP_EXTEND:
+			if (sscanf(optarg, "%d", &scoring.gap_extend) != 1) {
+				printf("invalid gap extend score\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_BLOCK:
+			if (sscanf(optarg, "%d", &block) != 1) {
+				printf("invalid block size\n");
+				return 1;
+			}
+			if (block > RUSSIANS_MAX_BLOCK) {
+				printf("blocks bigger than %d have too large "
+				       "tables\n", RUSSIANS_MAX_BLOCK);
+				return 1;
+			}
+			if (block < RUSSIANS_MIN_BLOCK) {
+				printf("invalid block size\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_RUSSIANS_TABLE:
+			if (strlen(optarg) >= sizeof(russians_path)) {
+				printf("invalid block table path\n");
+				return 1;
+			}
+			strcpy(russians_path, optarg);
+			break;
+
+		    case OPT_MIN_SCORE:
+			if (sscanf(optarg, "%d", &args.min_score) != 1) {
+				printf("invalid minimum score\n");
+				return 1;
+			}
+			args.prune = 1;
+			break;
+
+		    case OPT_XDROP:
+			if (sscanf(optarg, "%d", &args.xdrop) != 1
+			||  args.xdrop <= 0)
+			{
+				printf("invalid x-drop\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_ALL_VS_ALL:
+			if (strlen(optarg) >= sizeof(ava_path)) {
+				printf("invalid fasta path\n");
+				return 1;
+			}
+			strcpy(ava_path, optarg);
+			break;
+
+		    case OPT_BATCH:
+			if (strlen(optarg) >= sizeof(batch_path)) {
+				printf("invalid fasta path\n");
+				return 1;
+			}
+			strcpy(batch_path, optarg);
+			break;
+
+		    case OPT_INCREMENTAL:
+			incremental = 1;
+			break;
+
+		    case OPT_ASYNC_OUTPUT:
+			async_output = 1;
+			break;
+
+		    case OPT_PAIR_FORMAT:
+			if (strcmp(optarg, "text") && strcmp(optarg, "binary")) {
+				printf("pair formats are: text, binary\n");
+				return 1;
+			}
+			binary_output = !strcmp(optarg, "binary");
+			break;
+
+		    case OPT_TUNE:
+			tune = 1;
+			break;
+
+		    case OPT_LENGTHS:
+			if (sscanf(optarg, "%d,%d", &lengths[0],
+				   &lengths[1]) != 2
+			||  lengths[0] < 0 || lengths[1] < 0)
+			{
+				printf("invalid lengths\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_PEERS:
+			if (cluster_parse_peers(&cluster_cfg, optarg)) {
+				printf("peers are a list of host:port\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_RANK:
+			if (sscanf(optarg, "%d", &cluster_cfg.rank) != 1) {
+				printf("invalid rank\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_FORMAT:
+			ava_cfg.format = ava_find_format(optarg);
+			if (ava_cfg.format < 0) {
+				printf("formats are: tsv, binary\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_LAYOUT:
+			layout_given = 1;
+			if (!strcmp(optarg, "auto")) {
+				layout = -1;
+				break;
+			}
+			layout = matrix_find_layout(optarg);
+			if (layout < 0) {
+				printf("layouts are: diagonal, tiled, zorder, "
+				       "auto\n");
+				return 1;
+			}
+			break;
+
+		    case OPT_TOPOLOGY: {
+			numa_topology_t topo;
+			if (numa_read_topology(&topo)) {
+				return 1;
+			}
+			numa_print_topology(&topo);
+			return 0;
+		    }
 		}
 	}
 
+	if (tune) {
+		return tune_run(core_number);
+	}
+
+	if (args.prune && matrix_path[0]) {
+		printf("--min-score doesn't work with a --matrix-file\n");
+		return 1;
+	}
+
+	if (args.xdrop && (args.prune || matrix_path[0]
+			   || cache_budget || cache_path[0]))
+	{
+		printf("--xdrop doesn't work with --min-score, a "
+		       "--matrix-file or a cache\n");
+		return 1;
+	}
+
+	if (traceback_only && !matrix_path[0]) {
+		printf("--traceback-only needs a --matrix-file\n");
+		return 1;
+	}
+
+	if (cache_budget || cache_path[0]) {
+		cache = cache_new(cache_budget,
+				  cache_path[0] ? cache_path : NULL,
+				  cache_file_size);
+		if (!cache) {
+			return 1;
+		}
+	}
+
+	/* All-vs-all mode, sequences come from a fasta file */
+	if (ava_path[0]) {
+		FILE* out = stdout;
+		if (numa_setup(core_number, affinity)) {
+			return 1;
+		}
+		if (file_output && !(out = fopen(output_path, "w"))) {
+			printf("couldn't open output file %s\n", output_path);
+			return 1;
+		}
+		ava_cfg.scoring = &scoring;
+		ava_cfg.prune = args.prune;
+		ava_cfg.min_score = args.min_score;
+		int ret = all_vs_all(ava_path, out, &ava_cfg);
+		if (out != stdout) {
+			fclose(out);
+		}
+		cache_delete(cache);
+		return ret;
+	}
+
+	/* Batch mode, the reference is the only sequence given */
+	if (batch_path[0]) {
+		char* ref = NULL;
+		int len = 0;
+		FILE* out = stdout;
+		if (argc - optind < 1) {
+			printf("please specify the reference sequence\n");
+			return 1;
+		}
+		if (load_mode == LM_FILES) {
+			if (__load_sequence_file(argv[optind], &ref, &len)) {
+				return 1;
+			}
+		}
+		else {
+			ref = strdup(argv[optind]);
+			len = strlen(ref);
+		}
+		if (numa_setup(core_number, affinity)) {
+			free(ref);
+			return 1;
+		}
+		if (file_output && !(out = fopen(output_path, "w"))) {
+			printf("couldn't open output file %s\n", output_path);
+			free(ref);
+			return 1;
+		}
+		batch_cfg.scoring = &scoring;
+		batch_cfg.bound = max(bound, 0);
+		batch_cfg.prune = args.prune;
+		batch_cfg.min_score = args.min_score;
+		batch_cfg.striped = algorithm == ALGO_STRIPED;
+		int ret = batch_align(ref, len, batch_path, out, &batch_cfg);
+		if (out != stdout) {
+			fclose(out);
+		}
+		free(ref);
+		cache_delete(cache);
+		return ret;
+	}
+
+	/* Incremental mode, sequences grow from stdin */
+	if (incremental) {
+		algo_arg_t init;
+		memset(&init, 0, sizeof(init));
+		if (load_mode == LM_FILES && argc - optind >= 2) {
+			if (load_sequences_files(argv[optind], argv[optind + 1],
+						 &init))
+			{
+				return 1;
+			}
+		}
+		else if (load_mode == LM_ARGUMENTS && argc - optind >= 2) {
+			init.seq_a = strdup(argv[optind]);
+			init.seq_b = strdup(argv[optind + 1]);
+			init.len_a = strlen(init.seq_a);
+			init.len_b = strlen(init.seq_b);
+		}
+		int ret = __incremental(&init, &scoring, bound, do_bench);
+		free(init.seq_a);
+		free(init.seq_b);
+		cache_delete(cache);
+		return ret;
+	}
+
+	/* Server mode, sequences come from the clients */
+	if (serve_path[0]) {
+		server_cfg_t cfg;
+		server_cfg_default(&cfg);
+		cfg.workers = max(core_number, 1);
+		cfg.cache = cache;
+		cfg.scoring = &scoring;
+		cfg.prune = args.prune;
+		cfg.min_score = args.min_score;
+		int ret = serve(serve_path, &cfg);
+		cache_delete(cache);
+		return ret;
+	}
+
 	/* Check sequences are given */
 	if (load_mode == LM_SINGLE_FILE && argc - optind < 1) {
 		printf("please specify single input sequences file\n");
@@ -302,12 +1217,15 @@ int main(int argc, char** argv) {
 		args.seq_b = argv[optind + 1];
 	}
 	else if (load_mode == LM_FILES) {
-		if (load_sequences_files(argv[optind], argv[optind + 1],
-					 &args))
-		{
-			printf("couldn't load sequences\n");
+		if (stream_open(&streams[0], argv[optind], lengths[0])) {
+			return 1;
+		}
+		if (stream_open(&streams[1], argv[optind + 1], lengths[1])) {
+			stream_close(&streams[0]);
 			return 1;
 		}
+		args.seq_a = streams[0].buf;
+		args.seq_b = streams[1].buf;
 	}
 	else if (load_mode == LM_SINGLE_FILE) {
 		/* TODO load from file */
@@ -324,8 +1242,14 @@ int main(int argc, char** argv) {
 			args.seq_b[i] = 'A' + rand() % ('Z' - 'A'); 
 		}
 	}
-	args.len_a = strlen(args.seq_a);
-	args.len_b = strlen(args.seq_b);
+	if (load_mode == LM_FILES) {
+		args.len_a = streams[0].len;
+		args.len_b = streams[1].len;
+	}
+	else {
+		args.len_a = strlen(args.seq_a);
+		args.len_b = strlen(args.seq_b);
+	}
 
 	/* Start algorithm */
 	if (algorithms[algorithm].func == NULL) {
@@ -334,28 +1258,283 @@ int main(int argc, char** argv) {
 		return 1;
 	}
 
-	matrix_t move_matrix;
+	/* Score-only algorithms only give the score unless alignments are
+	 * asked for with -m, which are left to the iterative one.
+	 */
+	if ((algorithms[algorithm].flags & ALGO_SCORE_ONLY) && !bound_given) {
+		bound = 0;
+	}
+	if ((algorithms[algorithm].flags & ALGO_SCORE_ONLY) && bound != 0) {
+		VERBOSE_FMT("`%s` only computes scores, using `%s`\n",
+			    algorithms[algorithm].name,
+			    algorithms[ALGO_ITERATIVE].name);
+		algorithm = ALGO_ITERATIVE;
+	}
+
+	/* Parameters tuned for this machine, unless given */
+	tune_params_t tuned;
+	if ((algorithms[algorithm].func == nw
+	     || algorithms[algorithm].func == nw_omp)
+	&&  !tune_load(tune_class(args.len_a, args.len_b), &tuned))
+	{
+		VERBOSE_FMT("tuned: threads %d, cutoff %d, chunk %d, %s\n",
+			    tuned.threads, tuned.par_cutoff, tuned.omp_chunk,
+			    matrix_layout_names[tuned.layout]);
+		if (core_number == 0) {
+			core_number = tuned.threads;
+		}
+		if (!layout_given && !matrix_path[0]) {
+			layout = tuned.layout;
+		}
+		args.nt_store |= tuned.nt_store;
+		args.par_cutoff = tuned.par_cutoff;
+		args.omp_chunk = tuned.omp_chunk;
+	}
 
-	if (allocate_matrix(&args, &move_matrix, use_file)) {
+	/* Pin the threads of the parallelized kernel */
+	if (algorithms[algorithm].func == nw_omp
+	&&  numa_setup(core_number, affinity))
+	{
 		return 1;
 	}
 
-	if (do_bench) {
-		bench_start(&bench_algo, "algorithm runtime");
+	/* Streamed files are only awaited diagonal by diagonal by the kernels
+	 * of nw, other runs need them whole.
+	 */
+	int streamed = load_mode == LM_FILES;
+	if (streamed
+	&&  ((algorithms[algorithm].func != nw
+	      && algorithms[algorithm].func != nw_omp)
+	     || args.prune || cache || matrix_path[0] || layout < 0))
+	{
+		if (__load_streams(streams)) {
+			return 1;
+		}
+		streamed = 0;
 	}
 
-	VERBOSE_FMT("start %s algorithm.\n", algorithms[algorithm].name);
-	if (algorithms[algorithm].func(&args, &res,
-				       &move_matrix))
+	/* Binary alignments on stdout keep it to themselves */
+	FILE* status = (binary_output && !file_output) ? stderr : stdout;
+
+	/* Screening: pairs which can't reach the minimum score */
+	if (args.prune && qgram_reject(&args)) {
+		VERBOSE("rejected by the q-gram prefilter\n");
+		fprintf(status, "below threshold\n");
+		return 0;
+	}
+
+	/* Tiny pairs skip the setup of the kernels (see tiny.h) */
+	if ((algorithms[algorithm].func == nw
+	     || algorithms[algorithm].func == nw_omp)
+	&&  (bound == 0 || bound == 1) && tiny_fits(&args)
+	&&  !cache && !matrix_path[0] && !args.xdrop && !do_validation)
+	{
+		if (streamed && __load_streams(streams)) {
+			return 1;
+		}
+		VERBOSE("tiny pair\n");
+		return __tiny(&args, bound, do_bench,
+			      file_output ? output_path : NULL,
+			      binary_output);
+	}
+
+	/* Precompute the blocks */
+	if (algorithms[algorithm].func == nw_russians
+	&&  russians_supported(&args)
+	&&  russians_setup(block, russians_path[0] ? russians_path : NULL))
 	{
-		printf("algorithm failure\n");
 		return 1;
 	}
+
+	algo_func_t func = algorithms[algorithm].func;
+	const char* name = algorithms[algorithm].name;	/* of func */
+	int no_matrix = algorithms[algorithm].flags & ALGO_NO_MATRIX;
+	if (no_matrix && matrix_path[0]) {
+		printf("`%s` algorithm doesn't use a move matrix\n",
+		       algorithms[algorithm].name);
+		return 1;
+	}
+
+	if (args.xdrop && func != nw && func != nw_omp) {
+		printf("--xdrop needs the iterative or parallelized "
+		       "algorithm\n");
+		return 1;
+	}
+
+	if (func == nw_cluster) {
+		cluster_cfg.processes = max(core_number, 1);
+		cluster_setup(&cluster_cfg);
+	}
+	if (func == nw_seeded) {
+		seed_setup(plan_cfg.budget);
+	}
+
+	/* Keep the move matrix within the memory budget, unless its storage
+	 * is explicitly chosen. X-drop only touches the pages of its cases.
+	 */
+	if (!no_matrix && !matrix_path[0] && alloc != MATRIX_ALLOC_FILE
+	&&  !args.xdrop)
+	{
+		plan_estimate_t estimates[PLAN_COUNT];
+		plan_cfg.bound = bound;
+		plan_cfg.threads = (func == nw_omp) ? max(core_number, 1) : 1;
+		plan_cfg.layout = layout;
+		if (streamed
+		&&  (stream_wait(&streams[0], min(PLAN_SAMPLE, args.len_a))
+		     || stream_wait(&streams[1], min(PLAN_SAMPLE, args.len_b))))
+		{
+			printf("sequence files ended early\n");
+			return 1;
+		}
+		switch (plan_choose(&args, &plan_cfg, estimates)) {
+		    case PLAN_DISK:
+			alloc = MATRIX_ALLOC_FILE;
+			break;
+		    case PLAN_LINEAR:
+			func = nw_linear;
+			name = algorithms[ALGO_LINEAR].name;
+			no_matrix = 1;
+			break;
+		    case PLAN_FULL:
+			break;
+		    default:
+			return 1;
+		}
+	}
+
+	if (streamed && func == nw_linear) {
+		if (__load_streams(streams)) {
+			return 1;
+		}
+		streamed = 0;
+	}
+	if (streamed) {
+		args.stream_a = &streams[0];
+		args.stream_b = &streams[1];
+	}
+
+	matrix_t move_matrix;
+	alignment_t* alignments = NULL;
+	int nalignments = 0;
+	memset(&res, 0, sizeof(res));
+
+	if (do_bench) {
+		bench_start(&bench_algo, "algorithm runtime");
+	}
+
+	int cached = cache && cache_lookup(cache, &args, algorithm, bound,
+					   &res.score,
+					   (bound != 0) ? &alignments : NULL,
+					   &nalignments);
+	if (!cached && no_matrix) {
+		VERBOSE_FMT("start %s algorithm.\n", name);
+		if (func(&args, &res, NULL)) {
+			printf("algorithm failure\n");
+			return 1;
+		}
+
+		/* Other cluster hosts leave the results to the first one */
+		if (func == nw_cluster && cluster_cfg.rank > 0) {
+			cache_delete(cache);
+			return 0;
+		}
+		alignments = res.alignments;
+		nalignments = res.count;
+	}
+	else if (!cached) {
+		int complete = 0;
+		if (layout < 0 && matrix_path[0]) {
+			layout = matrix_file_layout(matrix_path);
+		}
+		if (layout < 0) {
+			layout = __pick_layout(&args, func);
+			VERBOSE_FMT("using %s layout\n",
+				    matrix_layout_names[layout]);
+		}
+
+		if (matrix_path[0]) {
+			if (matrix_file_open(&move_matrix, matrix_path, &args,
+					     algorithms[algorithm].name,
+					     layout, traceback_only,
+					     checkpoint_interval))
+			{
+				return 1;
+			}
+			complete = matrix_file_is_complete(&move_matrix,
+							   &res.score);
+		}
+		else if (allocate_matrix(&args, &move_matrix, alloc, layout)) {
+			return 1;
+		}
+
+		if (complete) {
+			VERBOSE_FMT("using complete matrix of %s\n",
+				    matrix_path);
+		}
+		else {
+			numa_place(move_matrix.v.v, move_matrix.size);
+			VERBOSE_FMT("start %s algorithm.\n", name);
+			if (func(&args, &res, &move_matrix)) {
+				printf("algorithm failure\n");
+				matrix_wipe(&move_matrix);
+				return 1;
+			}
+		}
+	}
 	
 	if (do_bench) {
 		bench_end(&bench_algo);
 	}
 
+	/* Alignments may end before the sequences do (X-drop) */
+	if (streamed && __load_streams(streams)) {
+		if (!cached && !no_matrix) {
+			matrix_wipe(&move_matrix);
+		}
+		return 1;
+	}
+	args.stream_a = NULL;
+	args.stream_b = NULL;
+
+	/* Screening: pairs below the threshold have no alignment */
+	if (args.prune && (res.below || res.score < args.min_score)) {
+		fprintf(status, "below threshold\n");
+		if (do_bench) {
+			fprintf(status, "algorithm runtime: %f\n",
+				bench_diff_s(&bench_algo));
+		}
+		for (int i = 0; i < nalignments && !cached; i++) {
+			alignment_wipe(alignments + i);
+		}
+		free(alignments);
+		cache_delete(cache);
+		if (!cached && !no_matrix) {
+			matrix_wipe(&move_matrix);
+		}
+		return 0;
+	}
+	if (args.prune && bound == 0) {
+		fprintf(status, "alignment score: %d\n", res.score);
+	}
+
+	/* X-drop alignments end at the best case */
+	algo_arg_t trace = args;
+	if (args.xdrop) {
+		trace.len_a = res.end_a;
+		trace.len_b = res.end_b;
+		fprintf(status, "alignment end: %d %d\n", res.end_a, res.end_b);
+		if (bound == 0) {
+			fprintf(status, "alignment score: %d\n", res.score);
+		}
+	}
+
+	/* The score is all there is to print */
+	if ((algorithms[algorithm].flags & ALGO_SCORE_ONLY) && !args.prune
+	&&  !binary_output)
+	{
+		printf("alignment score: %d\n", res.score);
+	}
+
 #if 0
 	print_score_matrix(&args, &score_matrix);
 	print_move_matrix(&args, &move_matrix);
@@ -365,40 +1544,75 @@ int main(int argc, char** argv) {
 		bench_start(&bench_align, "alignment runtime");
 	}
 
-	/* Alignment */
-	if (bound != 0) {
-		VERBOSE_FMT("retrieving alignments (max %d)\n", bound);
-		alignment_t* alignments = NULL;
-		int nalignments = compute_alignments(&args, &move_matrix, &alignments,
-						     bound);
-		if (nalignments <= 0) {
-			printf("Error during alignment creation\n");
+	/* Alignment. Binary alignments of a move matrix are written as they
+	 * are traced back, unless they are also needed for something else.
+	 */
+	if (binary_output && bound != 0 && !cached && !no_matrix && !cache
+	&&  !do_validation)
+	{
+		if (__write_binary_traced(&trace, res.score, &move_matrix,
+					  bound,
+					  file_output ? output_path : NULL))
+		{
 			matrix_wipe(&move_matrix);
 			return 1;
 		}
+	}
+	else if (bound != 0) {
+		if (!cached && !no_matrix) {
+			VERBOSE_FMT("retrieving alignments (max %d)\n", bound);
+			nalignments = compute_alignments(&trace, &move_matrix,
+							 &alignments, bound);
+			if (nalignments <= 0) {
+				printf("Error during alignment creation\n");
+				matrix_wipe(&move_matrix);
+				return 1;
+			}
+		}
+		if (!cached && cache) {
+			cache_store(cache, &args, algorithm, bound,
+				    res.score, alignments, nalignments);
+		}
 		if (do_validation)
 		{
-			if (validate(validation_file,alignments,nalignments)) {
-				printf("you are a fucking genius !\n");
+			if (validate(validation_file, &trace, alignments,
+				     nalignments))
+			{
+				fprintf(status, "you are a fucking genius !\n");
 			}
 			else {
-				printf("you are a fucking retard !\n");
+				fprintf(status, "you are a fucking retard !\n");
 			}
 		}
 		
-		for (int i = 0; i < nalignments; i++) {
-			printf("alignment %d:\n", i + 1);
-
-			if (i == 0)
-			{
-				int w = score_alignment(alignments + i);
-				printf("alignment score: %d\n",w);
-			}
-			print_alignment(alignments + i);
+		const char* path = file_output ? output_path : NULL;
+		int out_error = binary_output
+			      ? __write_binary(&trace, res.score, alignments,
+					       nalignments, path)
+			      : __write_text(&args, alignments, nalignments,
+					     path, async_output);
 
+		for (int i = 0; i < nalignments; i++) {
 			alignment_wipe(alignments + i);
 		}
 		free(alignments);
+		if (out_error) {
+			cache_delete(cache);
+			if (!cached && !no_matrix) {
+				matrix_wipe(&move_matrix);
+			}
+			return 1;
+		}
+	}
+	else if (binary_output
+	     &&  __write_binary(&trace, res.score, NULL, 0,
+				file_output ? output_path : NULL))
+	{
+		cache_delete(cache);
+		if (!cached && !no_matrix) {
+			matrix_wipe(&move_matrix);
+		}
+		return 1;
 	}
 
 	if (do_bench) {
@@ -406,11 +1620,26 @@ int main(int argc, char** argv) {
 	}
 
 	if (do_bench) {
-		printf("algorithm runtime: %f\n", bench_diff_s(&bench_algo));
-		printf("alignment runtime: %f\n", bench_diff_s(&bench_align));
+		fprintf(status, "algorithm runtime: %f\n",
+			bench_diff_s(&bench_algo));
+		fprintf(status, "alignment runtime: %f\n",
+			bench_diff_s(&bench_align));
+	}
+
+	if (cache && !cached && bound == 0) {
+		cache_store(cache, &args, algorithm, bound, res.score, NULL, 0);
 	}
+	cache_delete(cache);
 
-	matrix_wipe(&move_matrix);
+	if (!cached && no_matrix && bound == 0) {
+		for (int i = 0; i < nalignments; i++) {
+			alignment_wipe(alignments + i);
+		}
+		free(alignments);
+	}
+	else if (!cached && !no_matrix) {
+		matrix_wipe(&move_matrix);
+	}
 
 	return 0;
 }
@@ -9,6 +9,9 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "common.h"
 #include "matrix.h"
 
@@ -26,42 +29,314 @@ int open_tmp_buffer(char *path, size_t size) {
 	return fd;
 }
 
-int matrix_init(matrix_t* m, int w, int h, size_t base_size, int use_file) {
+#define HUGE_PAGE_SIZE	(2UL << 20)
+
+static size_t __round_up(size_t v, size_t a) {
+	return (v + a - 1) / a * a;
+}
+
+/* Anonymous mapping aligned on huge pages, so that transparent huge pages
+ * can back the whole matrix.
+ */
+static void* __mmap_thp(size_t size) {
+	char* v = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (v == MAP_FAILED) {
+		return MAP_FAILED;
+	}
+
+	char* aligned = (char*) __round_up((size_t) v, HUGE_PAGE_SIZE);
+	if (aligned > v) {
+		munmap(v, aligned - v);
+	}
+	munmap(aligned + size, (v + size + HUGE_PAGE_SIZE) - (aligned + size));
+
+	if (madvise(aligned, size, MADV_HUGEPAGE)) {
+		printf("transparent huge pages unavailable: %s\n",
+		       strerror(errno));
+	}
+	return aligned;
+}
+
+const char* matrix_alloc_names[MATRIX_ALLOC_COUNT] = {
+	"default",
+	"file",
+	"hugetlb",
+	"thp",
+	"populate",
+};
+
+int matrix_find_alloc(const char* name) {
+	for (int i = 0; i < MATRIX_ALLOC_COUNT; i++) {
+		if (!strcmp(name, matrix_alloc_names[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+const char* matrix_layout_names[MATRIX_LAYOUT_COUNT] = {
+	"diagonal",
+	"tiled",
+	"zorder",
+};
+
+int matrix_find_layout(const char* name) {
+	for (int i = 0; i < MATRIX_LAYOUT_COUNT; i++) {
+		if (!strcmp(name, matrix_layout_names[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+size_t matrix_layout_cases(int layout, int w, int h) {
+	if (layout == MATRIX_LAYOUT_DIAGONAL) {
+		return (size_t) w * h;
+	}
+	size_t tiles_w = (w + MATRIX_TILE - 1) >> MATRIX_TILE_SHIFT;
+	size_t tiles_h = (h + MATRIX_TILE - 1) >> MATRIX_TILE_SHIFT;
+	return (tiles_w * tiles_h) << (2 * MATRIX_TILE_SHIFT);
+}
+
+static void __free_layout(matrix_t* m) {
+	free(m->diag_base);
+	free(m->tile_rank);
+	free(m->tile_case);
+	m->diag_base = NULL;
+	m->tile_rank = NULL;
+	m->tile_case = NULL;
+}
+
+/* Tiles ranked along a Z-order curve, from `r`, in the square of `side`
+ * tiles at (x, y). Quadrants outside of the matrix are skipped, so only
+ * its tiles are visited when it isn't a power of two square of tiles.
+ * Returns the next rank.
+ */
+static uint32_t __rank_zorder(uint32_t* rank, int tiles_w, int tiles_h,
+			      int x, int y, int side, uint32_t r)
+{
+	if (x >= tiles_w || y >= tiles_h) {
+		return r;
+	}
+	if (side == 1) {
+		rank[(size_t) y * tiles_w + x] = r;
+		return r + 1;
+	}
+
+	int half = side / 2;
+	r = __rank_zorder(rank, tiles_w, tiles_h, x, y, half, r);
+	r = __rank_zorder(rank, tiles_w, tiles_h, x + half, y, half, r);
+	r = __rank_zorder(rank, tiles_w, tiles_h, x, y + half, half, r);
+	return __rank_zorder(rank, tiles_w, tiles_h, x + half, y + half, half,
+			     r);
+}
+
+int matrix_set_layout(matrix_t* m, int w, int h, int layout) {
+	__free_layout(m);
+	m->w = w;
+	m->h = h;
+	m->layout = layout;
+	m->tiles_w = 0;
+
+	if (layout == MATRIX_LAYOUT_DIAGONAL) {
+		m->diag_base = malloc((w + h) * sizeof(size_t));
+		if (!m->diag_base) {
+			printf("couldn't allocate matrix layout\n");
+			return 1;
+		}
+		for (int d = 0; d < w + h - 1; d++) {
+			m->diag_base[d] = matrix_diag_offset(m, d)
+					- matrix_diag_y(m, d);
+		}
+		return 0;
+	}
+
+	int tiles_w = (w + MATRIX_TILE - 1) >> MATRIX_TILE_SHIFT;
+	int tiles_h = (h + MATRIX_TILE - 1) >> MATRIX_TILE_SHIFT;
+	m->tiles_w = tiles_w;
+	m->tile_rank = malloc((size_t) tiles_w * tiles_h * sizeof(uint32_t));
+	m->tile_case = malloc(MATRIX_TILE * MATRIX_TILE * sizeof(uint16_t));
+	if (!m->tile_rank || !m->tile_case) {
+		printf("couldn't allocate matrix layout\n");
+		__free_layout(m);
+		return 1;
+	}
+
+	if (layout == MATRIX_LAYOUT_ZORDER) {
+		int side = 1;
+		while (side < max(tiles_w, tiles_h)) {
+			side <<= 1;
+		}
+		__rank_zorder(m->tile_rank, tiles_w, tiles_h, 0, 0, side, 0);
+	}
+	else {
+		for (size_t t = 0; t < (size_t) tiles_w * tiles_h; t++) {
+			m->tile_rank[t] = t;
+		}
+	}
+
+	/* Cases of a tile are stored by diagonals */
+	matrix_t tile = { .w = MATRIX_TILE, .h = MATRIX_TILE };
+	for (int y = 0; y < MATRIX_TILE; y++) {
+		for (int x = 0; x < MATRIX_TILE; x++) {
+			m->tile_case[(y << MATRIX_TILE_SHIFT) | x] =
+				matrix_diag_offset(&tile, x + y) + y
+				- matrix_diag_y(&tile, x + y);
+		}
+	}
+
+	return 0;
+}
+
+int matrix_init(matrix_t* m, int w, int h, size_t base_size, int alloc,
+		int layout)
+{
 	m->fd = -1;
-	if (use_file) {
-		m->fd = open_tmp_buffer(m->path, base_size * w * h);
+	m->file = NULL;
+	m->map_offset = 0;
+	m->diag_base = NULL;
+	m->tile_rank = NULL;
+	m->tile_case = NULL;
+	m->size = base_size * matrix_layout_cases(layout, w, h);
+
+	switch (alloc) {
+	    case MATRIX_ALLOC_FILE:
+		m->fd = open_tmp_buffer(m->path, m->size);
 		if (m->fd < 0) {
+			m->v.v = MAP_FAILED;
 			return 1;
 		}
+		m->v.v = mmap(NULL, m->size, PROT_READ | PROT_WRITE,
+			      MAP_SHARED, m->fd, 0);
+		break;
+
+	    case MATRIX_ALLOC_HUGETLB:
+		m->size = __round_up(m->size, HUGE_PAGE_SIZE);
+		m->v.v = mmap(NULL, m->size, PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+			      -1, 0);
+		if (m->v.v == MAP_FAILED) {
+			printf("no huge pages available, see "
+			       "/proc/sys/vm/nr_hugepages\n");
+		}
+		break;
+
+	    case MATRIX_ALLOC_THP:
+		m->size = __round_up(m->size, HUGE_PAGE_SIZE);
+		m->v.v = __mmap_thp(m->size);
+		break;
+
+	    case MATRIX_ALLOC_POPULATE:
+		m->v.v = mmap(NULL, m->size, PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+			      -1, 0);
+		break;
+
+	    default:
+		m->v.v = mmap(NULL, m->size, PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		break;
 	}
 
-	m->v.v = mmap(NULL,
-		      base_size * w * h,
-		      PROT_READ | PROT_WRITE,
-		      ((m->fd == -1) ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED),
-		      m->fd, 0);
 	if (m->v.v == MAP_FAILED) {
-		matrix_wipe(m);
                 printf("allocation error: %s\n", strerror(errno));
 		printf("trying to allocates %f MB\n",
 		       (base_size * w * h) / (1024.0 * 1024.0));
+		matrix_wipe(m);
 		return 1;
 	}
 
-	m->w = w;
-	m->h = h;
 	m->base_size = base_size;
+	if (matrix_set_layout(m, w, h, layout)) {
+		matrix_wipe(m);
+		return 1;
+	}
 
 	return 0;
 }
 
+int matrix_resize(matrix_t* m, int w, int h) {
+	size_t size = m->base_size * matrix_layout_cases(m->layout, w, h);
+
+	if (size > m->size) {
+		if (m->fd >= 0) {
+			printf("couldn't resize a file backed matrix\n");
+			return 1;
+		}
+
+		/* Grow by at least a half to amortize successive requests */
+		size = max(size, m->size + m->size / 2);
+		void* v = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (v == MAP_FAILED) {
+			printf("allocation error: %s\n", strerror(errno));
+			return 1;
+		}
+		munmap(m->v.v, m->size);
+		m->v.v = v;
+		m->size = size;
+	}
+
+	return matrix_set_layout(m, w, h, m->layout);
+}
+
 void matrix_wipe(matrix_t* m) {
 	if (m->v.v != MAP_FAILED) {
-		munmap(m->v.v, m->w * m->h * m->base_size);
+		munmap(m->v.c - m->map_offset, m->size + m->map_offset);
 	}
 	if (m->fd >= 0) {
 		close(m->fd);
-		unlink(m->path);
+		/* Durable files are kept for later runs */
+		if (!m->file) {
+			unlink(m->path);
+		}
+	}
+	free(m->file);
+	__free_layout(m);
+}
+
+void matrix_stream(char* dst, const char* src, size_t n) {
+#ifdef __SSE2__
+	while (((size_t) dst & 15) && n > 0) {
+		*dst++ = *src++;
+		n--;
+	}
+	while (n >= 16) {
+		_mm_stream_si128((__m128i*) dst,
+				 _mm_loadu_si128((const __m128i*) src));
+		dst += 16;
+		src += 16;
+		n -= 16;
+	}
+#endif
+	memcpy(dst, src, n);
+}
+
+void matrix_stream_fence(void) {
+#ifdef __SSE2__
+	_mm_sfence();
+#endif
+}
+
+void matrix_store_diagonal(matrix_t* m, int d, int i, const char* src, int n,
+			   int nt)
+{
+	char* dst = m->v.c + m->diag_base[d] + matrix_diag_y(m, d) + i;
+	if (nt) {
+		matrix_stream(dst, src, n);
+	}
+	else {
+		memcpy(dst, src, n);
+	}
+}
+
+void matrix_store_tiled(matrix_t* m, int d, int i, const char* src, int n) {
+	int x = matrix_diag_x(m, d) - i;
+	int y = matrix_diag_y(m, d) + i;
+
+	for (int k = 0; k < n; k++) {
+		m->v.c[matrix_tiled_offset(m, x - k, y + k)] = src[k];
 	}
 }
 
@@ -76,91 +351,20 @@ int matrix_diag_size(const matrix_t* m, int d) {
 		  
 }
 
-/* TODO simplify this function */
-size_t matrix_diag_offset(const matrix_t* m, size_t d) {
-	size_t k = (d + 1) - m->w;
+/* Cases (x, y) with x + y < n in an unbounded quarter plane */
+static size_t __triangle(long n) {
+	return (n > 0) ? (size_t) n * (n + 1) / 2 : 0;
+}
 
-	if (m->w == m->h) {
-		if (d <= m->w) {
-			return (d * (d + 1)) / 2;
-		}
-		else {
-			size_t rh = m->h - 1;
-			size_t kh = m->h - k;
-			size_t sum = (rh * (rh + 1)) / 2
-			   	   - (kh * (kh + 1)) / 2;
-			return (((size_t) m->w) * (((size_t) m->w) + 1)) / 2
-			     + sum;
-		}
-	}
-	else if (m->w > m->h) {
-		/*   0  1  2  3  4
-		 *
-		 * 0 f  f  f  m  m
-		 *
-		 * 1 f  f  m  m  l
-		 *
-		 * 2 f  m  m  l  l
-		 *
-		 */
-		if (d < m->h) {
-			return d * (d + 1) / 2;
-		}
-		else if (d < m->w) {
-			size_t sup_d = m->h;
-			size_t dec = d - sup_d;
-			return (sup_d * (sup_d + 1)) / 2
-			     + dec * m->h;
-		}
-		else {
-			size_t sup_d = m->h;
-			size_t dec = m->w - sup_d;
-			size_t h = m->h - 1;
-			size_t hk = m->h - k;
-			size_t diff_sum = (h * (h + 1)) / 2
-				     - (hk * (hk + 1)) / 2;
-			return (sup_d * (sup_d + 1)) / 2
-			     + dec * m->h
-			     + diff_sum;
-		}
-	}
-	else {
-		/*   0  1  2
-		 *
-		 * 0 f  f  f
-		 *
-		 * 1 f  f  m
-		 *
-		 * 2 f  m  m
-		 *
-		 * 3 m  m  l
-		 *
-		 * 4 m  l  l
-		 *
-		 */
-		if (d < m->w) {
-			return d * (d + 1) / 2;
-		}
-		else if (d < m->h) {
-			size_t sup_d = m->w;
-			size_t dec = d - sup_d;
-			return (sup_d * (sup_d + 1)) / 2
-			     + dec * m->w;
-		}
-		else {
-			k -= (m->h - m->w);
-			size_t sup_d = m->w;
-			size_t dec = m->h - sup_d;
-			size_t w = m->w - 1;
-			size_t wk = m->w - k;
-			size_t diff_sum = (w * (w + 1)) / 2
-				     - (wk * (wk + 1)) / 2;
-			return (sup_d * (sup_d + 1)) / 2
-			     + dec * m->w
-			     + diff_sum;
-		}
-	}
-	return -1;
+size_t matrix_diag_offset(const matrix_t* m, size_t d) {
+	/* Remove from the triangle the cases beyond the width and the height,
+	 * counting twice removed ones back.
+	 */
+	long n = d;
+	return __triangle(n)
+	     - __triangle(n - m->w)
+	     - __triangle(n - m->h)
+	     + __triangle(n - m->w - m->h);
 }
 
 int matrix_diag_y(const matrix_t* m, int diag) {
@@ -181,16 +385,6 @@ int matrix_diag_x(const matrix_t* m, int diag) {
 	}
 }
 
-size_t matrix_coord_offset(const matrix_t* matrix, int x, int y) {
-	size_t diag = x + y; 
-	size_t diag_off = matrix_diag_offset(matrix, diag);
-	size_t diag_x = matrix_diag_x(matrix, diag);
-	size_t diag_y = matrix_diag_y(matrix, diag);
-	size_t rel_x = abs(x - diag_x);
-	size_t rel_y = abs(y - diag_y);
-	return diag_off + min(rel_x, rel_y);
-}
-
 #ifdef TEST
 
 #include <stdio.h>
@@ -224,7 +418,7 @@ int test_diag_offset(const matrix_t* m) {
 
 int test_conversion_xy(void) {
 	matrix_t m;
-	matrix_init(&m, 4, 3, sizeof(int), 0);
+	matrix_init(&m, 4, 3, sizeof(int), 0, MATRIX_LAYOUT_DIAGONAL);
 
 	int references[] = {
 		0,  1,  3,  6,
@@ -247,14 +441,63 @@ int test_conversion_xy(void) {
 	return 0;
 }
 
+/* Every case must have its own offset inside of the matrix */
+int test_layout(int layout, int w, int h) {
+	matrix_t m;
+	if (matrix_init(&m, w, h, sizeof(char), 0, layout)) {
+		return 1;
+	}
+
+	size_t cases = matrix_layout_cases(layout, w, h);
+	char* seen = calloc(cases, 1);
+	int ret = 0;
+	for (int y = 0; y < h && !ret; y++) {
+		for (int x = 0; x < w; x++) {
+			size_t off = matrix_coord_offset(&m, x, y);
+			if (off >= cases || seen[off]) {
+				printf("error for %s %dx%d at %d %d: "
+				       "offset %zu\n", matrix_layout_names[layout],
+				       w, h, x, y, off);
+				ret = 1;
+				break;
+			}
+			seen[off] = 1;
+		}
+	}
+
+	free(seen);
+	matrix_wipe(&m);
+	return ret;
+}
+
+int test_layouts(void) {
+	int sizes[][2] = {
+		{ 1, 1 }, { 4, 3 }, { 64, 64 }, { 65, 64 }, { 130, 70 },
+		{ 3, 200 }, { 300, 129 },
+		/* Elongated matrices only rank the tiles they have */
+		{ 3, 1 << 20 }, { 1 << 20, 70 },
+	};
+
+	for (int layout = 0; layout < MATRIX_LAYOUT_COUNT; layout++) {
+		for (int i = 0; i < countof(sizes); i++) {
+			if (test_layout(layout, sizes[i][0], sizes[i][1])) {
+				return 1;
+			}
+		}
+		printf("offsets of %s layout are OK\n",
+		       matrix_layout_names[layout]);
+	}
+	return 0;
+}
+
 int main(void) {
 	matrix_t m_square;
 	matrix_t m_width;
 	matrix_t m_height;
 
-	matrix_init(&m_square, 11, 11, sizeof(int), 0);
-	matrix_init(&m_width, 19, 7, sizeof(int), 0);
-	matrix_init(&m_height, 29, 7, sizeof(int), 0);
+	matrix_init(&m_square, 11, 11, sizeof(int), 0, MATRIX_LAYOUT_DIAGONAL);
+	matrix_init(&m_width, 19, 7, sizeof(int), 0, MATRIX_LAYOUT_DIAGONAL);
+	matrix_init(&m_height, 29, 7, sizeof(int), 0, MATRIX_LAYOUT_DIAGONAL);
 
 	if (test_diag_offset(&m_square)) {
 		printf("error with square matrix\n");
@@ -280,6 +523,7 @@ int main(void) {
 	matrix_wipe(&m_height);
 
 	test_conversion_xy();
+	test_layouts();
 
 	return 0;
 }
@@ -1,6 +1,9 @@
 #ifndef _matrix_h_
 #define _matrix_h_
 
+#include <stddef.h>
+#include <stdint.h>
+
 /* Matrix are stored in memory by anti-diagonals (called "diagonals" in the next
  * of the code).
  * This fits better for Needleman-Wunsch processing.
@@ -23,27 +26,135 @@
  *   a b c d e f g h i 			a   b d   c e g   f h   i
  *
  */
+
+/* Matrix layouts, as recorded in matrix files.
+ *
+ * Diagonal is the layout described above. Kernels write it contiguously,
+ * but the traceback jumps a whole diagonal at each step.
+ *
+ * Tiled layouts split the matrix in square tiles of MATRIX_TILE cases (one
+ * page of moves). Cases are stored by diagonals inside a tile, so the
+ * kernel still writes runs of consecutive cases, and the traceback stays
+ * in a tile for up to MATRIX_TILE steps. Tiles are ordered row by row
+ * (tiled) or following a Z-order curve (zorder), which keeps neighbour
+ * tiles close at any scale.
+ *
+ * Offsets are table-driven: a lookup per diagonal for the diagonal layout,
+ * a lookup per tile and per case in tile for the tiled ones.
+ */
+enum {
+	MATRIX_LAYOUT_DIAGONAL = 0,
+	MATRIX_LAYOUT_TILED,
+	MATRIX_LAYOUT_ZORDER,
+	MATRIX_LAYOUT_COUNT,
+};
+
+#define MATRIX_TILE_SHIFT	6
+#define MATRIX_TILE		(1 << MATRIX_TILE_SHIFT)
+#define MATRIX_TILE_MASK	(MATRIX_TILE - 1)
+
 typedef struct matrix {
 	int	w, h;
 	int	base_size;
+	size_t	size;		/* mapped size, may exceed w * h */
+	size_t	map_offset;	/* offset of the values in the mapping */
         int     fd;
 	char	path[32];
+	struct matrix_file* file;	/* durable file (see matrix_file.h) */
 	union {
 		int*	i;
 		char*	c;
 		void*	v;
 	} v;
+
+	/* Layout offset tables */
+	int		layout;
+	int		tiles_w;
+	size_t*		diag_base;	/* diagonal offset - first case y */
+	uint32_t*	tile_rank;	/* rank of each tile */
+	uint16_t*	tile_case;	/* offset of each case in its tile */
 } matrix_t;
 
-int matrix_init(matrix_t* m, int w, int h, size_t base_size, int use_file);
+/* Matrix allocation backends */
+enum {
+	MATRIX_ALLOC_DEFAULT = 0,	/* anonymous memory */
+	MATRIX_ALLOC_FILE,		/* temporary file (hard drive memory) */
+	MATRIX_ALLOC_HUGETLB,		/* explicit huge pages (MAP_HUGETLB) */
+	MATRIX_ALLOC_THP,		/* transparent huge pages (madvise) */
+	MATRIX_ALLOC_POPULATE,		/* pre-faulted memory (MAP_POPULATE) */
+	MATRIX_ALLOC_COUNT,
+};
+
+extern const char* matrix_alloc_names[MATRIX_ALLOC_COUNT];
+
+/* Returns the allocation backend of given name, -1 if unknown */
+int matrix_find_alloc(const char* name);
+
+extern const char* matrix_layout_names[MATRIX_LAYOUT_COUNT];
+
+/* Returns the layout of given name, -1 if unknown */
+int matrix_find_layout(const char* name);
+
+/* Number of cases a w x h matrix takes in given layout */
+size_t matrix_layout_cases(int layout, int w, int h);
+
+int matrix_init(matrix_t* m, int w, int h, size_t base_size, int alloc,
+		int layout);
+
+/* Build the offset tables of a w x h matrix in given layout */
+int matrix_set_layout(matrix_t* m, int w, int h, int layout);
+
+/* Reuse the matrix memory for a w x h matrix, growing it if needed.
+ * Only anonymous matrices can grow.
+ */
+int matrix_resize(matrix_t* m, int w, int h);
 
 void matrix_wipe(matrix_t* m);
 
+/* Copy `n` values to `dst` with non-temporal stores, so that they don't
+ * evict the cache. `matrix_stream_fence` must be called before they are
+ * read by another thread.
+ */
+void matrix_stream(char* dst, const char* src, size_t n);
+
+void matrix_stream_fence(void);
+
+/* Store the `n` values of `src` in diagonal `d`, from its `i`th case, of a
+ * matrix in the diagonal layout, with non-temporal stores if `nt`.
+ */
+void matrix_store_diagonal(matrix_t* m, int d, int i, const char* src, int n,
+			   int nt);
+
+/* Same in the tiled and zorder layouts */
+void matrix_store_tiled(matrix_t* m, int d, int i, const char* src, int n);
+
 int matrix_diag_size(const matrix_t* m, int d);
 
+/* Number of cases before diagonal `d`, whatever the layout */
 size_t matrix_diag_offset(const matrix_t* m, size_t d);
 
-size_t matrix_coord_offset(const matrix_t* m, int x, int y);
+/* Offset of case (x, y) in the diagonal layout, and in the tiled ones.
+ * Kernels and traceback are specialized by layout with them, other users
+ * go through `matrix_coord_offset`.
+ */
+static inline size_t matrix_diagonal_offset(const matrix_t* m, int x, int y) {
+	return m->diag_base[x + y] + y;
+}
+
+static inline size_t matrix_tiled_offset(const matrix_t* m, int x, int y) {
+	size_t tile = m->tile_rank[(y >> MATRIX_TILE_SHIFT) * m->tiles_w
+				   + (x >> MATRIX_TILE_SHIFT)];
+	return (tile << (2 * MATRIX_TILE_SHIFT))
+	     + m->tile_case[((y & MATRIX_TILE_MASK) << MATRIX_TILE_SHIFT)
+			    | (x & MATRIX_TILE_MASK)];
+}
+
+static inline size_t matrix_coord_offset(const matrix_t* m, int x, int y) {
+	if (m->layout == MATRIX_LAYOUT_DIAGONAL) {
+		return matrix_diagonal_offset(m, x, y);
+	}
+	return matrix_tiled_offset(m, x, y);
+}
 
 int matrix_diag_x(const matrix_t* m, int diag);
 
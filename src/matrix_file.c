@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "matrix_file.h"
+#include "scoring.h"
+
+static size_t __page_size(void) {
+	return sysconf(_SC_PAGESIZE);
+}
+
+static size_t __align_up(size_t v, size_t a) {
+	return (v + a - 1) / a * a;
+}
+
+static int* __slot_window(const matrix_t* m, int slot, int i) {
+	const matrix_file_header_t* h = m->file->header;
+	uint8_t* base = (uint8_t*) h + h->checkpoint_offset;
+	return (int*) base + (MATRIX_FILE_WINDOWS * slot + i) * h->window_size;
+}
+
+/* Flush a byte range of the mapping */
+static int __sync(const matrix_t* m, size_t start, size_t end) {
+	size_t page = __page_size();
+	uint8_t* base = (uint8_t*) m->file->header;
+
+	start = start / page * page;
+	if (end <= start) {
+		return 0;
+	}
+	if (msync(base + start, end - start, MS_SYNC)) {
+		printf("couldn't flush matrix file: %s\n", strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+static void __fill_header(matrix_file_header_t* h, const algo_arg_t* args,
+			  const char* algorithm, int layout, size_t window_size,
+			  size_t checkpoint_offset, size_t data_offset)
+{
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, MATRIX_FILE_MAGIC, sizeof(h->magic));
+	h->version = MATRIX_FILE_VERSION;
+	h->state = MF_COMPUTING;
+	h->hash_a = hash64(args->seq_a, args->len_a, 0);
+	h->hash_b = hash64(args->seq_b, args->len_b, 0);
+	h->len_a = args->len_a;
+	h->len_b = args->len_b;
+	h->w = args->len_a + 1;
+	h->h = args->len_b + 1;
+	h->base_size = sizeof(char);
+	h->layout = layout;
+	strncpy(h->algorithm, algorithm, sizeof(h->algorithm) - 1);
+	h->checkpoint_diag[0] = -1;
+	h->checkpoint_diag[1] = -1;
+	h->window_size = window_size;
+	h->checkpoint_offset = checkpoint_offset;
+	h->data_offset = data_offset;
+	h->scoring = scoring_hash(args->scoring ? args->scoring
+						: &scoring_default);
+}
+
+/* Check an existing header against the expected one */
+static int __check_header(const matrix_file_header_t* h,
+			  const matrix_file_header_t* ref,
+			  const char* path, int readonly)
+{
+	if (memcmp(h->magic, ref->magic, sizeof(h->magic))
+	||  h->version != ref->version)
+	{
+		printf("%s is not a matrix file\n", path);
+		return 1;
+	}
+	if (h->hash_a != ref->hash_a || h->hash_b != ref->hash_b
+	||  h->len_a != ref->len_a || h->len_b != ref->len_b
+	||  h->w != ref->w || h->h != ref->h
+	||  h->base_size != ref->base_size
+	||  h->window_size != ref->window_size
+	||  h->checkpoint_offset != ref->checkpoint_offset
+	||  h->data_offset != ref->data_offset)
+	{
+		printf("matrix file %s was computed for other sequences\n",
+		       path);
+		return 1;
+	}
+	if (h->scoring != ref->scoring) {
+		printf("matrix file %s was computed with another scoring\n",
+		       path);
+		return 1;
+	}
+	if (h->layout != ref->layout) {
+		printf("matrix file %s has another layout\n", path);
+		return 1;
+	}
+	if (readonly && h->state != MF_COMPLETE) {
+		printf("matrix file %s is not complete\n", path);
+		return 1;
+	}
+	if (!readonly && h->state != MF_COMPLETE
+	&&  strcmp(h->algorithm, ref->algorithm))
+	{
+		printf("matrix file %s is being computed by `%s`\n",
+		       path, h->algorithm);
+		return 1;
+	}
+	return 0;
+}
+
+int matrix_file_open(matrix_t* m, const char* path, const algo_arg_t* args,
+		     const char* algorithm, int layout, int readonly,
+		     int interval)
+{
+	size_t page = __page_size();
+	size_t window_size = args->len_a + args->len_b + 2;
+	size_t checkpoint_offset = MATRIX_FILE_HEADER_SIZE;
+	size_t data_offset = __align_up(checkpoint_offset
+					+ 2 * MATRIX_FILE_WINDOWS
+					  * window_size * sizeof(int),
+					page);
+	size_t w = args->len_a + 1;
+	size_t h = args->len_b + 1;
+	size_t size = matrix_layout_cases(layout, w, h) * sizeof(char);
+
+	memset(m, 0, sizeof(*m));
+	m->fd = -1;
+	m->v.v = MAP_FAILED;
+	strncpy(m->path, path, sizeof(m->path) - 1);
+
+	m->file = malloc(sizeof(matrix_file_t));
+	if (!m->file) {
+		printf("couldn't allocate matrix file\n");
+		return 1;
+	}
+	memset(m->file, 0, sizeof(matrix_file_t));
+	m->file->readonly = readonly;
+	m->file->interval = interval;
+	clock_gettime(CLOCK_MONOTONIC, &m->file->last);
+
+	m->fd = open(path, readonly ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+	if (m->fd < 0) {
+		printf("couldn't open matrix file %s: %s\n", path,
+		       strerror(errno));
+		goto error;
+	}
+
+	struct stat st;
+	if (fstat(m->fd, &st)) {
+		printf("couldn't stat matrix file %s\n", path);
+		goto error;
+	}
+	int fresh = (st.st_size == 0);
+	if (fresh && readonly) {
+		printf("matrix file %s is empty\n", path);
+		goto error;
+	}
+	if (!fresh && matrix_file_layout(path) != layout) {
+		printf("matrix file %s has another layout\n", path);
+		goto error;
+	}
+	if (!fresh && (size_t) st.st_size != data_offset + size) {
+		printf("matrix file %s has an unexpected size\n", path);
+		goto error;
+	}
+	if (fresh) {
+		printf("creating %s (%f MB)\n", path,
+		       (data_offset + size) / (1024.0 * 1024.0));
+		if (ftruncate(m->fd, data_offset + size)) {
+			printf("couldn't resize matrix file %s: %s\n", path,
+			       strerror(errno));
+			goto error;
+		}
+	}
+
+	uint8_t* map = mmap(NULL, data_offset + size,
+			    PROT_READ | (readonly ? 0 : PROT_WRITE),
+			    MAP_SHARED, m->fd, 0);
+	if (map == MAP_FAILED) {
+		printf("couldn't map matrix file %s: %s\n", path,
+		       strerror(errno));
+		goto error;
+	}
+	m->v.c = (char*) map + data_offset;
+	m->map_offset = data_offset;
+	m->size = size;
+	m->base_size = sizeof(char);
+	m->file->header = (matrix_file_header_t*) map;
+	if (matrix_set_layout(m, w, h, layout)) {
+		goto error;
+	}
+
+	matrix_file_header_t ref;
+	__fill_header(&ref, args, algorithm, layout, window_size,
+		      checkpoint_offset, data_offset);
+	if (fresh) {
+		*m->file->header = ref;
+		if (__sync(m, 0, MATRIX_FILE_HEADER_SIZE)) {
+			goto error;
+		}
+	}
+	else if (__check_header(m->file->header, &ref, path, readonly)) {
+		goto error;
+	}
+
+	return 0;
+
+    error:
+	matrix_wipe(m);
+	return 1;
+}
+
+int matrix_file_layout(const char* path) {
+	matrix_file_header_t h;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	int layout = -1;
+	if (read(fd, &h, sizeof(h)) == sizeof(h)
+	&&  !memcmp(h.magic, MATRIX_FILE_MAGIC, sizeof(h.magic))
+	&&  h.version == MATRIX_FILE_VERSION
+	&&  h.layout < MATRIX_LAYOUT_COUNT)
+	{
+		layout = h.layout;
+	}
+
+	close(fd);
+	return layout;
+}
+
+int matrix_file_is_complete(const matrix_t* m, int* score) {
+	if (m->file->header->state != MF_COMPLETE) {
+		return 0;
+	}
+	*score = m->file->header->score;
+	return 1;
+}
+
+int matrix_file_resume(const matrix_t* m, int* const* windows) {
+	const matrix_file_header_t* h = m->file->header;
+	int slot = h->slot;
+	int diag = h->checkpoint_diag[slot];
+
+	if (h->state == MF_COMPLETE || diag < 0) {
+		return -1;
+	}
+
+	for (int i = 0; i < MATRIX_FILE_WINDOWS; i++) {
+		memcpy(windows[i], __slot_window(m, slot, i),
+		       h->window_size * sizeof(int));
+	}
+	return diag;
+}
+
+int matrix_file_checkpoint(matrix_t* m, int diag, int* const* windows) {
+	matrix_file_t* f = m->file;
+	matrix_file_header_t* h = f->header;
+	if (f->readonly) {
+		return 0;
+	}
+
+	/* Values of the completed diagonals first. Tiled layouts spread
+	 * diagonals over the whole matrix, only dirty pages are written back.
+	 */
+	size_t end = m->size;
+	if (m->layout == MATRIX_LAYOUT_DIAGONAL) {
+		end = (diag + 1 < m->w + m->h - 1)
+		    ? matrix_diag_offset(m, diag + 1) * m->base_size
+		    : m->size;
+	}
+	else {
+		f->synced = 0;
+	}
+	if (__sync(m, m->map_offset + f->synced, m->map_offset + end)) {
+		return 1;
+	}
+	f->synced = end;
+
+	/* Then the windows, in the slot not used by the last checkpoint */
+	int slot = 1 - h->slot;
+	for (int i = 0; i < MATRIX_FILE_WINDOWS; i++) {
+		memcpy(__slot_window(m, slot, i), windows[i],
+		       h->window_size * sizeof(int));
+	}
+	h->checkpoint_diag[slot] = -1;
+	if (__sync(m, 0, m->map_offset)) {
+		return 1;
+	}
+
+	/* And finally the header, which validates the checkpoint */
+	h->checkpoint_diag[slot] = diag;
+	h->slot = slot;
+	if (__sync(m, 0, MATRIX_FILE_HEADER_SIZE)) {
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &f->last);
+	VERBOSE_FMT("checkpoint at diagonal %d\n", diag);
+	return 0;
+}
+
+int matrix_file_tick(matrix_t* m, int diag, int* const* windows) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec - m->file->last.tv_sec < m->file->interval) {
+		return 0;
+	}
+	return matrix_file_checkpoint(m, diag, windows);
+}
+
+int matrix_file_complete(matrix_t* m, int score) {
+	matrix_file_t* f = m->file;
+	if (f->readonly) {
+		return 0;
+	}
+
+	if (m->layout != MATRIX_LAYOUT_DIAGONAL) {
+		f->synced = 0;
+	}
+	if (__sync(m, m->map_offset + f->synced, m->map_offset + m->size)) {
+		return 1;
+	}
+	f->synced = m->size;
+
+	f->header->score = score;
+	f->header->state = MF_COMPLETE;
+	return __sync(m, 0, MATRIX_FILE_HEADER_SIZE);
+}
+
@@ -0,0 +1,103 @@
+#ifndef _matrix_file_h_
+#define _matrix_file_h_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "common.h"
+#include "matrix.h"
+
+/* Durable move matrix file.
+ *
+ * Unlike the temporary file of `-u`, this file is named, self-described and
+ * kept after the run, so that:
+ *  - a crashed computation can be resumed from its last checkpoint,
+ *  - a completed matrix can be mapped again to compute alignments without
+ *    recomputing it.
+ *
+ * Layout:
+ *
+ *	header		MATRIX_FILE_HEADER_SIZE bytes
+ *	checkpoints	two slots of MATRIX_FILE_WINDOWS score windows
+ *	values		the matrix in the layout of the header, page aligned
+ *
+ * A checkpoint is the last completed diagonal, the best score windows of this
+ * diagonal and the previous one, and the gap state windows of this one.
+ * Matrix values are flushed before the checkpoint is written, and slots are
+ * used alternately so a crash while checkpointing keeps the previous
+ * checkpoint valid.
+ */
+
+#define MATRIX_FILE_MAGIC	"NWMATRIX"
+#define MATRIX_FILE_VERSION	2
+#define MATRIX_FILE_WINDOWS	4	/* score windows per checkpoint */
+#define MATRIX_FILE_HEADER_SIZE	4096
+
+/* Matrix file states */
+enum {
+	MF_COMPUTING	= 0,
+	MF_COMPLETE	= 1,
+};
+
+typedef struct matrix_file_header {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	state;
+	uint64_t	hash_a;
+	uint64_t	hash_b;
+	uint32_t	len_a;
+	uint32_t	len_b;
+	uint32_t	w;
+	uint32_t	h;
+	uint32_t	base_size;
+	uint32_t	layout;
+	char		algorithm[64];
+	int32_t		score;			/* valid when complete */
+	uint32_t	slot;			/* last written checkpoint slot */
+	int64_t		checkpoint_diag[2];	/* -1 if slot is empty */
+	uint64_t	window_size;		/* ints per window */
+	uint64_t	checkpoint_offset;
+	uint64_t	data_offset;
+	uint64_t	scoring;		/* scoring_hash() */
+} matrix_file_header_t;
+
+typedef struct matrix_file {
+	matrix_file_header_t*	header;
+	int			readonly;
+	int			interval;	/* seconds between checkpoints */
+	struct timespec		last;
+	size_t			synced;		/* bytes of values flushed */
+} matrix_file_t;
+
+/* Open or create the durable matrix of args sequences at `path`.
+ * An existing file must match the sequences and the algorithm, unless
+ * opened read-only where it must be complete.
+ */
+int matrix_file_open(matrix_t* m, const char* path, const algo_arg_t* args,
+		     const char* algorithm, int layout, int readonly,
+		     int interval);
+
+/* Returns the layout of the matrix file at `path`, -1 if there is none */
+int matrix_file_layout(const char* path);
+
+/* Returns 1 and gives the score if the matrix is completely computed */
+int matrix_file_is_complete(const matrix_t* m, int* score);
+
+/* Restore the score windows of the last checkpoint.
+ * Returns the last completed diagonal, or -1 if there is no checkpoint.
+ */
+int matrix_file_resume(const matrix_t* m, int* const* windows);
+
+/* Checkpoint diagonal `diag` if the checkpoint interval is elapsed.
+ * `windows` are the best scores of diagonals diag - 1 and diag, then the
+ * E and F gap states of diagonal diag.
+ */
+int matrix_file_tick(matrix_t* m, int diag, int* const* windows);
+
+int matrix_file_checkpoint(matrix_t* m, int diag, int* const* windows);
+
+/* Mark the matrix as complete */
+int matrix_file_complete(matrix_t* m, int score);
+
+#endif
+
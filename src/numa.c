@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <omp.h>
+#include <sys/syscall.h>
+
+#include "common.h"
+#include "numa.h"
+
+/* From linux/mempolicy.h, to avoid depending on libnuma */
+#define MPOL_PREFERRED	1
+#define MPOL_MF_MOVE	(1 << 1)
+
+/* Node shared by all the threads, -1 if they span several nodes */
+static int __team_node = -1;
+
+static const char* __affinity_names[] = {
+	"none",
+	"compact",
+	"spread",
+};
+
+int numa_find_affinity(const char* name) {
+	for (int i = 0; i < countof(__affinity_names); i++) {
+		if (!strcmp(name, __affinity_names[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Parse a kernel cpu list ("0-3,8-11") and keep the allowed cpus */
+static int __parse_cpulist(const char* list, const cpu_set_t* allowed,
+			   int* cpus, int max_cpus)
+{
+	int n = 0;
+	const char* p = list;
+
+	while (*p && *p != '\n') {
+		char* end;
+		int first = strtol(p, &end, 10);
+		int last = first;
+		if (end == p) {
+			return -1;
+		}
+		p = end;
+		if (*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			p = end;
+		}
+		for (int cpu = first; cpu <= last && n < max_cpus; cpu++) {
+			if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, allowed)) {
+				cpus[n++] = cpu;
+			}
+		}
+		if (*p == ',') {
+			p++;
+		}
+	}
+	return n;
+}
+
+int numa_read_topology(numa_topology_t* topo) {
+	cpu_set_t allowed;
+	int used = 0;
+
+	memset(topo, 0, sizeof(*topo));
+	if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+		printf("couldn't get cpu affinity: %s\n", strerror(errno));
+		return 1;
+	}
+
+	for (int node = 0; node < NUMA_MAX_NODES; node++) {
+		char path[64];
+		char list[1024];
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/node/node%d/cpulist", node);
+
+		FILE* f = fopen(path, "r");
+		if (!f) {
+			continue;
+		}
+		if (!fgets(list, sizeof(list), f)) {
+			list[0] = '\0';
+		}
+		fclose(f);
+
+		int n = __parse_cpulist(list, &allowed, topo->buf + used,
+					NUMA_MAX_CPUS - used);
+		if (n <= 0) {
+			continue;
+		}
+		topo->id[topo->nodes] = node;
+		topo->cpus[topo->nodes] = topo->buf + used;
+		topo->ncpus[topo->nodes] = n;
+		topo->nodes++;
+		used += n;
+	}
+
+	/* No sysfs node information: a single node */
+	if (topo->nodes == 0) {
+		for (int cpu = 0; cpu < CPU_SETSIZE && used < NUMA_MAX_CPUS;
+		     cpu++)
+		{
+			if (CPU_ISSET(cpu, &allowed)) {
+				topo->buf[used++] = cpu;
+			}
+		}
+		topo->cpus[0] = topo->buf;
+		topo->ncpus[0] = used;
+		topo->nodes = 1;
+	}
+
+	return 0;
+}
+
+void numa_print_topology(const numa_topology_t* topo) {
+	printf("%d numa node(s)\n", topo->nodes);
+	for (int node = 0; node < topo->nodes; node++) {
+		printf(" node %d:", topo->id[node]);
+		for (int i = 0; i < topo->ncpus[node]; i++) {
+			printf(" %d", topo->cpus[node][i]);
+		}
+		printf("\n");
+	}
+}
+
+/* Node and cpu of thread `t` among `threads` */
+static void __thread_place(const numa_topology_t* topo, int affinity,
+			   int threads, int t, int* node, int* cpu)
+{
+	if (affinity == NUMA_AFFINITY_SPREAD) {
+		*node = (int) ((long) t * topo->nodes / threads);
+		int first = (int) (((long) *node * threads + topo->nodes - 1)
+				   / topo->nodes);
+		*cpu = topo->cpus[*node][(t - first) % topo->ncpus[*node]];
+		return;
+	}
+
+	/* Compact */
+	int total = 0;
+	for (int n = 0; n < topo->nodes; n++) {
+		total += topo->ncpus[n];
+	}
+	int k = t % total;
+	for (*node = 0; k >= topo->ncpus[*node]; (*node)++) {
+		k -= topo->ncpus[*node];
+	}
+	*cpu = topo->cpus[*node][k];
+}
+
+int numa_setup(int threads, int affinity) {
+	numa_topology_t topo;
+
+	if (threads > 0) {
+		omp_set_num_threads(threads);
+	}
+	threads = omp_get_max_threads();
+
+	if (numa_read_topology(&topo)) {
+		return 1;
+	}
+	if (verbose) {
+		numa_print_topology(&topo);
+	}
+
+	__team_node = -1;
+	if (affinity == NUMA_AFFINITY_NONE) {
+		return 0;
+	}
+
+	int nodes[threads];
+	int error = 0;
+
+	/* OpenMP keeps its threads, they stay pinned for later regions */
+	#pragma omp parallel num_threads(threads)
+	{
+		int t = omp_get_thread_num();
+		int cpu;
+		cpu_set_t set;
+
+		__thread_place(&topo, affinity, threads, t, &nodes[t], &cpu);
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set)) {
+			#pragma omp atomic write
+			error = 1;
+		}
+		VERBOSE_FMT("thread %d on cpu %d (node %d)\n",
+			    t, cpu, topo.id[nodes[t]]);
+	}
+	if (error) {
+		printf("couldn't pin threads: %s\n", strerror(errno));
+		return 1;
+	}
+
+	/* Without NUMA, there is nothing to place */
+	if (topo.nodes == 1) {
+		return 0;
+	}
+
+	/* Nodes without usable cpus are left out of the topology: the team
+	 * node is the sysfs number, as mbind wants it.
+	 */
+	__team_node = topo.id[nodes[0]];
+	for (int t = 1; t < threads; t++) {
+		if (nodes[t] != nodes[0]) {
+			__team_node = -1;
+		}
+	}
+
+	return 0;
+}
+
+void numa_place(void* addr, size_t size) {
+	if (__team_node < 0 || __team_node >= 8 * sizeof(unsigned long)) {
+		return;
+	}
+
+	/* mbind needs a page aligned range */
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t start = (size_t) addr / page * page;
+	size = (size_t) addr + size - start;
+	unsigned long mask = 1UL << __team_node;
+
+	if (syscall(SYS_mbind, start, size, MPOL_PREFERRED, &mask,
+		    8 * sizeof(mask) + 1, MPOL_MF_MOVE))
+	{
+		VERBOSE_FMT("couldn't bind matrix to node %d: %s\n",
+			    __team_node, strerror(errno));
+	}
+}
+
@@ -0,0 +1,53 @@
+#ifndef _numa_h_
+#define _numa_h_
+
+#include <stddef.h>
+
+/* NUMA topology and thread placement.
+ *
+ * Iterative kernels split each diagonal in contiguous slices, one per
+ * OpenMP thread (static schedule). Threads are pinned so that consecutive
+ * threads share a node: a node then owns a band of rows of the matrix, and
+ * the pages of its slices are first touched by its own threads.
+ */
+
+#define NUMA_MAX_NODES	64
+#define NUMA_MAX_CPUS	1024
+
+typedef struct numa_topology {
+	int	nodes;
+	int	id[NUMA_MAX_NODES];		/* sysfs node numbers */
+	int	ncpus[NUMA_MAX_NODES];		/* usable cpus per node */
+	int*	cpus[NUMA_MAX_NODES];		/* usable cpus of each node */
+	int	buf[NUMA_MAX_CPUS];
+} numa_topology_t;
+
+/* Thread affinity policies */
+enum {
+	NUMA_AFFINITY_NONE = 0,		/* threads float */
+	NUMA_AFFINITY_COMPACT,		/* fill nodes one after the other */
+	NUMA_AFFINITY_SPREAD,		/* same share of threads on each node */
+};
+
+/* Returns the affinity of given name, -1 if unknown */
+int numa_find_affinity(const char* name);
+
+/* Read the topology from /sys/devices/system/node, restricted to the cpus
+ * the process may run on. Machines without NUMA give a single node.
+ */
+int numa_read_topology(numa_topology_t* topo);
+
+void numa_print_topology(const numa_topology_t* topo);
+
+/* Set the number of OpenMP threads (0 keeps the default) and pin them with
+ * given affinity policy.
+ */
+int numa_setup(int threads, int affinity);
+
+/* Move `size` bytes at `addr` to the node of the threads, if they all are on
+ * the same one. Otherwise pages are left to first touch.
+ */
+void numa_place(void* addr, size_t size);
+
+#endif
+
@@ -1,19 +1,28 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <omp.h>
 #include "common.h"
 #include "matrix.h"
-
+#include "matrix_file.h"
+#include "scoring.h"
+#include "stream.h"
+
+/* Only the first two diagonals are initialized here: the borders of the
+ * others are written by the kernel, so that pages are first touched by the
+ * thread computing them.
+ */
 static void __init_matrix(const algo_arg_t* args,
-			 matrix_t* move_matrix)
+			 matrix_t* move_matrix, int affine)
 {
 	move_matrix->v.c[0] = MOVE_NONE;
-	for (int x = 1; x < move_matrix->w; x++) {
-		size_t off = matrix_coord_offset(move_matrix, x, 0);
-		move_matrix->v.c[off] = MOVE_LEFT;
+	if (move_matrix->w > 1) {
+		size_t off = matrix_coord_offset(move_matrix, 1, 0);
+		move_matrix->v.c[off] = MOVE_LEFT | (affine ? MOVE_E_OPEN : 0);
 	}
-	for (int y = 1; y < move_matrix->h; y++) {
-		size_t off = matrix_coord_offset(move_matrix, 0, y);
-		move_matrix->v.c[off] = MOVE_TOP;
+	if (move_matrix->h > 1) {
+		size_t off = matrix_coord_offset(move_matrix, 0, 1);
+		move_matrix->v.c[off] = MOVE_TOP | (affine ? MOVE_F_OPEN : 0);
 	}
 }
 
@@ -42,155 +51,472 @@ static void __compute_offsets(int w, int h, int d, int i,
 	}
 }
 
-static void __process_case(const algo_arg_t* args,
-			   int** wscores,
-			   matrix_t* move_matrix,
-			   size_t d1_off, size_t d2_off, size_t d3_off,
-			   int d, int i, int x, int y)
-{
-	/* Compute offsets */
-	size_t off_cur, off_top, off_left, off_top_left;
-	off_cur  = d3_off + i;
-	__compute_offsets(move_matrix->w, move_matrix->h, d, i,
-			  d1_off, d2_off, d3_off,
-			  &off_top, &off_left, &off_top_left);
-
-	/* First line and first column is already filled */
-	if (x == 0 || y == 0) {
-		if (x == 0) {
-			wscores[2][off_cur - d3_off] = -y;
-		}
-		else if (y == 0) {
-			wscores[2][off_cur - d3_off] = -x;
-		}
-		return;
-	}
-
-	/* Values of neighbours */
-	int values[3] = {
-		wscores[1][off_top - d2_off],
-		wscores[1][off_left - d2_off],
-		wscores[0][off_top_left - d1_off]
-	};
-
-	/* Potential values from move */
-	int scores[3] = {
-		values[0] - 1,
-		values[1] - 1,
-		values[2]
-		+ ((args->seq_a[x - 1] == args->seq_b[y - 1]) ? 1 : -1)
-	};
-
-	/* What is the best score ? */
-	int bests[3] = {
-		(scores[0] >= scores[1] && scores[0] >= scores[2]) ? 1 : 0,
-		(scores[1] >= scores[0] && scores[1] >= scores[2]) ? 1 : 0,
-		(scores[2] >= scores[0] && scores[2] >= scores[1]) ? 1 : 0
-	};
-	int best = bests[0] ? 0 : bests[1] ? 1 : 2;
-
-	/* Fill the result */
-	wscores[2][off_cur - d3_off] = scores[best];
-	move_matrix->v.c[off_cur]   = bests[0] * MOVE_TOP
-				    | bests[1] * MOVE_LEFT
-				    | bests[2] * MOVE_TOP_LEFT;
-}
-
-static void __process_diagonal(const algo_arg_t* args,
-			       int** wscores,
-			       matrix_t* move_matrix,
-			       int diag)
+/* Moves are computed by chunks in a buffer, then stored in the matrix:
+ * streamed with non-temporal stores, or scattered in tiled layouts.
+ * Chunks are aligned in diagonal matrices so threads never share a cache
+ * line.
+ */
+#define MOVE_CHUNK	256
+
+static int __chunk_count(const matrix_t* move_matrix, size_t d3_off,
+			 int d3_size, int tiled, int* lead)
 {
-	/* Diagonal offsets */
-	size_t d1_off = matrix_diag_offset(move_matrix, diag - 2);
-	size_t d2_off = matrix_diag_offset(move_matrix, diag - 1);
-	size_t d3_off = matrix_diag_offset(move_matrix, diag);
+	*lead = 0;
+	if (!tiled) {
+		*lead = (-(size_t) (move_matrix->v.c + d3_off))
+		      & (MOVE_CHUNK - 1);
+	}
+	if (d3_size <= *lead) {
+		return 1;
+	}
+	return 1 + (d3_size - *lead + MOVE_CHUNK - 1) / MOVE_CHUNK;
+}
 
-	/* Current diagonal size */
-	int d3_size = matrix_diag_size(move_matrix, diag);
+/* Iterations of the parallel loop over `count` of them a thread takes at
+ * once, `unit` cases each.
+ */
+static inline int __omp_block(const algo_arg_t* args, int count, int unit) {
+	if (args->omp_chunk > 0) {
+		return max(1, args->omp_chunk / unit);
+	}
+	int threads = omp_get_max_threads();
+	return max(1, (count + threads - 1) / threads);
+}
 
-	/* Coordinates of the current diagonal first case */
-	int x = matrix_diag_x(move_matrix, diag);
-	int y = matrix_diag_y(move_matrix, diag);
+/* Diagonal matrices are written in place, unless streamed */
+static int __direct_store(const algo_arg_t* args, int tiled) {
+	return !tiled && !args->nt_store;
+}
 
-	for (int i = 0; i < d3_size; i++) {
-		int dx = x - i;
-		int dy = y + i;
-		__process_case(args, wscores, move_matrix,
-			       d1_off, d2_off, d3_off,
-			       diag, i, dx, dy);
-	}
+/* Score windows: the best scores (H) of the last three diagonals, and the
+ * gap states (E, F) of the last two ones for affine gaps.
+ */
+enum {
+	W_H_PREV2,
+	W_H_PREV,
+	W_H_CUR,
+	W_E_PREV,
+	W_E_CUR,
+	W_F_PREV,
+	W_F_CUR,
+	W_COUNT,
+};
+
+static void __rotate_windows(int** wscores) {
+	int* tmp = wscores[W_H_PREV2];
+	wscores[W_H_PREV2] = wscores[W_H_PREV];
+	wscores[W_H_PREV] = wscores[W_H_CUR];
+	wscores[W_H_CUR] = tmp;
+
+	tmp = wscores[W_E_PREV];
+	wscores[W_E_PREV] = wscores[W_E_CUR];
+	wscores[W_E_CUR] = tmp;
+
+	tmp = wscores[W_F_PREV];
+	wscores[W_F_PREV] = wscores[W_F_CUR];
+	wscores[W_F_CUR] = tmp;
+}
+
+static inline const scoring_t* __scoring(const algo_arg_t* args) {
+	return args->scoring ? args->scoring : &scoring_default;
+}
+
+/* Wait for the characters of the diagonal d of streamed sequences.
+ * Returns non zero if they are missing.
+ */
+static inline int __wait_sequences(const algo_arg_t* args, int d) {
+	return (args->stream_a
+		&& stream_wait(args->stream_a, min(d, args->len_a)))
+	    || (args->stream_b
+		&& stream_wait(args->stream_b, min(d, args->len_b)));
+}
+
+/* Kernels, one per scoring class and layout */
+
+#define KERNEL(f)		f##_unit
+#define SUBSTITUTE(sc, a, b)	(((a) == (b)) ? 1 : -1)
+#define GAP(sc)			(-1)
+#define AFFINE			0
+#define TILED			0
+#include "nw_kernel.h"
+
+#define KERNEL(f)		f##_unit_tiled
+#define SUBSTITUTE(sc, a, b)	(((a) == (b)) ? 1 : -1)
+#define GAP(sc)			(-1)
+#define AFFINE			0
+#define TILED			1
+#include "nw_kernel.h"
+
+#define KERNEL(f)		f##_linear
+#define SUBSTITUTE(sc, a, b)	(((a) == (b)) ? (sc)->match : (sc)->mismatch)
+#define GAP(sc)			((sc)->gap_extend)
+#define AFFINE			0
+#define TILED			0
+#include "nw_kernel.h"
+
+#define KERNEL(f)		f##_linear_tiled
+#define SUBSTITUTE(sc, a, b)	(((a) == (b)) ? (sc)->match : (sc)->mismatch)
+#define GAP(sc)			((sc)->gap_extend)
+#define AFFINE			0
+#define TILED			1
+#include "nw_kernel.h"
+
+#define KERNEL(f)		f##_linear_matrix
+#define SUBSTITUTE(sc, a, b)	((sc)->sub[(sc)->index[(uint8_t) (a)]] \
+					  [(sc)->index[(uint8_t) (b)]])
+#define GAP(sc)			((sc)->gap_extend)
+#define AFFINE			0
+#define TILED			0
+#include "nw_kernel.h"
+
+#define KERNEL(f)		f##_linear_matrix_tiled
+#define SUBSTITUTE(sc, a, b)	((sc)->sub[(sc)->index[(uint8_t) (a)]] \
+					  [(sc)->index[(uint8_t) (b)]])
+#define GAP(sc)			((sc)->gap_extend)
+#define AFFINE			0
+#define TILED			1
+#include "nw_kernel.h"
+
+#define KERNEL(f)		f##_affine
+#define SUBSTITUTE(sc, a, b)	(((a) == (b)) ? (sc)->match : (sc)->mismatch)
+#define GAP(sc)			((sc)->gap_extend)
+#define AFFINE			1
+#define TILED			0
+#include "nw_kernel.h"
+
+#define KERNEL(f)		f##_affine_tiled
+#define SUBSTITUTE(sc, a, b)	(((a) == (b)) ? (sc)->match : (sc)->mismatch)
+#define GAP(sc)			((sc)->gap_extend)
+#define AFFINE			1
+#define TILED			1
+#include "nw_kernel.h"
+
+#define KERNEL(f)		f##_affine_matrix
+#define SUBSTITUTE(sc, a, b)	((sc)->sub[(sc)->index[(uint8_t) (a)]] \
+					  [(sc)->index[(uint8_t) (b)]])
+#define GAP(sc)			((sc)->gap_extend)
+#define AFFINE			1
+#define TILED			0
+#include "nw_kernel.h"
+
+#define KERNEL(f)		f##_affine_matrix_tiled
+#define SUBSTITUTE(sc, a, b)	((sc)->sub[(sc)->index[(uint8_t) (a)]] \
+					  [(sc)->index[(uint8_t) (b)]])
+#define GAP(sc)			((sc)->gap_extend)
+#define AFFINE			1
+#define TILED			1
+#include "nw_kernel.h"
+
+typedef void (*process_diag_t)(const algo_arg_t*, int**, matrix_t*, int);
+
+/* Serial and parallelized kernels of each scoring class, for the diagonal
+ * layout and the tiled ones.
+ */
+#define KERNELS(f, c)	{ { f##_##c, f##_omp_##c }, \
+			  { f##_##c##_tiled, f##_omp_##c##_tiled } }
+
+static const process_diag_t __kernels[SCORING_CLASS_COUNT][2][2] = {
+	[SCORING_UNIT]		= KERNELS(__process_diagonal, unit),
+	[SCORING_LINEAR]	= KERNELS(__process_diagonal, linear),
+	[SCORING_LINEAR_MATRIX]	= KERNELS(__process_diagonal, linear_matrix),
+	[SCORING_AFFINE]	= KERNELS(__process_diagonal, affine),
+	[SCORING_AFFINE_MATRIX]	= KERNELS(__process_diagonal, affine_matrix),
+};
+
+#undef KERNELS
+
+typedef void (*process_range_t)(const algo_arg_t*, int**, matrix_t*, int, int,
+				int, int);
+
+static const process_range_t __range_kernels[SCORING_CLASS_COUNT][2] = {
+	[SCORING_UNIT]		= { __process_range_unit,
+				    __process_range_unit_tiled },
+	[SCORING_LINEAR]	= { __process_range_linear,
+				    __process_range_linear_tiled },
+	[SCORING_LINEAR_MATRIX]	= { __process_range_linear_matrix,
+				    __process_range_linear_matrix_tiled },
+	[SCORING_AFFINE]	= { __process_range_affine,
+				    __process_range_affine_tiled },
+	[SCORING_AFFINE_MATRIX]	= { __process_range_affine_matrix,
+				    __process_range_affine_matrix_tiled },
+};
+
+/* Upper bound of the score gained from a case to the end, with `ra` and `rb`
+ * characters left in each sequence: each diagonal move scores at most
+ * `step`, and the remaining characters of the longest sequence are gaps.
+ * Opening penalties are ignored, a gap may already be open.
+ */
+static inline long long __remaining_bound(int ra, int rb, int step, int ext) {
+	return (long long) min(ra, rb) * step + (long long) abs(ra - rb) * ext;
+}
 
-	/* Move score diagonales */
-	int* tmp = wscores[0];
-	wscores[0] = wscores[1];
-	wscores[1] = wscores[2];
-	wscores[2] = tmp;
+static inline void __prune_case(int** wscores, int i) {
+	wscores[W_H_CUR][i] = SCORE_NONE;
+	wscores[W_E_CUR][i] = SCORE_NONE;
+	wscores[W_F_CUR][i] = SCORE_NONE;
 }
 
-static void __process_diagonal_omp(const algo_arg_t* args,
-				   int** wscores,
-				   matrix_t* move_matrix,
-				   int diag)
+/* Pruned sweep, when only scores of at least min_score matter, or in
+ * X-drop mode.
+ *
+ * The live cases of a diagonal are kept as a range of columns. A case can
+ * be reached from live cases of the previous diagonal (top, left) or of the
+ * one before (top left), so only the range covering them is computed. Then
+ * cases whose score plus the best possible remaining gain is below
+ * min_score are pruned (set to SCORE_NONE), and the range shrinks to the
+ * remaining ones. Kernels read at most one case around the computed ranges,
+ * which are set to SCORE_NONE too. The sweep stops as soon as two
+ * consecutive diagonals have no live case.
+ *
+ * A case on an optimal path is never pruned when the score reaches
+ * min_score, so the score and the moves along optimal paths are the ones
+ * of the full sweep.
+ *
+ * In X-drop mode, cases more than `xdrop` below the best score of the
+ * previous diagonals are pruned as well, and the result is the best case
+ * met, in res->end_a and res->end_b. Moves of live cases only lead to live
+ * cases, so alignments are traced back from it as from the last case of
+ * the sequences ending there.
+ */
+static int __nw_pruned(const algo_arg_t* args, algo_res_t* res,
+		       int** wscores, matrix_t* move_matrix, int parallel)
 {
-	/* Diagonal offsets */
-	size_t d1_off = matrix_diag_offset(move_matrix, diag - 2);
-	size_t d2_off = matrix_diag_offset(move_matrix, diag - 1);
-	size_t d3_off = matrix_diag_offset(move_matrix, diag);
+	const scoring_t* sc = __scoring(args);
+	int tiled = move_matrix->layout != MATRIX_LAYOUT_DIAGONAL;
+	process_range_t process_range =
+		__range_kernels[scoring_class(sc)][tiled];
+	int step = max(scoring_best_substitution(sc), 2 * sc->gap_extend);
+	int last = args->len_a + args->len_b;
+
+	/* Live columns of the last two diagonals, empty if first > last */
+	int prev_first = 0;
+	int prev_last = min(1, args->len_a);
+	int prev2_first = 0;
+	int prev2_last = 0;
+
+	/* Best case of the X-drop mode among the previous diagonals, at least
+	 * the first one, so `best - xdrop` doesn't overflow.
+	 */
+	int best = 0;
+	int best_x = 0;
+	int best_y = 0;
+	for (int i = 0; args->xdrop && i < matrix_diag_size(move_matrix, 1);
+	     i++)
+	{
+		if (wscores[W_H_PREV][i] > best) {
+			best = wscores[W_H_PREV][i];
+			best_x = matrix_diag_x(move_matrix, 1) - i;
+			best_y = matrix_diag_y(move_matrix, 1) + i;
+		}
+	}
+
+	for (int d = 2; d <= last; d++) {
+		int abort = algo_should_abort(args);
+		if (abort) {
+			return abort;
+		}
+		if (__wait_sequences(args, d)) {
+			printf("sequence files ended early\n");
+			return ALGO_ERROR;
+		}
 
-	/* Current diagonal size */
-	int d3_size = matrix_diag_size(move_matrix, diag);
+		/* Columns reachable from the live cases */
+		int first = INT_MAX;
+		int end = INT_MIN;
+		if (prev_first <= prev_last) {
+			first = prev_first;
+			end = prev_last + 1;
+		}
+		if (prev2_first <= prev2_last) {
+			first = min(first, prev2_first + 1);
+			end = max(end, prev2_last + 1);
+		}
+		int x = matrix_diag_x(move_matrix, d);
+		int y = matrix_diag_y(move_matrix, d);
+		first = max(first, x - matrix_diag_size(move_matrix, d) + 1);
+		end = min(end, x);
+
+		/* Diagonal indexes go by decreasing columns */
+		int lo = x - end;
+		int hi = x - first;
+		if (lo <= hi) {
+			process_range(args, wscores, move_matrix, d, lo, hi,
+				      parallel);
+		}
+
+		int live_first = INT_MAX;
+		int live_last = INT_MIN;
+		int diag_best = best;
+		for (int i = lo; i <= hi; i++) {
+			int h = wscores[W_H_CUR][i];
+			if (args->xdrop && h < best - args->xdrop) {
+				__prune_case(wscores, i);
+				continue;
+			}
+			if (args->prune
+			&&  h + __remaining_bound(args->len_a - (x - i),
+						  args->len_b - (y + i), step,
+						  sc->gap_extend)
+			    < args->min_score)
+			{
+				__prune_case(wscores, i);
+				continue;
+			}
+			if (args->xdrop && h > diag_best) {
+				diag_best = h;
+				best_x = x - i;
+				best_y = y + i;
+			}
+			live_first = min(live_first, x - i);
+			live_last = max(live_last, x - i);
+		}
+		best = diag_best;
+		if (lo <= hi && lo > 0) {
+			__prune_case(wscores, lo - 1);
+		}
+		if (lo <= hi && hi + 1 < matrix_diag_size(move_matrix, d)) {
+			__prune_case(wscores, hi + 1);
+		}
+		__rotate_windows(wscores);
 
-	/* Coordinates of the current diagonal first case */
-	int x = matrix_diag_x(move_matrix, diag);
-	int y = matrix_diag_y(move_matrix, diag);
+		if (live_first > live_last && prev_first > prev_last
+		&&  args->xdrop)
+		{
+			VERBOSE_FMT("x-drop after diagonal %d of %d\n", d, last);
+			break;
+		}
+		if (live_first > live_last && prev_first > prev_last) {
+			VERBOSE_FMT("below %d after diagonal %d of %d\n",
+				    args->min_score, d, last);
+			res->below = 1;
+			return ALGO_OK;
+		}
+		prev2_first = prev_first;
+		prev2_last = prev_last;
+		prev_first = live_first;
+		prev_last = live_last;
+	}
 
-	#pragma omp parallel for
-	for (int i = 0; i < d3_size; i++) {
-		int dx = x - i;
-		int dy = y + i;
-		__process_case(args, wscores, move_matrix,
-			       d1_off, d2_off, d3_off,
-			       diag, i, dx, dy);
+	if (args->xdrop) {
+		res->score = best;
+		res->end_a = best_x;
+		res->end_b = best_y;
+		return ALGO_OK;
 	}
 
-	/* Rotate score diagonales */
-	int* tmp = wscores[0];
-	wscores[0] = wscores[1];
-	wscores[1] = wscores[2];
-	wscores[2] = tmp;
+	/* The last case may have been skipped */
+	if (last > 0 && prev_first > prev_last) {
+		res->below = 1;
+		return ALGO_OK;
+	}
+	res->score = (last == 0) ? 0 : wscores[W_H_PREV][0];
+	res->below = res->score < args->min_score;
+	return ALGO_OK;
 }
 
 static int __nw(const algo_arg_t* args, algo_res_t* res, matrix_t* move_matrix,
-		void (*process_diag)(const algo_arg_t*, int**, matrix_t*, int))
+		int parallel)
 {
+	const scoring_t* sc = __scoring(args);
+	int affine = scoring_is_affine(sc);
+	int tiled = move_matrix->layout != MATRIX_LAYOUT_DIAGONAL;
+	process_diag_t process_diag =
+		__kernels[scoring_class(sc)][tiled][parallel];
+	process_diag_t process_serial = __kernels[scoring_class(sc)][tiled][0];
 	int* score_buf = NULL;
 
 	/* Matrix initialisation */
-	__init_matrix(args, move_matrix);
+	__init_matrix(args, move_matrix, affine);
 
 	/* Initialize score windows */
 	size_t size_win = args->len_a + args->len_b + 2;
-	score_buf = malloc(3 * size_win * sizeof(int));
+	score_buf = malloc(W_COUNT * size_win * sizeof(int));
 	if (!score_buf) {
 		printf("couldn't allocates score windows buffer\n");
 		return 1;
 	}
 
-	/* Windows initialisation */
-	int* wscores[3] = {
-		score_buf,
-		score_buf + size_win,
-		score_buf + 2 * size_win
-	};
-	wscores[0][0] = 0;
-	wscores[1][0] = -1;
-	wscores[1][1] = -1;
+	/* Parallel windows are first touched with the static partition of the
+	 * kernel, so each thread mostly reads scores from its own node.
+	 */
+	if (parallel) {
+		#pragma omp parallel for schedule(static)
+		for (size_t i = 0; i < size_win; i++) {
+			for (int w = 0; w < W_COUNT; w++) {
+				score_buf[w * size_win + i] = 0;
+			}
+		}
+	}
+
+	/* Windows initialisation, with the first two diagonals */
+	int* wscores[W_COUNT];
+	for (int w = 0; w < W_COUNT; w++) {
+		wscores[w] = score_buf + w * size_win;
+	}
+	wscores[W_H_PREV2][0] = 0;
+	for (int i = 0; i < matrix_diag_size(move_matrix, 1); i++) {
+		int x = matrix_diag_x(move_matrix, 1) - i;
+		wscores[W_H_PREV][i] = scoring_gap(sc, 1);
+		wscores[W_E_PREV][i] = x ? scoring_gap(sc, 1) : SCORE_NONE;
+		wscores[W_F_PREV][i] = x ? SCORE_NONE : scoring_gap(sc, 1);
+	}
+
+	/* Bounds need penalties for gaps, X-drop doesn't */
+	if (args->xdrop
+	||  (args->prune && sc->gap_open <= 0 && sc->gap_extend <= 0))
+	{
+		int ret = __nw_pruned(args, res, wscores, move_matrix,
+				      parallel);
+		free(score_buf);
+		return ret;
+	}
+
+	/* Durable matrices restart after their last checkpoint */
+	int start = 2;
+	if (move_matrix->file) {
+		int* windows[MATRIX_FILE_WINDOWS] = {
+			wscores[W_H_PREV2], wscores[W_H_PREV],
+			wscores[W_E_PREV], wscores[W_F_PREV]
+		};
+		int diag = matrix_file_resume(move_matrix, windows);
+		if (diag >= 0) {
+			VERBOSE_FMT("resuming after diagonal %d\n", diag);
+			start = diag + 1;
+		}
+	}
 
 	size_t total_size = (args->len_a + 1) * (size_t) (args->len_b + 1);
-	size_t current = 3;
-	for (int d = 2; d < args->len_a + args->len_b + 1; d++) {
-		process_diag(args, wscores, move_matrix, d);
+	size_t current = (start > 2) ? matrix_diag_offset(move_matrix, start)
+				     : 3;
+	for (int d = start; d < args->len_a + args->len_b + 1; d++) {
+		int abort = algo_should_abort(args);
+		if (abort) {
+			free(score_buf);
+			return abort;
+		}
+		if (__wait_sequences(args, d)) {
+			printf("sequence files ended early\n");
+			free(score_buf);
+			return ALGO_ERROR;
+		}
+
+		if (matrix_diag_size(move_matrix, d) < args->par_cutoff) {
+			process_serial(args, wscores, move_matrix, d);
+		}
+		else {
+			process_diag(args, wscores, move_matrix, d);
+		}
+
+		if (move_matrix->file && d % 64 == 0) {
+			int* windows[MATRIX_FILE_WINDOWS] = {
+				wscores[W_H_PREV2], wscores[W_H_PREV],
+				wscores[W_E_PREV], wscores[W_F_PREV]
+			};
+			if (matrix_file_tick(move_matrix, d, windows)) {
+				free(score_buf);
+				return ALGO_ERROR;
+			}
+		}
 
 		current += matrix_diag_size(move_matrix, d);
 		if (d % 10 == 0) {
@@ -200,22 +526,47 @@ static int __nw(const algo_arg_t* args, algo_res_t* res, matrix_t* move_matrix,
 	}
 	VERBOSE("\n");
 
+	/* Last diagonal has only one case, the alignment score */
+	res->score = (args->len_a + args->len_b == 0) ? 0
+							: wscores[W_H_PREV][0];
+
 	free(score_buf);
 
+	if (move_matrix->file && matrix_file_complete(move_matrix, res->score)) {
+		return ALGO_ERROR;
+	}
+
 	return 0;
 
 }
 
+int algo_should_abort(const algo_arg_t* args) {
+	if (args->cancel && *args->cancel) {
+		return ALGO_CANCELLED;
+	}
+	if (args->deadline.tv_sec || args->deadline.tv_nsec) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > args->deadline.tv_sec
+		||  (now.tv_sec == args->deadline.tv_sec
+		     && now.tv_nsec >= args->deadline.tv_nsec))
+		{
+			return ALGO_TIMEOUT;
+		}
+	}
+	return ALGO_OK;
+}
+
 int nw(const algo_arg_t* args, algo_res_t* res,
        matrix_t* move_matrix)
 {
-	return __nw(args, res, move_matrix, &__process_diagonal);
+	return __nw(args, res, move_matrix, 0);
 }
 
 int nw_omp(const algo_arg_t* args, algo_res_t* res,
        matrix_t* move_matrix)
 {
-	return __nw(args, res, move_matrix, &__process_diagonal_omp);
+	return __nw(args, res, move_matrix, 1);
 }
 
  void print_move_matrix(const algo_arg_t* args,
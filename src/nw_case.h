@@ -0,0 +1,68 @@
+#ifndef _nw_case_h_
+#define _nw_case_h_
+
+#include "common.h"
+#include "scoring.h"
+
+/* Scalar case of the recurrences, for the algorithms computing the matrix
+ * by rows or columns instead of diagonals. Scores and moves are the ones
+ * of the nw kernels (see nw_kernel.h): E and F are only kept with affine
+ * gaps, whose moves also tell how the gap states were reached.
+ *
+ * `diag`, `left_*` and `top_*` are the scores of the neighbour cases,
+ * ignored on the first line and column.
+ */
+static inline char nw_case(const scoring_t* sc, int affine,
+			   const char* seq_a, const char* seq_b, int x, int y,
+			   int diag, int left_h, int left_e,
+			   int top_h, int top_f,
+			   int* h, int* e, int* f)
+{
+	/* First line and first column */
+	if (x == 0) {
+		*h = scoring_gap(sc, y);
+		*e = SCORE_NONE;
+		*f = *h;
+		return MOVE_TOP | (!affine ? 0 :
+			(y == 1) ? MOVE_F_OPEN : MOVE_F_EXT);
+	}
+	else if (y == 0) {
+		*h = scoring_gap(sc, x);
+		*e = *h;
+		*f = SCORE_NONE;
+		return MOVE_LEFT | (!affine ? 0 :
+			(x == 1) ? MOVE_E_OPEN : MOVE_E_EXT);
+	}
+
+	diag += scoring_substitute(sc, seq_a[x - 1], seq_b[y - 1]);
+
+	if (affine) {
+		int open = sc->gap_open + sc->gap_extend;
+		int e_open = left_h + open;
+		int e_ext = left_e + sc->gap_extend;
+		int f_open = top_h + open;
+		int f_ext = top_f + sc->gap_extend;
+		*e = max(e_open, e_ext);
+		*f = max(f_open, f_ext);
+		*h = max(diag, max(*e, *f));
+		return (*f == *h) * MOVE_TOP
+		     | (*e == *h) * MOVE_LEFT
+		     | (diag == *h) * MOVE_TOP_LEFT
+		     | (*e == e_open) * MOVE_E_OPEN
+		     | (*e == e_ext) * MOVE_E_EXT
+		     | (*f == f_open) * MOVE_F_OPEN
+		     | (*f == f_ext) * MOVE_F_EXT;
+	}
+
+	int top = top_h + sc->gap_extend;
+	int left = left_h + sc->gap_extend;
+	*h = max(diag, max(top, left));
+	*e = SCORE_NONE;
+	*f = SCORE_NONE;
+	return (top == *h) * MOVE_TOP
+	     | (left == *h) * MOVE_LEFT
+	     | (diag == *h) * MOVE_TOP_LEFT;
+}
+
+#endif
+
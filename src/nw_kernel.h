@@ -0,0 +1,282 @@
+/* Needleman-Wunsch kernel template, included by nw.c once per scoring class
+ * and matrix layout.
+ *
+ * No include guard: the including file defines
+ *	KERNEL(f)		suffixes the names of the generated functions
+ *	SUBSTITUTE(sc, a, b)	score of aligning characters a and b
+ *	GAP(sc)			score of a gap character (linear gaps)
+ *	AFFINE			1 to compute the E and F gap states (Gotoh)
+ *	TILED			1 for the tiled and zorder layouts, 0 for the
+ *				diagonal one
+ * and gets __process_case, __process_chunk, __process_diagonal,
+ * __process_diagonal_omp and __process_range specialized for them. Macros
+ * are undefined at the end of this file.
+ */
+
+/* Computes the score of a case and returns its move */
+static inline char KERNEL(__process_case)(const algo_arg_t* args,
+					  const scoring_t* sc,
+					  int** wscores,
+					  const matrix_t* move_matrix,
+					  size_t d1_off, size_t d2_off,
+					  size_t d3_off,
+					  int d, int i, int x, int y)
+{
+	/* First line and first column */
+	if (x == 0) {
+		wscores[W_H_CUR][i] = scoring_gap(sc, y);
+#if AFFINE
+		wscores[W_E_CUR][i] = SCORE_NONE;
+		wscores[W_F_CUR][i] = wscores[W_H_CUR][i];
+		return MOVE_TOP | ((y == 1) ? MOVE_F_OPEN : MOVE_F_EXT);
+#else
+		return MOVE_TOP;
+#endif
+	}
+	else if (y == 0) {
+		wscores[W_H_CUR][i] = scoring_gap(sc, x);
+#if AFFINE
+		wscores[W_E_CUR][i] = wscores[W_H_CUR][i];
+		wscores[W_F_CUR][i] = SCORE_NONE;
+		return MOVE_LEFT | ((x == 1) ? MOVE_E_OPEN : MOVE_E_EXT);
+#else
+		return MOVE_LEFT;
+#endif
+	}
+
+	/* Compute offsets */
+	size_t off_top, off_left, off_top_left;
+	__compute_offsets(move_matrix->w, move_matrix->h, d, i,
+			  d1_off, d2_off, d3_off,
+			  &off_top, &off_left, &off_top_left);
+	off_top -= d2_off;
+	off_left -= d2_off;
+	off_top_left -= d1_off;
+
+	int diag = wscores[W_H_PREV2][off_top_left]
+		 + SUBSTITUTE(sc, args->seq_a[x - 1], args->seq_b[y - 1]);
+
+#if AFFINE
+	/* Gaps are either opened from the best score or extended */
+	int open = sc->gap_open + sc->gap_extend;
+	int e_open = wscores[W_H_PREV][off_left] + open;
+	int e_ext = wscores[W_E_PREV][off_left] + sc->gap_extend;
+	int f_open = wscores[W_H_PREV][off_top] + open;
+	int f_ext = wscores[W_F_PREV][off_top] + sc->gap_extend;
+	int e = max(e_open, e_ext);
+	int f = max(f_open, f_ext);
+	int best = max(diag, max(e, f));
+
+	wscores[W_H_CUR][i] = best;
+	wscores[W_E_CUR][i] = e;
+	wscores[W_F_CUR][i] = f;
+	return (f == best) * MOVE_TOP
+	     | (e == best) * MOVE_LEFT
+	     | (diag == best) * MOVE_TOP_LEFT
+	     | (e == e_open) * MOVE_E_OPEN
+	     | (e == e_ext) * MOVE_E_EXT
+	     | (f == f_open) * MOVE_F_OPEN
+	     | (f == f_ext) * MOVE_F_EXT;
+#else
+	/* Potential values from move */
+	int scores[3] = {
+		wscores[W_H_PREV][off_top] + GAP(sc),
+		wscores[W_H_PREV][off_left] + GAP(sc),
+		diag
+	};
+
+	/* What is the best score ? */
+	int bests[3] = {
+		(scores[0] >= scores[1] && scores[0] >= scores[2]) ? 1 : 0,
+		(scores[1] >= scores[0] && scores[1] >= scores[2]) ? 1 : 0,
+		(scores[2] >= scores[0] && scores[2] >= scores[1]) ? 1 : 0
+	};
+	int best = bests[0] ? 0 : bests[1] ? 1 : 2;
+
+	/* Fill the result */
+	wscores[W_H_CUR][i] = scores[best];
+	return bests[0] * MOVE_TOP
+	     | bests[1] * MOVE_LEFT
+	     | bests[2] * MOVE_TOP_LEFT;
+#endif
+}
+
+/* Store moves computed in a buffer, streamed if `nt` in the diagonal
+ * layout
+ */
+static inline void KERNEL(__store)(matrix_t* move_matrix, int diag, int i,
+				   const char* moves, int n, int nt)
+{
+#if TILED
+	matrix_store_tiled(move_matrix, diag, i, moves, n);
+#else
+	matrix_store_diagonal(move_matrix, diag, i, moves, n, nt);
+#endif
+}
+
+static void KERNEL(__process_chunk)(const algo_arg_t* args,
+				    const scoring_t* sc,
+				    int** wscores,
+				    matrix_t* move_matrix,
+				    size_t d1_off, size_t d2_off, size_t d3_off,
+				    int diag, int x, int y,
+				    int d3_size, int lead, int chunk)
+{
+	char moves[MOVE_CHUNK];
+	int start = (chunk == 0) ? 0 : lead + (chunk - 1) * MOVE_CHUNK;
+	int end = min(d3_size, lead + chunk * MOVE_CHUNK);
+
+	for (int i = start; i < end; i++) {
+		moves[i - start] = KERNEL(__process_case)(args, sc, wscores,
+							  move_matrix,
+							  d1_off, d2_off,
+							  d3_off, diag, i,
+							  x - i, y + i);
+	}
+	if (end > start) {
+		KERNEL(__store)(move_matrix, diag, start, moves, end - start,
+				args->nt_store);
+	}
+}
+
+static void KERNEL(__process_diagonal)(const algo_arg_t* args,
+				       int** wscores,
+				       matrix_t* move_matrix,
+				       int diag)
+{
+	const scoring_t* sc = __scoring(args);
+
+	/* Diagonal offsets */
+	size_t d1_off = matrix_diag_offset(move_matrix, diag - 2);
+	size_t d2_off = matrix_diag_offset(move_matrix, diag - 1);
+	size_t d3_off = matrix_diag_offset(move_matrix, diag);
+
+	/* Current diagonal size */
+	int d3_size = matrix_diag_size(move_matrix, diag);
+
+	/* Coordinates of the current diagonal first case */
+	int x = matrix_diag_x(move_matrix, diag);
+	int y = matrix_diag_y(move_matrix, diag);
+
+	if (!__direct_store(args, TILED)) {
+		int lead;
+		int chunks = __chunk_count(move_matrix, d3_off, d3_size,
+					   TILED, &lead);
+		for (int c = 0; c < chunks; c++) {
+			KERNEL(__process_chunk)(args, sc, wscores, move_matrix,
+						d1_off, d2_off, d3_off,
+						diag, x, y, d3_size, lead, c);
+		}
+		if (args->nt_store) {
+			matrix_stream_fence();
+		}
+	}
+	else {
+		for (int i = 0; i < d3_size; i++) {
+			int dx = x - i;
+			int dy = y + i;
+			move_matrix->v.c[d3_off + i] =
+				KERNEL(__process_case)(args, sc, wscores,
+						       move_matrix,
+						       d1_off, d2_off, d3_off,
+						       diag, i, dx, dy);
+		}
+	}
+
+	__rotate_windows(wscores);
+}
+
+static void KERNEL(__process_diagonal_omp)(const algo_arg_t* args,
+					   int** wscores,
+					   matrix_t* move_matrix,
+					   int diag)
+{
+	const scoring_t* sc = __scoring(args);
+
+	/* Diagonal offsets */
+	size_t d1_off = matrix_diag_offset(move_matrix, diag - 2);
+	size_t d2_off = matrix_diag_offset(move_matrix, diag - 1);
+	size_t d3_off = matrix_diag_offset(move_matrix, diag);
+
+	/* Current diagonal size */
+	int d3_size = matrix_diag_size(move_matrix, diag);
+
+	/* Coordinates of the current diagonal first case */
+	int x = matrix_diag_x(move_matrix, diag);
+	int y = matrix_diag_y(move_matrix, diag);
+
+	if (!__direct_store(args, TILED)) {
+		int lead;
+		int chunks = __chunk_count(move_matrix, d3_off, d3_size,
+					   TILED, &lead);
+		int block = __omp_block(args, chunks, MOVE_CHUNK);
+		#pragma omp parallel
+		{
+			#pragma omp for schedule(static, block)
+			for (int c = 0; c < chunks; c++) {
+				KERNEL(__process_chunk)(args, sc, wscores,
+							move_matrix,
+							d1_off, d2_off, d3_off,
+							diag, x, y, d3_size,
+							lead, c);
+			}
+			/* Each thread drains its own write combining buffers */
+			if (args->nt_store) {
+				matrix_stream_fence();
+			}
+		}
+	}
+	else {
+		int block = __omp_block(args, d3_size, 1);
+		#pragma omp parallel for schedule(static, block)
+		for (int i = 0; i < d3_size; i++) {
+			int dx = x - i;
+			int dy = y + i;
+			move_matrix->v.c[d3_off + i] =
+				KERNEL(__process_case)(args, sc, wscores,
+						       move_matrix,
+						       d1_off, d2_off, d3_off,
+						       diag, i, dx, dy);
+		}
+	}
+
+	__rotate_windows(wscores);
+}
+
+/* Computes the cases [lo, hi] of a diagonal only, the others being pruned */
+static void KERNEL(__process_range)(const algo_arg_t* args,
+				    int** wscores,
+				    matrix_t* move_matrix,
+				    int diag, int lo, int hi, int parallel)
+{
+	const scoring_t* sc = __scoring(args);
+
+	size_t d1_off = matrix_diag_offset(move_matrix, diag - 2);
+	size_t d2_off = matrix_diag_offset(move_matrix, diag - 1);
+	size_t d3_off = matrix_diag_offset(move_matrix, diag);
+	int x = matrix_diag_x(move_matrix, diag);
+	int y = matrix_diag_y(move_matrix, diag);
+	int chunks = (hi - lo + MOVE_CHUNK) / MOVE_CHUNK;
+
+	#pragma omp parallel for schedule(static) if (parallel)
+	for (int c = 0; c < chunks; c++) {
+		char moves[MOVE_CHUNK];
+		int start = lo + c * MOVE_CHUNK;
+		int end = min(hi + 1, start + MOVE_CHUNK);
+		for (int i = start; i < end; i++) {
+			moves[i - start] = KERNEL(__process_case)(args, sc, wscores,
+								  move_matrix,
+								  d1_off, d2_off,
+								  d3_off, diag, i,
+								  x - i, y + i);
+		}
+		KERNEL(__store)(move_matrix, diag, start, moves, end - start,
+				0);
+	}
+}
+
+#undef KERNEL
+#undef SUBSTITUTE
+#undef GAP
+#undef AFFINE
+#undef TILED
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nwb.h"
+
+int nwb_open(nwb_t* f, const char* path) {
+	struct stat st;
+
+	memset(f, 0, sizeof(*f));
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		printf("couldn't open %s\n", path);
+		return 1;
+	}
+	if (fstat(fd, &st)
+	||  st.st_size < sizeof(nwb_header_t) + sizeof(nwb_footer_t))
+	{
+		printf("%s isn't an alignment file\n", path);
+		close(fd);
+		return 1;
+	}
+	f->size = st.st_size;
+	f->map = mmap(NULL, f->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (f->map == MAP_FAILED) {
+		printf("couldn't map %s\n", path);
+		f->map = NULL;
+		return 1;
+	}
+
+	const nwb_header_t* h = (const nwb_header_t*) f->map;
+	const nwb_footer_t* foot = (const nwb_footer_t*)
+				   (f->map + f->size - sizeof(nwb_footer_t));
+	if (memcmp(h->magic, NWB_MAGIC, sizeof(NWB_MAGIC))
+	||  h->version != NWB_VERSION)
+	{
+		printf("%s isn't an alignment file\n", path);
+		goto error;
+	}
+	if (memcmp(foot->magic, NWB_MAGIC, sizeof(NWB_MAGIC))) {
+		printf("%s is incomplete\n", path);
+		goto error;
+	}
+
+	/* The index must fit between the records and the footer, and its
+	 * offsets be in order within the records.
+	 */
+	size_t end = f->size - sizeof(nwb_footer_t);
+	if (foot->index_offset % sizeof(uint64_t)
+	||  foot->index_offset < sizeof(nwb_header_t)
+	||  foot->index_offset > end
+	||  foot->count >= (end - foot->index_offset) / sizeof(uint64_t))
+	{
+		printf("%s has a corrupt index\n", path);
+		goto error;
+	}
+	const uint64_t* index = (const uint64_t*) (f->map
+						   + foot->index_offset);
+	if (index[0] != sizeof(nwb_header_t)
+	||  index[foot->count] > foot->index_offset)
+	{
+		printf("%s has a corrupt index\n", path);
+		goto error;
+	}
+	for (uint64_t i = 0; i < foot->count; i++) {
+		if (index[i] > index[i + 1]) {
+			printf("%s has a corrupt index\n", path);
+			goto error;
+		}
+	}
+
+	f->header = h;
+	f->index = index;
+	f->count = foot->count;
+	return 0;
+
+    error:
+	munmap((void*) f->map, f->size);
+	f->map = NULL;
+	return 1;
+}
+
+void nwb_close(nwb_t* f) {
+	if (f->map) {
+		munmap((void*) f->map, f->size);
+	}
+	memset(f, 0, sizeof(*f));
+}
+
+const uint8_t* nwb_ops(const nwb_t* f, uint64_t i, size_t* size) {
+	if (i >= f->count) {
+		*size = 0;
+		return NULL;
+	}
+	*size = f->index[i + 1] - f->index[i];
+	return f->map + f->index[i];
+}
+
+int nwb_next_run(const uint8_t** ops, const uint8_t* end, int* op,
+		 uint64_t* run)
+{
+	const uint8_t* p = *ops;
+	uint64_t v = 0;
+	int shift = 0;
+
+	do {
+		if (p >= end || shift > 63) {
+			return 0;
+		}
+		v |= (uint64_t) (*p & 0x7f) << shift;
+		shift += 7;
+	} while (*p++ & 0x80);
+
+	*op = v & 3;
+	*run = v >> 2;
+	*ops = p;
+	return 1;
+}
+
+
+#ifdef TEST
+
+#include <stdlib.h>
+
+#include "alignment.h"
+#include "hash.h"
+
+/* Alignments of ACGTTA with AGTTCA */
+static char* __ups[] = { "ACGTT-A", "ACGTTA-", "ACGTTA" };
+static char* __downs[] = { "A-GTTCA", "A-GTTCA", "AGTTCA" };
+
+/* Write the alignments, read them back from the index */
+int test_round_trip(const char* path) {
+	algo_arg_t args;
+	memset(&args, 0, sizeof(args));
+	args.seq_a = "ACGTTA";
+	args.seq_b = "AGTTCA";
+	args.len_a = 6;
+	args.len_b = 6;
+
+	nwb_writer_t w;
+	if (nwb_writer_open(&w, path, &args, 3)) {
+		return 1;
+	}
+	for (int i = 0; i < 3; i++) {
+		alignment_t al = { __ups[i], __downs[i], strlen(__ups[i]) + 1 };
+		nwb_writer_add(&w, &al);
+	}
+	if (nwb_writer_close(&w)) {
+		printf("couldn't write %s\n", path);
+		return 1;
+	}
+
+	nwb_t f;
+	if (nwb_open(&f, path)) {
+		return 1;
+	}
+	int ret = 0;
+	if (f.count != 3 || f.header->score != 3
+	||  f.header->len_a != 6 || f.header->len_b != 6
+	||  f.header->hash_a != hash64(args.seq_a, 6, 0)
+	||  f.header->hash_b != hash64(args.seq_b, 6, 0))
+	{
+		printf("wrong header read from %s\n", path);
+		ret = 1;
+	}
+	for (uint64_t i = 0; i < f.count && !ret; i++) {
+		size_t size;
+		const uint8_t* ops = nwb_ops(&f, i, &size);
+		alignment_t al;
+		if (alignment_decode(&args, ops, size, 0, &al)) {
+			printf("couldn't decode alignment %lu\n",
+			       (unsigned long) i);
+			ret = 1;
+			break;
+		}
+		if (strcmp(al.up, __ups[i]) || strcmp(al.down, __downs[i])) {
+			printf("wrong alignment %lu: %s %s\n",
+			       (unsigned long) i, al.up, al.down);
+			ret = 1;
+		}
+		alignment_wipe(&al);
+	}
+	nwb_close(&f);
+
+	if (!ret) {
+		printf("binary alignments round trip is OK\n");
+	}
+	return ret;
+}
+
+/* Files cut in the footer, the index, the records or the header are
+ * rejected
+ */
+int test_truncated(const char* path) {
+	struct stat st;
+	if (stat(path, &st)) {
+		return 1;
+	}
+
+	off_t sizes[] = {
+		st.st_size - 1,
+		st.st_size - sizeof(nwb_footer_t),
+		st.st_size - sizeof(nwb_footer_t) - sizeof(uint64_t),
+		sizeof(nwb_header_t) + 2,
+		sizeof(nwb_header_t) - 1,
+		0,
+	};
+	for (int i = 0; i < countof(sizes); i++) {
+		off_t size = sizes[i];
+		nwb_t f;
+		if (truncate(path, size)) {
+			printf("couldn't truncate %s\n", path);
+			return 1;
+		}
+		if (!nwb_open(&f, path)) {
+			printf("%s opened truncated to %ld bytes\n", path,
+			       (long) size);
+			nwb_close(&f);
+			return 1;
+		}
+	}
+
+	printf("truncated binary alignments are rejected\n");
+	return 0;
+}
+
+int main(void) {
+	char path[] = "/tmp/nwb.test.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		printf("couldn't create a temporary file\n");
+		return 1;
+	}
+	close(fd);
+
+	int ret = test_round_trip(path) || test_truncated(path);
+	unlink(path);
+	return ret;
+}
+
+#endif
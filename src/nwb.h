@@ -0,0 +1,121 @@
+#ifndef _nwb_h_
+#define _nwb_h_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Binary alignment output (`--pair-format binary`).
+ *
+ * Layout, in host byte order:
+ *
+ *	header		nwb_header_t: sequences, scoring and score
+ *	records		the operations of each co-optimal alignment, as
+ *			encoded by `alignment_encode` (runs of
+ *			`(length << 2) | op` varints), back to back
+ *	padding		up to a multiple of 8 bytes
+ *	index		count + 1 u64 offsets: record i is the bytes
+ *			[index[i], index[i + 1])
+ *	footer		nwb_footer_t
+ *
+ * Records are written as traceback produces them, and the index once they
+ * are all known: the writer never seeks back, so the output may be a
+ * pipe. Readers map the file and find the index from the footer, record i
+ * being then one lookup away.
+ *
+ * The reader (nwb.c) only depends on the C library, and is also built as
+ * libnwb.a for other tools.
+ */
+
+#define NWB_MAGIC	"NWALIGN"
+#define NWB_VERSION	1
+
+/* Header flags */
+enum {
+	NWB_SUBSTITUTION_MATRIX	= 1,	/* match and mismatch are unused */
+};
+
+/* Operations of the records, as AL_OP_* of alignment.h */
+enum {
+	NWB_OP_MATCH	= 0,	/* a character of both sequences */
+	NWB_OP_INS	= 1,	/* a character of seq_b only */
+	NWB_OP_DEL	= 2,	/* a character of seq_a only */
+};
+
+typedef struct nwb_header {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	flags;
+	uint64_t	hash_a;		/* hash64(seq, len, 0) of hash.h */
+	uint64_t	hash_b;
+	uint32_t	len_a;
+	uint32_t	len_b;
+	int32_t		score;
+	int32_t		match;
+	int32_t		mismatch;
+	int32_t		gap_open;
+	int32_t		gap_extend;
+	uint32_t	reserved;
+	uint64_t	scoring;	/* scoring_hash() of scoring.h */
+} nwb_header_t;
+
+typedef struct nwb_footer {
+	uint64_t	index_offset;
+	uint64_t	count;
+	char		magic[8];	/* a complete file ends with it */
+} nwb_footer_t;
+
+/* Reader */
+typedef struct nwb {
+	const uint8_t*		map;
+	size_t			size;
+	const nwb_header_t*	header;
+	const uint64_t*		index;
+	uint64_t		count;
+} nwb_t;
+
+/* Map the file at `path`, checking its header, footer and index */
+int nwb_open(nwb_t* f, const char* path);
+
+void nwb_close(nwb_t* f);
+
+/* Operations of alignment `i`, in the map, and their size */
+const uint8_t* nwb_ops(const nwb_t* f, uint64_t i, size_t* size);
+
+/* Read the run at *ops, before `end`, moving *ops past it.
+ * Returns 0 at the end of the operations or if they are corrupt.
+ */
+int nwb_next_run(const uint8_t** ops, const uint8_t* end, int* op,
+		 uint64_t* run);
+
+/* Writer */
+struct algo_arg;
+struct alignment;
+
+typedef struct nwb_writer {
+	FILE*		out;
+	int		close;		/* out was opened by nwb_writer_open */
+	int		error;
+	uint64_t	offset;		/* bytes written */
+	uint64_t*	index;
+	uint64_t	count;
+	uint64_t	capacity;
+	uint8_t*	ops;		/* encoding buffer */
+	size_t		ops_size;
+} nwb_writer_t;
+
+/* Write the header of the alignments of `args` sequences, to the file of
+ * `path`, truncated, or to stdout if NULL.
+ */
+int nwb_writer_open(nwb_writer_t* w, const char* path,
+		    const struct algo_arg* args, int score);
+
+int nwb_writer_add(nwb_writer_t* w, const struct alignment* al);
+
+/* Writes the index and the footer, and returns non zero if any write
+ * failed.
+ */
+int nwb_writer_close(nwb_writer_t* w);
+
+#endif
+
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "alignment.h"
+#include "hash.h"
+#include "scoring.h"
+#include "nwb.h"
+
+static void __write(nwb_writer_t* w, const void* data, size_t size) {
+	if (!w->error && size && fwrite(data, size, 1, w->out) != 1) {
+		w->error = 1;
+	}
+	w->offset += size;
+}
+
+/* Record the start of the next record, or the end of the last one */
+static int __index(nwb_writer_t* w) {
+	if (w->count + 1 >= w->capacity) {
+		uint64_t capacity = max(2 * w->capacity, 64);
+		uint64_t* index = realloc(w->index,
+					  capacity * sizeof(uint64_t));
+		if (!index) {
+			printf("couldn't allocate alignment index\n");
+			return 1;
+		}
+		w->index = index;
+		w->capacity = capacity;
+	}
+	w->index[w->count] = w->offset;
+	return 0;
+}
+
+int nwb_writer_open(nwb_writer_t* w, const char* path,
+		    const algo_arg_t* args, int score)
+{
+	const scoring_t* sc = args->scoring ? args->scoring : &scoring_default;
+	nwb_header_t h;
+
+	memset(w, 0, sizeof(*w));
+	if (path) {
+		w->out = fopen(path, "w");
+		if (!w->out) {
+			printf("couldn't open output file %s\n", path);
+			return 1;
+		}
+		w->close = 1;
+	}
+	else {
+		w->out = stdout;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, NWB_MAGIC, sizeof(NWB_MAGIC));
+	h.version = NWB_VERSION;
+	h.flags = sc->has_matrix ? NWB_SUBSTITUTION_MATRIX : 0;
+	h.hash_a = hash64(args->seq_a, args->len_a, 0);
+	h.hash_b = hash64(args->seq_b, args->len_b, 0);
+	h.len_a = args->len_a;
+	h.len_b = args->len_b;
+	h.score = score;
+	h.match = sc->match;
+	h.mismatch = sc->mismatch;
+	h.gap_open = sc->gap_open;
+	h.gap_extend = sc->gap_extend;
+	h.scoring = scoring_hash(sc);
+	__write(w, &h, sizeof(h));
+	return 0;
+}
+
+int nwb_writer_add(nwb_writer_t* w, const alignment_t* al) {
+	if (__index(w)) {
+		w->error = 1;
+		return 1;
+	}
+
+	size_t size = alignment_encode(al, w->ops, w->ops_size);
+	if (size > w->ops_size) {
+		uint8_t* ops = realloc(w->ops, size);
+		if (!ops) {
+			printf("couldn't allocate alignment operations\n");
+			w->error = 1;
+			return 1;
+		}
+		w->ops = ops;
+		w->ops_size = size;
+		alignment_encode(al, w->ops, w->ops_size);
+	}
+	__write(w, w->ops, size);
+	w->count++;
+	return w->error;
+}
+
+int nwb_writer_close(nwb_writer_t* w) {
+	static const uint8_t padding[sizeof(uint64_t)];
+	nwb_footer_t foot;
+
+	if (!w->error && __index(w)) {
+		w->error = 1;
+	}
+	if (!w->error) {
+		__write(w, padding, -w->offset % sizeof(uint64_t));
+		memset(&foot, 0, sizeof(foot));
+		foot.index_offset = w->offset;
+		foot.count = w->count;
+		memcpy(foot.magic, NWB_MAGIC, sizeof(NWB_MAGIC));
+		__write(w, w->index, (w->count + 1) * sizeof(uint64_t));
+		__write(w, &foot, sizeof(foot));
+	}
+
+	if (fflush(w->out)) {
+		w->error = 1;
+	}
+	if (w->close && fclose(w->out)) {
+		w->error = 1;
+	}
+	free(w->index);
+	free(w->ops);
+	return w->error;
+}
+
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "output.h"
+
+/* writev the whole vector, resuming after partial writes */
+static int __writev_all(int fd, struct iovec* iov, int n) {
+	while (n > 0) {
+		ssize_t w = writev(fd, iov, n);
+		if (w < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 1;
+		}
+		while (n > 0 && (size_t) w >= iov->iov_len) {
+			w -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n > 0) {
+			iov->iov_base = (char*) iov->iov_base + w;
+			iov->iov_len -= w;
+		}
+	}
+	return 0;
+}
+
+static void __batch_write(output_t* out, output_batch_t* b) {
+	if (!out->error && __writev_all(out->fd, b->iov, b->niov)) {
+		out->error = 1;
+	}
+	b->used = 0;
+	b->niov = 0;
+}
+
+static void* __writer(void* arg) {
+	output_t* out = arg;
+
+	pthread_mutex_lock(&out->lock);
+	for (;;) {
+		while (!out->pending && !out->stop) {
+			pthread_cond_wait(&out->cond, &out->lock);
+		}
+		if (!out->pending) {
+			break;
+		}
+		output_batch_t* b = out->pending;
+		pthread_mutex_unlock(&out->lock);
+
+		__batch_write(out, b);
+
+		pthread_mutex_lock(&out->lock);
+		out->pending = NULL;
+		pthread_cond_broadcast(&out->cond);
+	}
+	pthread_mutex_unlock(&out->lock);
+	return NULL;
+}
+
+/* Wait for the writer to be done with the submitted batch */
+static void __wait_writer(output_t* out) {
+	pthread_mutex_lock(&out->lock);
+	while (out->pending) {
+		pthread_cond_wait(&out->cond, &out->lock);
+	}
+	pthread_mutex_unlock(&out->lock);
+}
+
+/* Write the current batch, or hand it to the writer and go on with the
+ * other one.
+ */
+static void __submit(output_t* out) {
+	output_batch_t* b = out->cur;
+	if (b->niov == 0) {
+		return;
+	}
+	if (!out->async) {
+		__batch_write(out, b);
+		return;
+	}
+
+	__wait_writer(out);
+	pthread_mutex_lock(&out->lock);
+	out->pending = b;
+	pthread_cond_broadcast(&out->cond);
+	pthread_mutex_unlock(&out->lock);
+	out->cur = (b == out->batches) ? out->batches + 1 : out->batches;
+}
+
+int output_open(output_t* out, const char* path, int async) {
+	memset(out, 0, sizeof(*out));
+	out->cur = out->batches;
+
+	for (int i = 0; i < 2; i++) {
+		if (posix_memalign((void**) &out->batches[i].buf, 4096,
+				   OUTPUT_BUFFER))
+		{
+			printf("couldn't allocate output buffers\n");
+			free(out->batches[0].buf);
+			return 1;
+		}
+	}
+
+	if (path) {
+		out->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (out->fd < 0) {
+			printf("couldn't open output file %s\n", path);
+			goto error;
+		}
+		out->close = 1;
+	}
+	else {
+		/* Keep the order with what stdio already buffered */
+		fflush(stdout);
+		out->fd = STDOUT_FILENO;
+	}
+
+	if (async) {
+		pthread_mutex_init(&out->lock, NULL);
+		pthread_cond_init(&out->cond, NULL);
+		if (pthread_create(&out->thread, NULL, __writer, out)) {
+			printf("couldn't start output thread\n");
+			pthread_mutex_destroy(&out->lock);
+			pthread_cond_destroy(&out->cond);
+			goto error;
+		}
+		out->async = 1;
+	}
+	return 0;
+
+    error:
+	if (out->close) {
+		close(out->fd);
+	}
+	free(out->batches[0].buf);
+	free(out->batches[1].buf);
+	return 1;
+}
+
+int output_flush(output_t* out) {
+	__submit(out);
+	if (out->async) {
+		__wait_writer(out);
+	}
+	return out->error;
+}
+
+int output_close(output_t* out) {
+	int ret = output_flush(out);
+
+	if (out->async) {
+		pthread_mutex_lock(&out->lock);
+		out->stop = 1;
+		pthread_cond_broadcast(&out->cond);
+		pthread_mutex_unlock(&out->lock);
+		pthread_join(out->thread, NULL);
+		pthread_mutex_destroy(&out->lock);
+		pthread_cond_destroy(&out->cond);
+	}
+	if (out->close && close(out->fd)) {
+		ret = 1;
+	}
+	free(out->batches[0].buf);
+	free(out->batches[1].buf);
+	return ret;
+}
+
+/* Copy a short piece in the batch buffer, growing the last iovec if it
+ * ends there.
+ */
+static void __copy(output_t* out, const void* data, size_t len) {
+	output_batch_t* b = out->cur;
+	if (b->used + len > OUTPUT_BUFFER || b->niov == OUTPUT_IOV) {
+		__submit(out);
+		b = out->cur;
+	}
+
+	char* dst = b->buf + b->used;
+	memcpy(dst, data, len);
+	b->used += len;
+
+	struct iovec* last = b->niov ? b->iov + b->niov - 1 : NULL;
+	if (last && (char*) last->iov_base + last->iov_len == dst) {
+		last->iov_len += len;
+	}
+	else {
+		b->iov[b->niov++] = (struct iovec) { dst, len };
+	}
+}
+
+int output_write(output_t* out, const void* data, size_t len) {
+	if (len == 0) {
+		return out->error;
+	}
+	if (len < OUTPUT_ZERO_COPY) {
+		__copy(out, data, len);
+		return out->error;
+	}
+
+	if (out->cur->niov == OUTPUT_IOV) {
+		__submit(out);
+	}
+	output_batch_t* b = out->cur;
+	b->iov[b->niov++] = (struct iovec) { (void*) data, len };
+	return out->error;
+}
+
+int output_printf(output_t* out, const char* fmt, ...) {
+	char line[OUTPUT_ZERO_COPY];
+	va_list ap;
+
+	va_start(ap, fmt);
+	int n = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+	if (n < 0) {
+		return 1;
+	}
+	if (n < sizeof(line)) {
+		__copy(out, line, n);
+		return out->error;
+	}
+
+	/* Long lines are rare, they go through their own buffer */
+	char* buf = malloc(n + 1);
+	if (!buf) {
+		printf("couldn't allocate output line\n");
+		return 1;
+	}
+	va_start(ap, fmt);
+	vsnprintf(buf, n + 1, fmt, ap);
+	va_end(ap);
+	output_write(out, buf, n);
+	int ret = output_flush(out);
+	free(buf);
+	return ret;
+}
+
+int output_alignment(output_t* out, const alignment_t* al) {
+	output_write(out, al->up, strlen(al->up));
+	output_write(out, "\n", 1);
+	output_write(out, al->down, strlen(al->down));
+	return output_write(out, "\n", 1);
+}
+
@@ -0,0 +1,64 @@
+#ifndef _output_h_
+#define _output_h_
+
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "alignment.h"
+
+/* Buffered output of alignments to a file descriptor.
+ *
+ * Writes are gathered in batches of iovecs, flushed with writev. Short
+ * pieces (headers, new lines) are copied in the page aligned buffer of
+ * the batch, alignment strings are referenced where they are, without
+ * copy. They must stay valid until the next `output_flush`.
+ *
+ * With `async`, a writer thread flushes a batch while the next one is
+ * filled (two batches).
+ */
+
+#define OUTPUT_BUFFER		(1 << 20)	/* copied bytes per batch */
+#define OUTPUT_IOV		1024		/* iovecs per batch, IOV_MAX at most */
+#define OUTPUT_ZERO_COPY	256		/* shorter pieces are copied */
+
+typedef struct output_batch {
+	char*		buf;
+	size_t		used;
+	struct iovec	iov[OUTPUT_IOV];
+	int		niov;
+} output_batch_t;
+
+typedef struct output {
+	int		fd;
+	int		close;		/* fd was opened by output_open */
+	int		error;
+	output_batch_t	batches[2];
+	output_batch_t*	cur;
+
+	/* Writer thread, if async */
+	int		async;
+	pthread_t	thread;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	output_batch_t*	pending;	/* submitted, until written */
+	int		stop;
+} output_t;
+
+/* Output to the file of `path`, truncated, or to stdout if NULL */
+int output_open(output_t* out, const char* path, int async);
+
+/* Flushes the output, and returns non zero if any write failed */
+int output_close(output_t* out);
+
+int output_write(output_t* out, const void* data, size_t len);
+int output_printf(output_t* out, const char* fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/* The two lines of `print_alignment` */
+int output_alignment(output_t* out, const alignment_t* al);
+
+/* Writes everything given so far, referenced data can be freed after */
+int output_flush(output_t* out);
+
+#endif
+
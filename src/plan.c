@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/statvfs.h>
+
+#include "common.h"
+#include "alignment.h"
+#include "bench.h"
+#include "hirschberg.h"
+#include "plan.h"
+
+const char* plan_names[PLAN_COUNT] = {
+	[PLAN_FULL]	= "full",
+	[PLAN_DISK]	= "disk",
+	[PLAN_LINEAR]	= "linear",
+};
+
+void plan_cfg_default(plan_cfg_t* cfg) {
+	cfg->budget = 0;
+	cfg->bound = -1;
+	cfg->threads = 1;
+	cfg->layout = MATRIX_LAYOUT_DIAGONAL;
+}
+
+/* First number of `path`, after `key` if given */
+static int __read_value(const char* path, const char* key, size_t* v) {
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		return 1;
+	}
+
+	char line[256];
+	int ret = 1;
+	while (fgets(line, sizeof(line), f)) {
+		const char* p = line;
+		if (key) {
+			if (strncmp(line, key, strlen(key))) {
+				continue;
+			}
+			p += strlen(key);
+		}
+		unsigned long long value;
+		if (sscanf(p, "%llu", &value) == 1) {
+			*v = value;
+			ret = 0;
+		}
+		break;
+	}
+
+	fclose(f);
+	return ret;
+}
+
+/* Memory left under the limit of a cgroup directory, v2 or v1 files */
+static int __cgroup_left(const char* dir, size_t* left) {
+	char path[512];
+	size_t limit, usage;
+
+	snprintf(path, sizeof(path), "%s/memory.max", dir);
+	if (__read_value(path, NULL, &limit)) {
+		snprintf(path, sizeof(path), "%s/memory.limit_in_bytes", dir);
+		if (__read_value(path, NULL, &limit)) {
+			return 1;
+		}
+		snprintf(path, sizeof(path), "%s/memory.usage_in_bytes", dir);
+	}
+	else {
+		snprintf(path, sizeof(path), "%s/memory.current", dir);
+	}
+	if (__read_value(path, NULL, &usage)) {
+		return 1;
+	}
+
+	*left = (usage < limit) ? limit - usage : 0;
+	return 0;
+}
+
+/* Cgroup of the process, from /proc/self/cgroup: the memory controller
+ * line of cgroup v1 or the unified line of cgroup v2. The hierarchy may be
+ * mounted at its root in containers.
+ */
+static int __cgroup_memory_left(size_t* left) {
+	FILE* f = fopen("/proc/self/cgroup", "r");
+	if (!f) {
+		return 1;
+	}
+
+	char line[512];
+	char v1[512] = "";
+	char v2[512] = "";
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = '\0';
+		char* ctrl = strchr(line, ':');
+		char* path = ctrl ? strchr(ctrl + 1, ':') : NULL;
+		if (!path) {
+			continue;
+		}
+		*path++ = '\0';
+		if (!strcmp(ctrl + 1, "memory")) {
+			snprintf(v1, sizeof(v1), "/sys/fs/cgroup/memory%s", path);
+		}
+		else if (!strcmp(ctrl + 1, "")) {
+			snprintf(v2, sizeof(v2), "/sys/fs/cgroup%s", path);
+		}
+	}
+	fclose(f);
+
+	if (v1[0] && (!__cgroup_left(v1, left)
+		  ||  !__cgroup_left("/sys/fs/cgroup/memory", left)))
+	{
+		return 0;
+	}
+	if (v2[0] && (!__cgroup_left(v2, left)
+		  ||  !__cgroup_left("/sys/fs/cgroup", left)))
+	{
+		return 0;
+	}
+	return 1;
+}
+
+int plan_available_memory(size_t* bytes) {
+	size_t kb;
+	if (__read_value("/proc/meminfo", "MemAvailable:", &kb)) {
+		printf("couldn't read available memory\n");
+		return 1;
+	}
+	*bytes = kb << 10;
+
+	size_t left;
+	if (!__cgroup_memory_left(&left)) {
+		*bytes = min(*bytes, left);
+	}
+	return 0;
+}
+
+/* Seconds per case of the iterative kernel, timed on a small sample */
+static double __calibrate(const algo_arg_t* args) {
+	char a[PLAN_SAMPLE + 1];
+	char b[PLAN_SAMPLE + 1];
+	for (int i = 0; i < PLAN_SAMPLE; i++) {
+		a[i] = args->len_a ? args->seq_a[i % args->len_a] : 'A';
+		b[i] = args->len_b ? args->seq_b[i % args->len_b] : 'C';
+	}
+	a[PLAN_SAMPLE] = '\0';
+	b[PLAN_SAMPLE] = '\0';
+
+	algo_arg_t sample = *args;
+	sample.seq_a = a;
+	sample.seq_b = b;
+	sample.len_a = PLAN_SAMPLE;
+	sample.len_b = PLAN_SAMPLE;
+	sample.prune = 0;
+
+	matrix_t m;
+	if (matrix_init(&m, PLAN_SAMPLE + 1, PLAN_SAMPLE + 1, sizeof(char),
+			MATRIX_ALLOC_DEFAULT, MATRIX_LAYOUT_DIAGONAL))
+	{
+		return 0;
+	}
+
+	int saved_verbose = verbose;
+	verbose = 0;
+	bench_t b_run;
+	algo_res_t res;
+	memset(&res, 0, sizeof(res));
+	bench_start(&b_run, "calibration");
+	nw(&sample, &res, &m);
+	bench_end(&b_run);
+	verbose = saved_verbose;
+
+	matrix_wipe(&m);
+	return bench_diff_s(&b_run) / ((double) (PLAN_SAMPLE + 1)
+				       * (PLAN_SAMPLE + 1));
+}
+
+static void __print_size(const char* name, size_t bytes) {
+	printf(" %s %.1f MB", name, bytes / (1024.0 * 1024.0));
+}
+
+int plan_choose(const algo_arg_t* args, const plan_cfg_t* cfg,
+		plan_estimate_t estimates[PLAN_COUNT])
+{
+	size_t budget = cfg->budget;
+	if (!budget && plan_available_memory(&budget)) {
+		return -1;
+	}
+
+	size_t disk = 0;
+	struct statvfs vfs;
+	if (!statvfs(".", &vfs)) {
+		disk = (size_t) vfs.f_bavail * vfs.f_frsize;
+	}
+
+	size_t w = args->len_a + 1;
+	size_t h = args->len_b + 1;
+	double cases = (double) w * h;
+	double seconds = cases * __calibrate(args);
+	int layout = (cfg->layout < 0) ? MATRIX_LAYOUT_TILED : cfg->layout;
+	size_t matrix = matrix_layout_cases(layout, w, h);
+
+	/* Every strategy holds the sequences, the full ones also the score
+	 * windows of nw and the traceback tree.
+	 */
+	int count = (cfg->bound < 0) ? 1 : cfg->bound;
+	size_t path = w + h;
+	size_t common = w + h + count * 2 * path;
+	size_t windows = 7 * path * sizeof(int);
+	size_t tree = count * path * PLAN_NODE_BYTES;
+
+	memset(estimates, 0, PLAN_COUNT * sizeof(plan_estimate_t));
+
+	plan_estimate_t* e = estimates + PLAN_FULL;
+	e->supported = 1;
+	e->memory = common + windows + tree + matrix;
+	e->seconds = seconds / max(cfg->threads, 1);
+
+	/* Moves past the budget are written back and read again */
+	e = estimates + PLAN_DISK;
+	e->supported = 1;
+	e->memory = common + windows + tree;
+	e->disk = matrix;
+	e->seconds = estimates[PLAN_FULL].seconds;
+	if (e->memory + matrix > budget) {
+		e->seconds += 2.0 * (e->memory + matrix - budget)
+			    / PLAN_DISK_RATE;
+	}
+
+	/* Twice the cases, with a single thread */
+	e = estimates + PLAN_LINEAR;
+	e->supported = !scoring_is_affine(args->scoring ? args->scoring
+							: &scoring_default)
+		    && cfg->bound >= 0 && cfg->bound <= 1;
+	e->memory = common + 2 * w * sizeof(int) + HIRSCHBERG_BASE_CASES
+		  + path * PLAN_NODE_BYTES;
+	e->seconds = 2 * seconds;
+
+	int best = -1;
+	for (int s = 0; s < PLAN_COUNT; s++) {
+		e = estimates + s;
+		e->fits = e->supported && e->memory <= budget && e->disk <= disk;
+		if (e->fits && (best < 0 || e->seconds
+					    < estimates[best].seconds))
+		{
+			best = s;
+		}
+
+		if (verbose) {
+			printf("> %s:", plan_names[s]);
+			if (!e->supported) {
+				printf(" unsupported\n");
+				continue;
+			}
+			__print_size("memory", e->memory);
+			__print_size("disk", e->disk);
+			printf(" %.2f s%s\n", e->seconds,
+			       e->fits ? "" : " (doesn't fit)");
+		}
+	}
+
+	if (best < 0) {
+		printf("no strategy fits in %.1f MB of memory\n",
+		       budget / (1024.0 * 1024.0));
+	}
+	else {
+		VERBOSE_FMT("%s strategy, budget %.1f MB\n", plan_names[best],
+			    budget / (1024.0 * 1024.0));
+	}
+	return best;
+}
+
@@ -0,0 +1,64 @@
+#ifndef _plan_h_
+#define _plan_h_
+
+#include <stddef.h>
+
+#include "common.h"
+
+/* Execution planner.
+ *
+ * Estimates the memory and the time each strategy needs for a pair of
+ * sequences, and picks the fastest one fitting in a memory budget:
+ *
+ *	full	move matrix in memory (the usual run)
+ *	disk	move matrix in a temporary file (`-u`), the page cache
+ *		holding what the budget allows
+ *	linear	linear space Hirschberg alignment, recomputing cases
+ *		instead of storing moves (linear gaps, one alignment)
+ *
+ * The budget defaults to the available memory: MemAvailable, lowered to
+ * what is left under the memory limit of the process cgroup. Times come
+ * from a small calibration run of the kernel.
+ */
+
+enum {
+	PLAN_FULL = 0,
+	PLAN_DISK,
+	PLAN_LINEAR,
+	PLAN_COUNT,
+};
+
+extern const char* plan_names[PLAN_COUNT];
+
+#define PLAN_SAMPLE		256		/* calibration sequences length */
+#define PLAN_DISK_RATE		(200 << 20)	/* bytes per second of paging */
+#define PLAN_NODE_BYTES		96		/* traceback tree node */
+
+typedef struct plan_cfg {
+	size_t		budget;		/* bytes, 0 for the available memory */
+	int		bound;		/* alignments requested, -1 for all */
+	int		threads;	/* threads of the kernel */
+	int		layout;		/* -1 if not picked yet */
+} plan_cfg_t;
+
+typedef struct plan_estimate {
+	int	supported;
+	int	fits;
+	size_t	memory;			/* bytes of memory */
+	size_t	disk;			/* bytes of disk */
+	double	seconds;
+} plan_estimate_t;
+
+void plan_cfg_default(plan_cfg_t* cfg);
+
+/* Memory the process can still use, in bytes */
+int plan_available_memory(size_t* bytes);
+
+/* Fill the estimates of each strategy and return the one to use, -1 if
+ * none fits in the budget.
+ */
+int plan_choose(const algo_arg_t* args, const plan_cfg_t* cfg,
+		plan_estimate_t estimates[PLAN_COUNT]);
+
+#endif
+
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "protocol.h"
+
+void nwp_put_u32(uint8_t* buf, uint32_t v) {
+	v = htonl(v);
+	memcpy(buf, &v, sizeof(v));
+}
+
+uint32_t nwp_get_u32(const uint8_t* buf) {
+	uint32_t v;
+	memcpy(&v, buf, sizeof(v));
+	return ntohl(v);
+}
+
+void nwp_put_u64(uint8_t* buf, uint64_t v) {
+	nwp_put_u32(buf, v >> 32);
+	nwp_put_u32(buf + 4, v);
+}
+
+uint64_t nwp_get_u64(const uint8_t* buf) {
+	return (uint64_t) nwp_get_u32(buf) << 32 | nwp_get_u32(buf + 4);
+}
+
+/* Write the whole iovec array, handling partial writes */
+static int __writev_all(int fd, struct iovec* iov, int niov) {
+	while (niov > 0) {
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = niov;
+
+		ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 1;
+		}
+
+		while (niov > 0 && (size_t) n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			niov--;
+		}
+		if (niov > 0) {
+			iov->iov_base = (char*) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+static int __read_all(int fd, void* buf, size_t size) {
+	size_t done = 0;
+	while (done < size) {
+		ssize_t n = read(fd, (char*) buf + done, size - done);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 1;
+		}
+		if (n == 0) {
+			return (done == 0) ? -1 : 1;
+		}
+		done += n;
+	}
+	return 0;
+}
+
+int nwp_send(int fd, uint8_t type, uint32_t id,
+	     const struct iovec* parts, int nparts)
+{
+	struct iovec iov[nparts + 1];
+	uint8_t header[NWP_HEADER_SIZE];
+	size_t size = NWP_HEADER_SIZE - 4;
+
+	for (int i = 0; i < nparts; i++) {
+		iov[i + 1] = parts[i];
+		size += parts[i].iov_len;
+	}
+	if (size > NWP_MAX_FRAME) {
+		return 1;
+	}
+
+	nwp_put_u32(header, size);
+	header[4] = type;
+	nwp_put_u32(header + 5, id);
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof(header);
+
+	return __writev_all(fd, iov, nparts + 1);
+}
+
+int nwp_recv(int fd, nwp_frame_t* frame) {
+	uint8_t header[NWP_HEADER_SIZE];
+
+	memset(frame, 0, sizeof(*frame));
+	int ret = __read_all(fd, header, sizeof(header));
+	if (ret) {
+		return ret;
+	}
+
+	uint32_t size = nwp_get_u32(header);
+	if (size < NWP_HEADER_SIZE - 4 || size > NWP_MAX_FRAME) {
+		return 1;
+	}
+	frame->type = header[4];
+	frame->id = nwp_get_u32(header + 5);
+	frame->size = size - (NWP_HEADER_SIZE - 4);
+
+	if (frame->size == 0) {
+		return 0;
+	}
+	frame->payload = malloc(frame->size);
+	if (!frame->payload) {
+		return 1;
+	}
+	if (__read_all(fd, frame->payload, frame->size)) {
+		nwp_frame_wipe(frame);
+		return 1;
+	}
+	return 0;
+}
+
+void nwp_frame_wipe(nwp_frame_t* frame) {
+	free(frame->payload);
+	frame->payload = NULL;
+	frame->size = 0;
+}
+
+int nwp_send_align(int fd, uint32_t id, const nwp_align_t* req) {
+	uint8_t name_len = strlen(req->algorithm);
+	uint8_t fields[16];
+
+	nwp_put_u32(fields, req->bound);
+	nwp_put_u32(fields + 4, req->deadline_ms);
+	nwp_put_u32(fields + 8, req->len_a);
+	nwp_put_u32(fields + 12, req->len_b);
+
+	struct iovec parts[5] = {
+		{ &name_len, 1 },
+		{ (void*) req->algorithm, name_len },
+		{ fields, sizeof(fields) },
+		{ (void*) req->seq_a, req->len_a },
+		{ (void*) req->seq_b, req->len_b },
+	};
+	return nwp_send(fd, NWP_ALIGN, id, parts, 5);
+}
+
+int nwp_decode_align(const nwp_frame_t* frame, nwp_align_t* req) {
+	const uint8_t* p = frame->payload;
+	size_t size = frame->size;
+
+	if (size < 1 || size < 1 + (size_t) p[0] + 16
+	||  p[0] >= sizeof(req->algorithm))
+	{
+		return 1;
+	}
+	memcpy(req->algorithm, p + 1, p[0]);
+	req->algorithm[p[0]] = '\0';
+	size -= 1 + p[0];
+	p += 1 + p[0];
+
+	req->bound	 = (int32_t) nwp_get_u32(p);
+	req->deadline_ms = nwp_get_u32(p + 4);
+	req->len_a	 = nwp_get_u32(p + 8);
+	req->len_b	 = nwp_get_u32(p + 12);
+	size -= 16;
+	p += 16;
+
+	if ((size_t) req->len_a + req->len_b != size) {
+		return 1;
+	}
+	req->seq_a = (const char*) p;
+	req->seq_b = (const char*) p + req->len_a;
+
+	return 0;
+}
+
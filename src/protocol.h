@@ -0,0 +1,115 @@
+#ifndef _protocol_h_
+#define _protocol_h_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+/* Alignment server protocol.
+ *
+ * Every message is a frame, integers are in network byte order:
+ *
+ *	u32	length		size of the frame without this field
+ *	u8	type
+ *	u32	request id	chosen by the client
+ *	...	payload		length - 5 bytes
+ *
+ * Client to server:
+ *
+ *	NWP_ALIGN	u8 algorithm name length, algorithm name,
+ *			i32 max alignments (as -m, 0 for score only),
+ *			u32 deadline in milliseconds (0 for none),
+ *			u32 len_a, u32 len_b, seq_a, seq_b
+ *	NWP_CANCEL	empty
+ *
+ * Server to client, for each request:
+ *
+ *	NWP_SCORE	i32 score
+ *	NWP_ALIGNMENT	u32 index, u32 length, up, down	(zero or more)
+ *	NWP_DONE	u8 status, u32 number of alignments sent
+ *
+ * Frames of different requests can be interleaved, NWP_DONE is always the
+ * last frame of a request.
+ *
+ * Between the processes of the clusterized algorithm (see cluster.h), from
+ * a process to the next one:
+ *
+ *	NWP_HELLO	u32 processes, u32 len_a, u32 len_b,
+ *			u64 hash64 of seq_a, u64 hash64 of seq_b
+ *	NWP_BOUNDARY	u32 first row, u32 rows, then i32 H, i32 E of the
+ *			last column of the sender for each row
+ *
+ * and back to the previous one:
+ *
+ *	NWP_CURSOR	i32 score, u32 row, u8 gap state, u32 length,
+ *			up, down (the end of the alignment, reversed)
+ */
+
+#define NWP_HEADER_SIZE		9
+#define NWP_MAX_FRAME		(1 << 30)
+
+enum {
+	NWP_ALIGN	= 1,
+	NWP_CANCEL,
+	NWP_SCORE,
+	NWP_ALIGNMENT,
+	NWP_DONE,
+	NWP_HELLO,
+	NWP_BOUNDARY,
+	NWP_CURSOR,
+};
+
+/* NWP_DONE status */
+enum {
+	NWP_OK		= 0,
+	NWP_CANCELLED,
+	NWP_TIMEOUT,
+	NWP_ERROR,
+	NWP_BELOW,		/* below the minimum score of the server */
+};
+
+typedef struct nwp_frame {
+	uint8_t		type;
+	uint32_t	id;
+	uint32_t	size;		/* payload size */
+	uint8_t*	payload;	/* malloc'ed, NULL if size is 0 */
+} nwp_frame_t;
+
+/* Decoded NWP_ALIGN payload, pointers refer to the frame payload */
+typedef struct nwp_align {
+	char		algorithm[64];
+	int32_t		bound;
+	uint32_t	deadline_ms;
+	uint32_t	len_a;
+	uint32_t	len_b;
+	const char*	seq_a;
+	const char*	seq_b;
+} nwp_align_t;
+
+void nwp_put_u32(uint8_t* buf, uint32_t v);
+
+uint32_t nwp_get_u32(const uint8_t* buf);
+
+void nwp_put_u64(uint8_t* buf, uint64_t v);
+
+uint64_t nwp_get_u64(const uint8_t* buf);
+
+/* Send a frame whose payload is the concatenation of `parts`.
+ * Returns 0 on success.
+ */
+int nwp_send(int fd, uint8_t type, uint32_t id,
+	     const struct iovec* parts, int nparts);
+
+/* Receive a frame. Returns 0 on success, -1 on end of stream and 1 on
+ * error. The payload must be released with `nwp_frame_wipe`.
+ */
+int nwp_recv(int fd, nwp_frame_t* frame);
+
+void nwp_frame_wipe(nwp_frame_t* frame);
+
+int nwp_send_align(int fd, uint32_t id, const nwp_align_t* req);
+
+int nwp_decode_align(const nwp_frame_t* frame, nwp_align_t* req);
+
+#endif
+
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <smmintrin.h>
+#endif
+
+#include "common.h"
+#include "qgram.h"
+
+static inline uint32_t __bin(const char* s) {
+	uint64_t gram = 0;
+	for (int i = 0; i < QGRAM_Q; i++) {
+		gram = (gram << 8) | (uint8_t) s[i];
+	}
+	return (gram * 0x9e3779b97f4a7c15ULL) >> (64 - QGRAM_BITS);
+}
+
+void qgram_profile(qgram_profile_t* p, const char* seq, int len) {
+	memset(p->counts, 0, sizeof(p->counts));
+	p->len = len;
+	for (int i = 0; i + QGRAM_Q <= len; i++) {
+		p->counts[__bin(seq + i)]++;
+	}
+}
+
+/* Shared q-grams: the sum of the minimums of the counters */
+static uint64_t __shared_scalar(const uint32_t* a, const uint32_t* b) {
+	uint64_t shared = 0;
+	for (int i = 0; i < QGRAM_BINS; i++) {
+		shared += min(a[i], b[i]);
+	}
+	return shared;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse4.1")))
+static uint64_t __shared_sse41(const uint32_t* a, const uint32_t* b) {
+	/* Lanes sum at most a quarter of the q-grams, no overflow */
+	__m128i acc = _mm_setzero_si128();
+	for (int i = 0; i < QGRAM_BINS; i += 4) {
+		__m128i va = _mm_load_si128((const __m128i*) (a + i));
+		__m128i vb = _mm_load_si128((const __m128i*) (b + i));
+		acc = _mm_add_epi32(acc, _mm_min_epu32(va, vb));
+	}
+	uint32_t lanes[4];
+	_mm_storeu_si128((__m128i*) lanes, acc);
+	return (uint64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+#endif
+
+static uint64_t __shared(const qgram_profile_t* a, const qgram_profile_t* b) {
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("sse4.1")) {
+		return __shared_sse41(a->counts, b->counts);
+	}
+#endif
+	return __shared_scalar(a->counts, b->counts);
+}
+
+/* An alignment of D substitution columns (X of them on different
+ * characters) and G gap characters scores at most
+ *	D * best + X * (mismatch - best) + G * gap_extend
+ * with 2D + G = len_a + len_b, G >= |len_a - len_b| and X + G >= edits.
+ * Both extra mismatches and extra pairs of gaps cost their edits, the
+ * bound takes the cheapest. Scores are doubled to stay integers.
+ */
+int qgram_score_bound(const qgram_profile_t* a, const qgram_profile_t* b,
+		      const scoring_t* sc)
+{
+	long long best = scoring_best_substitution(sc);
+	long long mismatch = sc->has_matrix ? best : sc->mismatch;
+	long long gap2 = 2LL * sc->gap_extend - best;	/* doubled, per gap */
+	if (sc->gap_open > 0 || gap2 > 0 || mismatch > best) {
+		return INT_MAX;
+	}
+
+	long long longest = max(a->len, b->len);
+	long long shared = __shared(a, b);
+	long long edits = longest - QGRAM_Q + 1 - shared;
+	edits = (edits > 0) ? (edits + QGRAM_Q - 1) / QGRAM_Q : 0;
+
+	long long gaps = abs(a->len - b->len);
+	long long extra = max(edits - gaps, 0);
+	long long bound2 = (a->len + (long long) b->len) * best
+			 + gaps * gap2
+			 + extra * max(2 * (mismatch - best), gap2);
+
+	/* Rounded down */
+	long long bound = (bound2 >= 0) ? bound2 / 2 : -((-bound2 + 1) / 2);
+	return (bound > INT_MAX) ? INT_MAX : bound;
+}
+
+int qgram_reject(const algo_arg_t* args) {
+	const scoring_t* sc = args->scoring ? args->scoring : &scoring_default;
+	qgram_profile_t* p = malloc(2 * sizeof(qgram_profile_t));
+	if (!p) {
+		return 0;
+	}
+
+	qgram_profile(p, args->seq_a, args->len_a);
+	qgram_profile(p + 1, args->seq_b, args->len_b);
+	int bound = qgram_score_bound(p, p + 1, sc);
+	free(p);
+
+	return bound < args->min_score;
+}
+
+#ifdef TEST
+
+#include "tiny.h"
+
+/* `b` is `a` after `edits` random substitutions, insertions and deletions */
+static int __mutate(const char* a, int len, char* b, int size, int edits) {
+	int n = len;
+	memcpy(b, a, len);
+	for (int e = 0; e < edits; e++) {
+		int i = rand() % (n + 1);
+		int op = rand() % 3;
+		if (op == 0 && i < n) {
+			b[i] = "ACGT"[rand() % 4];
+		}
+		else if (op == 1 && n < size) {
+			memmove(b + i + 1, b + i, n - i);
+			b[i] = "ACGT"[rand() % 4];
+			n++;
+		}
+		else if (op == 2 && i < n) {
+			memmove(b + i, b + i + 1, n - i - 1);
+			n--;
+		}
+	}
+	return n;
+}
+
+/* The bound is never below the score of the best alignment */
+int test_bound(const scoring_t* sc, const char* name) {
+	char a[TINY_MAX];
+	char b[TINY_MAX];
+	qgram_profile_t p[2];
+
+	for (int i = 0; i < 20000; i++) {
+		int len_a = rand() % (TINY_MAX + 1);
+		for (int k = 0; k < len_a; k++) {
+			a[k] = "ACGT"[rand() % 4];
+		}
+		int len_b = __mutate(a, len_a, b, TINY_MAX, rand() % 12);
+
+		algo_arg_t args;
+		memset(&args, 0, sizeof(args));
+		args.seq_a = a;
+		args.seq_b = b;
+		args.len_a = len_a;
+		args.len_b = len_b;
+		args.scoring = sc;
+		int score = tiny_align(&args, NULL);
+
+		qgram_profile(p, a, len_a);
+		qgram_profile(p + 1, b, len_b);
+		int bound = qgram_score_bound(p, p + 1, sc);
+		if (bound < score) {
+			printf("q-gram bound error with %s scoring: "
+			       "%.*s %.*s score %d, bound %d\n", name,
+			       len_a, a, len_b, b, score, bound);
+			return 1;
+		}
+	}
+
+	printf("q-gram bound of %s scoring is OK\n", name);
+	return 0;
+}
+
+int main(void) {
+	scoring_t linear = scoring_default;
+	linear.match = 2;
+	linear.mismatch = -3;
+	linear.gap_extend = -2;
+	scoring_t affine = scoring_default;
+	affine.match = 2;
+	affine.mismatch = -1;
+	affine.gap_open = -4;
+	affine.gap_extend = -1;
+
+	srand(1);
+	return test_bound(&scoring_default, "default")
+	    || test_bound(&linear, "linear")
+	    || test_bound(&affine, "affine");
+}
+
+#endif
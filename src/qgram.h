@@ -0,0 +1,43 @@
+#ifndef _qgram_h_
+#define _qgram_h_
+
+#include <stdint.h>
+
+#include "common.h"
+#include "scoring.h"
+
+/* q-gram prefilter.
+ *
+ * By the q-gram lemma, sequences within k edit operations share at least
+ * max(len_a, len_b) - q + 1 - k * q q-grams. Counting the shared q-grams
+ * gives a lower bound on the edits of any alignment, hence an upper bound
+ * on its score: pairs whose bound is below the minimum score are rejected
+ * without running a kernel.
+ *
+ * q-grams are hashed in QGRAM_BINS counters. Collisions only overestimate
+ * the shared q-grams, so the bound stays valid.
+ */
+
+#define QGRAM_Q		5	/* at most 8 */
+#define QGRAM_BITS	12
+#define QGRAM_BINS	(1 << QGRAM_BITS)
+
+typedef struct qgram_profile {
+	uint32_t	counts[QGRAM_BINS] __attribute__((aligned(16)));
+	int		len;
+} qgram_profile_t;
+
+/* Count the q-grams of `seq` */
+void qgram_profile(qgram_profile_t* p, const char* seq, int len);
+
+/* Upper bound of the score of aligning the profiled sequences, INT_MAX if
+ * the scoring has none (gaps scoring better than substitutions).
+ */
+int qgram_score_bound(const qgram_profile_t* a, const qgram_profile_t* b,
+		      const scoring_t* sc);
+
+/* Returns 1 if args sequences can't reach args->min_score */
+int qgram_reject(const algo_arg_t* args);
+
+#endif
+
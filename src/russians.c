@@ -0,0 +1,489 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "hash.h"
+#include "matrix_file.h"
+#include "scoring.h"
+#include "russians.h"
+
+#define TABLE_MAGIC	"NWRUSSIA"
+#define TABLE_VERSION	1
+
+typedef struct table_header {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	t;
+	uint32_t	nrgs;
+	uint32_t	reserved;
+	uint64_t	entries;
+	uint64_t	check;		/* hash of the entries */
+} table_header_t;
+
+/* Transition table of t x t blocks */
+typedef struct table {
+	int		t;
+	int		nrgs;		/* number of character patterns */
+	uint16_t*	rank;		/* character pattern rank */
+	uint64_t*	entries;
+} table_t;
+
+static table_t __table;
+static pthread_mutex_t __table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Unit scoring case, the same as the iterative kernel */
+static inline char __case(int top, int left, int diag, int equal, int* score)
+{
+	int scores[3] = {
+		top - 1,
+		left - 1,
+		diag + (equal ? 1 : -1)
+	};
+	int bests[3] = {
+		(scores[0] >= scores[1] && scores[0] >= scores[2]) ? 1 : 0,
+		(scores[1] >= scores[0] && scores[1] >= scores[2]) ? 1 : 0,
+		(scores[2] >= scores[0] && scores[2] >= scores[1]) ? 1 : 0
+	};
+	*score = max(scores[0], max(scores[1], scores[2]));
+	return bests[0] * MOVE_TOP
+	     | bests[1] * MOVE_LEFT
+	     | bests[2] * MOVE_TOP_LEFT;
+}
+
+/* Compute a block from its input differences and its characters codes */
+static uint64_t __block(int t, uint32_t diffs, uint32_t chars) {
+	int h[RUSSIANS_MAX_BLOCK + 1][RUSSIANS_MAX_BLOCK + 1];
+	uint64_t entry = 0;
+
+	h[0][0] = 0;
+	for (int i = 1; i <= t; i++) {
+		h[0][i] = h[0][i - 1] + (int) ((diffs >> (2 * (i - 1))) & 3) - 1;
+		h[i][0] = h[i - 1][0]
+			+ (int) ((diffs >> (2 * (t + i - 1))) & 3) - 1;
+	}
+
+	for (int j = 1; j <= t; j++) {
+		for (int i = 1; i <= t; i++) {
+			int a = (chars >> (2 * (i - 1))) & 3;
+			int b = (chars >> (2 * (t + j - 1))) & 3;
+			uint64_t move = __case(h[j - 1][i], h[j][i - 1],
+					       h[j - 1][i - 1], a == b,
+					       &h[j][i]);
+			entry |= move << (4 * t + 3 * ((j - 1) * t + i - 1));
+		}
+	}
+
+	for (int i = 1; i <= t; i++) {
+		entry |= (uint64_t) (h[t][i] - h[t][i - 1] + 1) << (2 * (i - 1));
+		entry |= (uint64_t) (h[i][t] - h[i - 1][t] + 1)
+		       << (2 * (t + i - 1));
+	}
+	return entry;
+}
+
+static void __table_free(table_t* table) {
+	free(table->rank);
+	free(table->entries);
+	memset(table, 0, sizeof(*table));
+}
+
+/* Rank the character patterns by their restricted growth string: only the
+ * equality of characters matters, so "ACCA" and "GTTG" are the same block.
+ */
+static int __rank_patterns(table_t* table, uint32_t** reps) {
+	size_t npatterns = 1UL << (4 * table->t);
+	int* canonical_rank = malloc(npatterns * sizeof(int));
+	table->rank = malloc(npatterns * sizeof(uint16_t));
+	*reps = malloc(npatterns * sizeof(uint32_t));
+	if (!canonical_rank || !table->rank || !*reps) {
+		printf("couldn't allocate block patterns\n");
+		free(canonical_rank);
+		return 1;
+	}
+	memset(canonical_rank, 0xff, npatterns * sizeof(int));
+
+	table->nrgs = 0;
+	for (uint32_t p = 0; p < npatterns; p++) {
+		int label[4] = { -1, -1, -1, -1 };
+		int next = 0;
+		uint32_t q = 0;
+		for (int k = 0; k < 2 * table->t; k++) {
+			int c = (p >> (2 * k)) & 3;
+			if (label[c] < 0) {
+				label[c] = next++;
+			}
+			q |= label[c] << (2 * k);
+		}
+		if (canonical_rank[q] < 0) {
+			canonical_rank[q] = table->nrgs;
+			(*reps)[table->nrgs++] = q;
+		}
+		table->rank[p] = canonical_rank[q];
+	}
+
+	free(canonical_rank);
+	return 0;
+}
+
+static size_t __table_size(const table_t* table) {
+	return ((size_t) 1 << (4 * table->t)) * table->nrgs;
+}
+
+static int __table_build(table_t* table, int t) {
+	uint32_t* reps = NULL;
+
+	table->t = t;
+	if (__rank_patterns(table, &reps)) {
+		goto error;
+	}
+
+	size_t ndiffs = 1UL << (4 * t);
+	table->entries = malloc(__table_size(table) * sizeof(uint64_t));
+	if (!table->entries) {
+		printf("couldn't allocate block table\n");
+		goto error;
+	}
+
+	#pragma omp parallel for schedule(static)
+	for (size_t d = 0; d < ndiffs; d++) {
+		for (int r = 0; r < table->nrgs; r++) {
+			table->entries[d * table->nrgs + r] =
+				__block(t, d, reps[r]);
+		}
+	}
+
+	free(reps);
+	return 0;
+
+    error:
+	free(reps);
+	__table_free(table);
+	return 1;
+}
+
+/* Load the entries of a persisted table, patterns are always rebuilt */
+static int __table_load(table_t* table, const char* path) {
+	table_header_t h;
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		return 1;
+	}
+
+	if (fread(&h, sizeof(h), 1, f) != 1
+	||  memcmp(h.magic, TABLE_MAGIC, sizeof(h.magic))
+	||  h.version != TABLE_VERSION
+	||  h.t != table->t || h.nrgs != table->nrgs
+	||  h.entries != __table_size(table))
+	{
+		printf("block table %s doesn't match, rebuilding it\n", path);
+		goto error;
+	}
+
+	table->entries = malloc(h.entries * sizeof(uint64_t));
+	if (!table->entries
+	||  fread(table->entries, sizeof(uint64_t), h.entries, f) != h.entries
+	||  hash64(table->entries, h.entries * sizeof(uint64_t), 0) != h.check)
+	{
+		printf("block table %s is corrupted, rebuilding it\n", path);
+		free(table->entries);
+		table->entries = NULL;
+		goto error;
+	}
+
+	fclose(f);
+	return 0;
+
+    error:
+	fclose(f);
+	return 1;
+}
+
+static int __table_save(const table_t* table, const char* path) {
+	table_header_t h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, TABLE_MAGIC, sizeof(h.magic));
+	h.version = TABLE_VERSION;
+	h.t = table->t;
+	h.nrgs = table->nrgs;
+	h.entries = __table_size(table);
+	h.check = hash64(table->entries, h.entries * sizeof(uint64_t), 0);
+
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		printf("couldn't create block table %s\n", path);
+		return 1;
+	}
+	if (fwrite(&h, sizeof(h), 1, f) != 1
+	||  fwrite(table->entries, sizeof(uint64_t), h.entries, f) != h.entries)
+	{
+		printf("couldn't write block table %s\n", path);
+		fclose(f);
+		return 1;
+	}
+	fclose(f);
+	return 0;
+}
+
+static int __setup(int t, const char* path) {
+	if (t < RUSSIANS_MIN_BLOCK || t > RUSSIANS_MAX_BLOCK) {
+		printf("block size must be between %d and %d\n",
+		       RUSSIANS_MIN_BLOCK, RUSSIANS_MAX_BLOCK);
+		return 1;
+	}
+
+	table_t table;
+	memset(&table, 0, sizeof(table));
+	table.t = t;
+
+	if (path) {
+		uint32_t* reps = NULL;
+		if (__rank_patterns(&table, &reps)) {
+			return 1;
+		}
+		free(reps);
+		if (!__table_load(&table, path)) {
+			VERBOSE_FMT("loaded %dx%d block table %s\n", t, t, path);
+			goto done;
+		}
+		__table_free(&table);
+	}
+
+	if (__table_build(&table, t)) {
+		return 1;
+	}
+	VERBOSE_FMT("built %dx%d block table (%d patterns, %f MB)\n", t, t,
+		    table.nrgs,
+		    __table_size(&table) * sizeof(uint64_t) / (1024.0 * 1024.0));
+	if (path) {
+		__table_save(&table, path);
+	}
+
+    done:
+	__table_free(&__table);
+	__table = table;
+	return 0;
+}
+
+int russians_setup(int t, const char* path) {
+	pthread_mutex_lock(&__table_lock);
+	int ret = __setup(t, path);
+	pthread_mutex_unlock(&__table_lock);
+	return ret;
+}
+
+/* Default table for runs without setup, the server ones for instance */
+static int __ensure_table(void) {
+	int ret = 0;
+	pthread_mutex_lock(&__table_lock);
+	if (!__table.entries) {
+		ret = __setup(RUSSIANS_DEFAULT_BLOCK, NULL);
+	}
+	pthread_mutex_unlock(&__table_lock);
+	return ret;
+}
+
+/* Give a 2 bits code to each character, -1 if there are more than four */
+static int __char_codes(const algo_arg_t* args, uint8_t* codes_a,
+			uint8_t* codes_b)
+{
+	int codes[256];
+	int next = 0;
+	memset(codes, 0xff, sizeof(codes));
+
+	for (int s = 0; s < 2; s++) {
+		const char* seq = s ? args->seq_b : args->seq_a;
+		int len = s ? args->len_b : args->len_a;
+		uint8_t* out = s ? codes_b : codes_a;
+		for (int i = 0; i < len; i++) {
+			uint8_t c = seq[i];
+			if (codes[c] < 0) {
+				if (next == 4) {
+					return -1;
+				}
+				codes[c] = next++;
+			}
+			if (out) {
+				out[i] = codes[c];
+			}
+		}
+	}
+	return 0;
+}
+
+int russians_supported(const algo_arg_t* args) {
+	if (args->scoring && scoring_class(args->scoring) != SCORING_UNIT) {
+		return 0;
+	}
+	return __char_codes(args, NULL, NULL) == 0;
+}
+
+static inline void __process_block(const table_t* table,
+				   const uint8_t* codes_a,
+				   const uint8_t* codes_b,
+				   uint32_t* col_state, uint32_t* row_state,
+				   matrix_t* move_matrix, int bx, int by)
+{
+	int t = table->t;
+	int x0 = bx * t;
+	int y0 = by * t;
+	uint32_t mask = (1U << (2 * t)) - 1;
+
+	uint32_t chars = 0;
+	for (int i = 0; i < t; i++) {
+		chars |= codes_a[x0 + i] << (2 * i);
+		chars |= codes_b[y0 + i] << (2 * (t + i));
+	}
+	uint32_t diffs = col_state[bx] | (row_state[by] << (2 * t));
+	uint64_t entry = table->entries[(size_t) diffs * table->nrgs
+					+ table->rank[chars]];
+
+	col_state[bx] = entry & mask;
+	row_state[by] = (entry >> (2 * t)) & mask;
+
+	entry >>= 4 * t;
+	for (int j = 1; j <= t; j++) {
+		for (int i = 1; i <= t; i++) {
+			size_t off = matrix_coord_offset(move_matrix,
+							 x0 + i, y0 + j);
+			move_matrix->v.c[off] = entry & 7;
+			entry >>= 3;
+		}
+	}
+}
+
+/* Cases out of full blocks, the bottom rows then the right columns.
+ * `hrow` are the scores of the last block row, `hcol` the ones of the last
+ * block column, completed with the bottom rows.
+ */
+static int __process_margins(const algo_arg_t* args, matrix_t* move_matrix,
+			     int xb, int yb, int* hrow, int* hcol)
+{
+	int size = max(xb, args->len_b) + 1;
+	int* cur = malloc(size * sizeof(int));
+	if (!cur) {
+		printf("couldn't allocate margin scores\n");
+		return 1;
+	}
+
+	int* prev = hrow;
+	for (int y = yb + 1; y <= args->len_b; y++) {
+		cur[0] = -y;
+		for (int x = 1; x <= xb; x++) {
+			size_t off = matrix_coord_offset(move_matrix, x, y);
+			move_matrix->v.c[off] =
+				__case(prev[x], cur[x - 1], prev[x - 1],
+				       args->seq_a[x - 1] == args->seq_b[y - 1],
+				       &cur[x]);
+		}
+		hcol[y] = cur[xb];
+		memcpy(prev, cur, (xb + 1) * sizeof(int));
+	}
+
+	prev = hcol;
+	for (int x = xb + 1; x <= args->len_a; x++) {
+		cur[0] = -x;
+		for (int y = 1; y <= args->len_b; y++) {
+			size_t off = matrix_coord_offset(move_matrix, x, y);
+			move_matrix->v.c[off] =
+				__case(cur[y - 1], prev[y], prev[y - 1],
+				       args->seq_a[x - 1] == args->seq_b[y - 1],
+				       &cur[y]);
+		}
+		memcpy(prev, cur, (args->len_b + 1) * sizeof(int));
+	}
+
+	free(cur);
+	return 0;
+}
+
+int nw_russians(const algo_arg_t* args, algo_res_t* res,
+		matrix_t* move_matrix)
+{
+	if (!russians_supported(args) || __ensure_table()) {
+		VERBOSE("blocks don't apply, using the iterative algorithm\n");
+		return nw(args, res, move_matrix);
+	}
+
+	const table_t* table = &__table;
+	int t = table->t;
+	int bw = args->len_a / t;
+	int bh = args->len_b / t;
+	int xb = bw * t;
+	int yb = bh * t;
+	int ret = ALGO_ERROR;
+
+	uint8_t* codes_a = malloc(args->len_a + 1);
+	uint8_t* codes_b = malloc(args->len_b + 1);
+	uint32_t* col_state = calloc(bw + 1, sizeof(uint32_t));
+	uint32_t* row_state = calloc(bh + 1, sizeof(uint32_t));
+	int* hrow = malloc((xb + 1) * sizeof(int));
+	int* hcol = malloc((args->len_b + 1) * sizeof(int));
+	if (!codes_a || !codes_b || !col_state || !row_state || !hrow || !hcol) {
+		printf("couldn't allocate block states\n");
+		goto end;
+	}
+	__char_codes(args, codes_a, codes_b);
+
+	/* Borders, whose differences are all -1 (code 0 in the states) */
+	move_matrix->v.c[0] = MOVE_NONE;
+	for (int x = 1; x <= args->len_a; x++) {
+		move_matrix->v.c[matrix_coord_offset(move_matrix, x, 0)] =
+			MOVE_LEFT;
+	}
+	for (int y = 1; y <= args->len_b; y++) {
+		move_matrix->v.c[matrix_coord_offset(move_matrix, 0, y)] =
+			MOVE_TOP;
+	}
+
+	/* Blocks, by anti-diagonals */
+	for (int k = 0; k < bw + bh - 1; k++) {
+		int abort = algo_should_abort(args);
+		if (abort) {
+			ret = abort;
+			goto end;
+		}
+
+		int first = max(0, k - bw + 1);
+		int last = min(k, bh - 1);
+		#pragma omp parallel for schedule(static) if (last - first > 1024)
+		for (int by = first; by <= last; by++) {
+			__process_block(table, codes_a, codes_b,
+					col_state, row_state, move_matrix,
+					k - by, by);
+		}
+	}
+
+	/* Scores along the last block row and column, from the differences */
+	hrow[0] = -yb;
+	for (int x = 0; x < xb; x++) {
+		int code = (col_state[x / t] >> (2 * (x % t))) & 3;
+		hrow[x + 1] = hrow[x] + code - 1;
+	}
+	hcol[0] = -xb;
+	for (int y = 0; y < yb; y++) {
+		int code = (row_state[y / t] >> (2 * (y % t))) & 3;
+		hcol[y + 1] = hcol[y] + code - 1;
+	}
+
+	if (__process_margins(args, move_matrix, xb, yb, hrow, hcol)) {
+		goto end;
+	}
+	res->score = hcol[args->len_b];
+
+	if (move_matrix->file && matrix_file_complete(move_matrix, res->score)) {
+		goto end;
+	}
+	ret = ALGO_OK;
+
+    end:
+	free(codes_a);
+	free(codes_b);
+	free(col_state);
+	free(row_state);
+	free(hrow);
+	free(hcol);
+	return ret;
+}
+
@@ -0,0 +1,42 @@
+#ifndef _russians_h_
+#define _russians_h_
+
+#include "common.h"
+
+/* Four-Russians Needleman-Wunsch, for the historical unit scoring over
+ * alphabets of at most four characters (DNA).
+ *
+ * With unit scoring, the difference between two neighbour scores is in
+ * {-1, 0, 1, 2}. The output differences of a t x t block only depend on its
+ * input differences and on which of its characters are equal, so the
+ * transitions of all blocks are precomputed:
+ *
+ *	index	input differences (top row, then left column), 2 bits each,
+ *		and the rank of the block characters relabelled by order of
+ *		first occurrence (a restricted growth string)
+ *	entry	output differences (bottom row, then right column), then
+ *		the moves of the t x t cases, 3 bits each
+ *
+ * Blocks are swept by anti-diagonals, their moves are unpacked in the move
+ * matrix so the usual traceback applies. The cases out of full blocks are
+ * computed one by one.
+ */
+
+#define RUSSIANS_MIN_BLOCK	2
+#define RUSSIANS_MAX_BLOCK	3
+#define RUSSIANS_DEFAULT_BLOCK	3
+
+/* Build the transition table of t x t blocks, or load it from `path` if it
+ * is not NULL. A missing or invalid table file is written after the build.
+ */
+int russians_setup(int t, const char* path);
+
+/* Returns 1 if the arguments can be aligned by blocks */
+int russians_supported(const algo_arg_t* args);
+
+/* The algorithm. Arguments the blocks can't handle are aligned by `nw`. */
+int nw_russians(const algo_arg_t* args, algo_res_t* res,
+		matrix_t* move_matrix);
+
+#endif
+
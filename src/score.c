@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "score.h"
+
+void score_alphabet_init(score_alphabet_t* ab) {
+	memset(ab, 0, sizeof(*ab));
+}
+
+void score_alphabet_add(score_alphabet_t* ab, const char* seq, int len) {
+	for (int i = 0; i < len; i++) {
+		uint8_t c = seq[i];
+		if (!ab->known[c]) {
+			ab->known[c] = 1;
+			ab->code[c] = ab->size;
+			ab->chars[ab->size++] = c;
+		}
+	}
+}
+
+void score_encode(const score_alphabet_t* ab, const char* seq, int len,
+		  uint8_t* codes)
+{
+	for (int i = 0; i < len; i++) {
+		codes[i] = ab->code[(uint8_t) seq[i]];
+	}
+}
+
+int score_check_scoring(const scoring_t* sc) {
+	for (int a = 0; a < 256; a++) {
+		for (int b = 0; b < 256; b++) {
+			int s = scoring_substitute(sc, a, b);
+			if (s < INT16_MIN || s > INT16_MAX) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+int score_profile_init(score_profile_t* p, const score_alphabet_t* ab,
+		       const scoring_t* sc, const char* query, int len)
+{
+	p->len = len;
+	p->size = ab->size;
+	p->rows = malloc(max((size_t) ab->size * len, 1) * sizeof(int16_t));
+	if (!p->rows) {
+		printf("couldn't allocate query profile\n");
+		return 1;
+	}
+
+	for (int c = 0; c < ab->size; c++) {
+		int16_t* row = p->rows + (size_t) c * len;
+		for (int i = 0; i < len; i++) {
+			row[i] = scoring_substitute(sc, query[i], ab->chars[c]);
+		}
+	}
+	return 0;
+}
+
+void score_profile_wipe(score_profile_t* p) {
+	free(p->rows);
+	p->rows = NULL;
+}
+
+/* Gotoh recurrences by rows of the subject, E being the horizontal gap
+ * state along the row and F the vertical ones of the previous row. Linear
+ * gaps are the case of a zero gap_open.
+ */
+void score_profile_first_row(const score_profile_t* p, const scoring_t* sc,
+			     int* h, int* f)
+{
+	h[0] = 0;
+	for (int i = 1; i <= p->len; i++) {
+		h[i] = scoring_gap(sc, i);
+		f[i] = SCORE_NONE;
+	}
+}
+
+void score_profile_row(const score_profile_t* p, const scoring_t* sc,
+		       uint8_t code, int j, const int* h_prev,
+		       const int* f_prev, int* h, int* f)
+{
+	const int16_t* prof = p->rows + (size_t) code * p->len;
+	int open = sc->gap_open + sc->gap_extend;
+	int ext = sc->gap_extend;
+	int diag = h_prev[0];
+	int e = SCORE_NONE;
+
+	h[0] = scoring_gap(sc, j);
+	for (int i = 1; i <= p->len; i++) {
+		int up = h_prev[i];
+		int fi = max(up + open, f_prev[i] + ext);
+		e = max(h[i - 1] + open, e + ext);
+		int best = max(diag + prof[i - 1], max(e, fi));
+		diag = up;
+		h[i] = best;
+		f[i] = fi;
+	}
+}
+
+int score_profile_align(const score_profile_t* p, const scoring_t* sc,
+			const uint8_t* subject, int len, int* buf)
+{
+	int* h = buf;
+	int* f = buf + p->len + 1;
+
+	score_profile_first_row(p, sc, h, f);
+	for (int j = 1; j <= len; j++) {
+		score_profile_row(p, sc, subject[j - 1], j, h, f, h, f);
+	}
+	return h[p->len];
+}
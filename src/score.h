@@ -0,0 +1,65 @@
+#ifndef _score_h_
+#define _score_h_
+
+#include <stdint.h>
+
+#include "scoring.h"
+
+/* Score-only Needleman-Wunsch, in linear space.
+ *
+ * Characters are first mapped to dense codes (an alphabet). A query
+ * profile holds, for each code c and query position i, the score of
+ * aligning query[i] with c: the inner loop then reads one profile row per
+ * subject character instead of looking the scoring up for each case.
+ * Profiles are built once per sequence and reused against every subject.
+ */
+
+typedef struct score_alphabet {
+	uint8_t	known[256];		/* characters having a code */
+	uint8_t	code[256];		/* character codes */
+	uint8_t	chars[256];		/* character of each code */
+	int	size;
+} score_alphabet_t;
+
+typedef struct score_profile {
+	int		len;
+	int		size;		/* alphabet size */
+	int16_t*	rows;		/* size rows of len scores */
+} score_profile_t;
+
+void score_alphabet_init(score_alphabet_t* ab);
+
+/* Give codes to the characters of `seq` which have none yet */
+void score_alphabet_add(score_alphabet_t* ab, const char* seq, int len);
+
+/* Write the codes of `seq` in `codes` */
+void score_encode(const score_alphabet_t* ab, const char* seq, int len,
+		  uint8_t* codes);
+
+/* Returns 1 if the substitution scores don't fit in profiles */
+int score_check_scoring(const scoring_t* sc);
+
+int score_profile_init(score_profile_t* p, const score_alphabet_t* ab,
+		       const scoring_t* sc, const char* query, int len);
+
+void score_profile_wipe(score_profile_t* p);
+
+/* Row 0 of the recurrences, in `h` and `f` of p->len + 1 ints */
+void score_profile_first_row(const score_profile_t* p, const scoring_t* sc,
+			     int* h, int* f);
+
+/* Row `j` of the recurrences, of the subject character `code`, from row
+ * j - 1. The rows may be the same arrays, to be updated in place.
+ */
+void score_profile_row(const score_profile_t* p, const scoring_t* sc,
+		       uint8_t code, int j, const int* h_prev,
+		       const int* f_prev, int* h, int* f);
+
+/* Score of the global alignment of the profiled query with the encoded
+ * subject. `buf` holds 2 * (p->len + 1) ints.
+ */
+int score_profile_align(const score_profile_t* p, const scoring_t* sc,
+			const uint8_t* subject, int len, int* buf);
+
+#endif
+
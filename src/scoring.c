@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "common.h"
+#include "hash.h"
+#include "scoring.h"
+
+const scoring_t scoring_default = {
+	.match		= 1,
+	.mismatch	= -1,
+	.gap_open	= 0,
+	.gap_extend	= -1,
+};
+
+void scoring_init(scoring_t* sc) {
+	*sc = scoring_default;
+}
+
+/* Read the next token of a matrix line */
+static char* __token(char** line) {
+	char* p = *line;
+	while (*p && isspace((unsigned char) *p)) {
+		p++;
+	}
+	if (!*p) {
+		return NULL;
+	}
+	char* start = p;
+	while (*p && !isspace((unsigned char) *p)) {
+		p++;
+	}
+	if (*p) {
+		*p++ = '\0';
+	}
+	*line = p;
+	return start;
+}
+
+int scoring_load_matrix(scoring_t* sc, const char* path) {
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		printf("couldn't open substitution matrix %s\n", path);
+		return 1;
+	}
+
+	char line[1024];
+	char letters[SCORING_ALPHABET];
+	int nletters = 0;
+	int rows = 0;
+	int lowest = 0;
+	int seen[SCORING_ALPHABET] = { 0 };
+
+	while (fgets(line, sizeof(line), f)) {
+		char* p = line;
+		char* tok = __token(&p);
+		if (!tok || tok[0] == '#') {
+			continue;
+		}
+
+		/* Header line: the column letters */
+		if (nletters == 0) {
+			do {
+				if (nletters == SCORING_ALPHABET - 1) {
+					printf("too many letters in %s\n", path);
+					goto error;
+				}
+				letters[nletters++] = toupper(tok[0]);
+			} while ((tok = __token(&p)));
+			continue;
+		}
+
+		/* Matrix row: its letter then its scores */
+		int row = -1;
+		for (int i = 0; i < nletters; i++) {
+			if (letters[i] == toupper(tok[0])) {
+				row = i;
+			}
+		}
+		if (row < 0 || seen[row]) {
+			printf("unexpected row `%s` in %s\n", tok, path);
+			goto error;
+		}
+		for (int col = 0; col < nletters; col++) {
+			char* end;
+			tok = __token(&p);
+			if (!tok) {
+				printf("row `%c` is too short in %s\n",
+				       letters[row], path);
+				goto error;
+			}
+			sc->sub[row][col] = strtol(tok, &end, 10);
+			if (*end) {
+				printf("invalid score `%s` in %s\n", tok, path);
+				goto error;
+			}
+			lowest = min(lowest, sc->sub[row][col]);
+		}
+		seen[row] = 1;
+		rows++;
+	}
+
+	if (nletters == 0 || rows != nletters) {
+		printf("incomplete substitution matrix %s\n", path);
+		goto error;
+	}
+	for (int i = 0; i < nletters; i++) {
+		for (int j = 0; j < i; j++) {
+			if (sc->sub[i][j] != sc->sub[j][i]) {
+				printf("substitution matrix %s is not symmetric\n",
+				       path);
+				goto error;
+			}
+		}
+	}
+
+	/* Unknown characters use the last index */
+	int unknown = SCORING_ALPHABET - 1;
+	for (int i = 0; i < SCORING_ALPHABET; i++) {
+		sc->sub[unknown][i] = lowest;
+		sc->sub[i][unknown] = lowest;
+	}
+	memset(sc->index, unknown, sizeof(sc->index));
+	for (int i = 0; i < nletters; i++) {
+		sc->index[(uint8_t) letters[i]] = i;
+		sc->index[(uint8_t) tolower(letters[i])] = i;
+	}
+	sc->has_matrix = 1;
+
+	fclose(f);
+	return 0;
+
+    error:
+	fclose(f);
+	return 1;
+}
+
+int scoring_class(const scoring_t* sc) {
+	if (scoring_is_affine(sc)) {
+		return sc->has_matrix ? SCORING_AFFINE_MATRIX : SCORING_AFFINE;
+	}
+	if (sc->has_matrix) {
+		return SCORING_LINEAR_MATRIX;
+	}
+	if (sc->match == 1 && sc->mismatch == -1 && sc->gap_extend == -1) {
+		return SCORING_UNIT;
+	}
+	return SCORING_LINEAR;
+}
+
+int scoring_best_substitution(const scoring_t* sc) {
+	if (!sc->has_matrix) {
+		return max(sc->match, sc->mismatch);
+	}
+	int best = sc->sub[0][0];
+	for (int i = 0; i < SCORING_ALPHABET; i++) {
+		for (int j = 0; j < SCORING_ALPHABET; j++) {
+			best = max(best, sc->sub[i][j]);
+		}
+	}
+	return best;
+}
+
+uint64_t scoring_hash(const scoring_t* sc) {
+	/* The historical scoring keeps the hash of older caches */
+	if (scoring_class(sc) == SCORING_UNIT) {
+		return 0;
+	}
+
+	uint64_t h = hash64_mix(0, sc->gap_open);
+	h = hash64_mix(h, sc->gap_extend);
+	if (!sc->has_matrix) {
+		h = hash64_mix(h, sc->match);
+		return hash64_mix(h, sc->mismatch);
+	}
+	h = hash64_mix(h, hash64(sc->index, sizeof(sc->index), 0));
+	return hash64_mix(h, hash64(sc->sub, sizeof(sc->sub), 0));
+}
+
+int scoring_alignment(const scoring_t* sc, const char* up, const char* down) {
+	int score = 0;
+	int gap_up = 0;
+	int gap_down = 0;
+
+	for (int i = 0; up[i] != '\0'; i++) {
+		if (up[i] == '-') {
+			score += sc->gap_extend + (gap_up ? 0 : sc->gap_open);
+			gap_up = 1;
+			gap_down = 0;
+		}
+		else if (down[i] == '-') {
+			score += sc->gap_extend + (gap_down ? 0 : sc->gap_open);
+			gap_down = 1;
+			gap_up = 0;
+		}
+		else {
+			score += scoring_substitute(sc, up[i], down[i]);
+			gap_up = gap_down = 0;
+		}
+	}
+	return score;
+}
+
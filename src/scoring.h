@@ -0,0 +1,86 @@
+#ifndef _scoring_h_
+#define _scoring_h_
+
+#include <stdint.h>
+#include <limits.h>
+
+/* Alignment scoring.
+ *
+ * Aligned characters score `match` or `mismatch`, unless a substitution
+ * matrix is loaded. A gap of n characters scores gap_open + n * gap_extend,
+ * gaps are linear when gap_open is 0 (Gotoh algorithm otherwise).
+ * Scores are added, so penalties are negative.
+ */
+
+#define SCORING_ALPHABET	32
+
+/* Minus infinity, low enough to never be chosen but safe to add scores to */
+#define SCORE_NONE		(INT_MIN / 4)
+
+typedef struct scoring {
+	int	match;
+	int	mismatch;
+	int	gap_open;
+	int	gap_extend;
+
+	/* Substitution matrix, indexed by the character indexes */
+	int	has_matrix;
+	uint8_t	index[256];
+	int	sub[SCORING_ALPHABET][SCORING_ALPHABET];
+} scoring_t;
+
+/* Scoring classes, each one having its own kernels */
+enum {
+	SCORING_UNIT = 0,		/* +1/-1 and linear -1 gaps */
+	SCORING_LINEAR,			/* match/mismatch, linear gaps */
+	SCORING_LINEAR_MATRIX,		/* substitution matrix, linear gaps */
+	SCORING_AFFINE,			/* match/mismatch, affine gaps */
+	SCORING_AFFINE_MATRIX,		/* substitution matrix, affine gaps */
+	SCORING_CLASS_COUNT,
+};
+
+/* The historical scoring, used when arguments have none */
+extern const scoring_t scoring_default;
+
+void scoring_init(scoring_t* sc);
+
+/* Load a substitution matrix in the NCBI format (BLOSUM, PAM):
+ *
+ *	# comment
+ *	   A  R  N ...
+ *	A  4 -1 -2 ...
+ *	R -1  5  0 ...
+ *
+ * Characters out of the matrix score as its lowest value.
+ */
+int scoring_load_matrix(scoring_t* sc, const char* path);
+
+int scoring_class(const scoring_t* sc);
+
+static inline int scoring_is_affine(const scoring_t* sc) {
+	return sc->gap_open != 0;
+}
+
+static inline int scoring_substitute(const scoring_t* sc, char a, char b) {
+	if (sc->has_matrix) {
+		return sc->sub[sc->index[(uint8_t) a]][sc->index[(uint8_t) b]];
+	}
+	return (a == b) ? sc->match : sc->mismatch;
+}
+
+/* Score of a gap of `n` characters */
+static inline int scoring_gap(const scoring_t* sc, int n) {
+	return (n > 0) ? sc->gap_open + n * sc->gap_extend : 0;
+}
+
+/* Highest score of aligning two characters */
+int scoring_best_substitution(const scoring_t* sc);
+
+/* Identifies the scoring parameters, for caches and matrix files */
+uint64_t scoring_hash(const scoring_t* sc);
+
+/* Score of an alignment given as two gapped strings */
+int scoring_alignment(const scoring_t* sc, const char* up, const char* down);
+
+#endif
+
@@ -0,0 +1,470 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "alignment.h"
+#include "hirschberg.h"
+#include "plan.h"
+#include "scoring.h"
+#include "seed.h"
+
+/* Rolling hash of k-mers: sum of c_i * SEED_BASE^(k - 1 - i) */
+#define SEED_BASE	0x100000001b3ULL
+
+typedef struct anchor {
+	int	x;		/* first character in seq_a */
+	int	y;		/* first character in seq_b */
+	int	len;
+} anchor_t;
+
+/* K-mers of seq_a bucketed by hash, `pos[heads[b]..heads[b + 1]]` being the
+ * positions of bucket b in increasing order.
+ */
+typedef struct kmer_index {
+	int	bits;
+	int*	heads;
+	int*	pos;
+} kmer_index_t;
+
+static inline uint64_t __kmer_hash(const char* s) {
+	uint64_t h = 0;
+	for (int i = 0; i < SEED_K; i++) {
+		h = h * SEED_BASE + (uint8_t) s[i];
+	}
+	return h;
+}
+
+static inline uint64_t __kmer_roll(uint64_t h, uint64_t top, char out, char in)
+{
+	return (h - top * (uint8_t) out) * SEED_BASE + (uint8_t) in;
+}
+
+static inline uint32_t __kmer_bucket(const kmer_index_t* idx, uint64_t h) {
+	return (h * 0x9e3779b97f4a7c15ULL) >> (64 - idx->bits);
+}
+
+/* SEED_BASE^(k - 1), the weight of the outgoing character */
+static uint64_t __kmer_top(void) {
+	uint64_t top = 1;
+	for (int i = 1; i < SEED_K; i++) {
+		top *= SEED_BASE;
+	}
+	return top;
+}
+
+static void __index_wipe(kmer_index_t* idx) {
+	free(idx->heads);
+	free(idx->pos);
+	idx->heads = NULL;
+	idx->pos = NULL;
+}
+
+static int __index_build(kmer_index_t* idx, const char* seq, int len) {
+	int n = len - SEED_K + 1;
+	uint32_t* buckets = malloc(n * sizeof(uint32_t));
+
+	idx->bits = 1;
+	while ((1 << idx->bits) < n) {
+		idx->bits++;
+	}
+	idx->heads = calloc((1 << idx->bits) + 1, sizeof(int));
+	idx->pos = malloc(n * sizeof(int));
+	if (!buckets || !idx->heads || !idx->pos) {
+		printf("couldn't allocate k-mer index\n");
+		free(buckets);
+		__index_wipe(idx);
+		return 1;
+	}
+
+	uint64_t top = __kmer_top();
+	uint64_t h = __kmer_hash(seq);
+	for (int i = 0; i < n; i++) {
+		if (i > 0) {
+			h = __kmer_roll(h, top, seq[i - 1], seq[i + SEED_K - 1]);
+		}
+		buckets[i] = __kmer_bucket(idx, h);
+		idx->heads[buckets[i] + 1]++;
+	}
+	for (int b = 0; b < (1 << idx->bits); b++) {
+		idx->heads[b + 1] += idx->heads[b];
+	}
+
+	/* Bucket starts move to their ends while filling them */
+	for (int i = 0; i < n; i++) {
+		idx->pos[idx->heads[buckets[i]]++] = i;
+	}
+	for (int b = (1 << idx->bits); b > 0; b--) {
+		idx->heads[b] = idx->heads[b - 1];
+	}
+	idx->heads[0] = 0;
+
+	free(buckets);
+	return 0;
+}
+
+/* Maximal exact matches of at least SEED_K characters, sorted by y then x */
+static int __find_anchors(const algo_arg_t* args, const kmer_index_t* idx,
+			  anchor_t** anchors, int* nanchors)
+{
+	const char* a = args->seq_a;
+	const char* b = args->seq_b;
+	int size = 1024;
+	int n = 0;
+	anchor_t* out = malloc(size * sizeof(anchor_t));
+	if (!out) {
+		printf("couldn't allocate anchors\n");
+		return 1;
+	}
+
+	uint64_t top = __kmer_top();
+	uint64_t h = __kmer_hash(b);
+	for (int y = 0; y + SEED_K <= args->len_b; y++) {
+		if (y > 0) {
+			h = __kmer_roll(h, top, b[y - 1], b[y + SEED_K - 1]);
+		}
+		uint32_t bucket = __kmer_bucket(idx, h);
+		int first = idx->heads[bucket];
+		int last = idx->heads[bucket + 1];
+		if (last - first > SEED_MAX_OCC) {
+			continue;
+		}
+
+		for (int p = first; p < last; p++) {
+			int x = idx->pos[p];
+			if (memcmp(a + x, b + y, SEED_K)) {
+				continue;
+			}
+			/* Only the start of a match makes an anchor */
+			if (x > 0 && y > 0 && a[x - 1] == b[y - 1]) {
+				continue;
+			}
+
+			int len = SEED_K;
+			while (x + len < args->len_a && y + len < args->len_b
+			&&     a[x + len] == b[y + len])
+			{
+				len++;
+			}
+
+			if (n == size) {
+				size *= 2;
+				anchor_t* tmp = realloc(out, size * sizeof(anchor_t));
+				if (!tmp) {
+					printf("couldn't allocate anchors\n");
+					free(out);
+					return 1;
+				}
+				out = tmp;
+			}
+			out[n++] = (anchor_t) { x, y, len };
+		}
+	}
+
+	*anchors = out;
+	*nanchors = n;
+	return 0;
+}
+
+/* Best collinear chain of non overlapping anchors. Anchors gain their
+ * length and lose the shift of diagonal from their predecessor.
+ * Returns the chain length, its anchors being put in order in `chain`.
+ */
+static int __chain(const anchor_t* anchors, int n, int* chain, int* coverage)
+{
+	int* score = malloc(n * sizeof(int));
+	int* pred = malloc(n * sizeof(int));
+	if (!score || !pred) {
+		printf("couldn't allocate chain\n");
+		free(score);
+		free(pred);
+		return -1;
+	}
+
+	int best = 0;
+	for (int c = 0; c < n; c++) {
+		const anchor_t* ac = anchors + c;
+		score[c] = ac->len;
+		pred[c] = -1;
+		for (int p = c - 1; p >= max(0, c - SEED_LOOKBACK); p--) {
+			const anchor_t* ap = anchors + p;
+			if (ap->x + ap->len > ac->x || ap->y + ap->len > ac->y) {
+				continue;
+			}
+			int shift = abs((ac->x - ap->x) - (ac->y - ap->y));
+			int s = score[p] + ac->len - shift;
+			if (s > score[c]) {
+				score[c] = s;
+				pred[c] = p;
+			}
+		}
+		if (score[c] > score[best]) {
+			best = c;
+		}
+	}
+
+	int len = 0;
+	for (int c = best; c >= 0; c = pred[c]) {
+		len++;
+	}
+	*coverage = 0;
+	for (int c = best, i = len - 1; c >= 0; c = pred[c], i--) {
+		chain[i] = c;
+		*coverage += anchors[c].len;
+	}
+
+	free(score);
+	free(pred);
+	return len;
+}
+
+/* Budget of the gaps too large for a move matrix in memory */
+static size_t __budget = 0;
+
+void seed_setup(size_t budget) {
+	__budget = budget;
+}
+
+/* Align seq_a[x, x + w) with seq_b[y, y + h), the move matrix being
+ * allocated with `alloc`.
+ */
+static int __align_region(const algo_arg_t* args, int x, int y, int w, int h,
+			  int alloc, alignment_t* al, int* score)
+{
+	algo_arg_t sub = *args;
+	sub.seq_a = args->seq_a + x;
+	sub.seq_b = args->seq_b + y;
+	sub.len_a = w;
+	sub.len_b = h;
+
+	/* The minimum score and X-drop are about the whole pair */
+	sub.prune = 0;
+	sub.xdrop = 0;
+
+	matrix_t m;
+	if (matrix_init(&m, w + 1, h + 1, sizeof(char), alloc,
+			MATRIX_LAYOUT_DIAGONAL))
+	{
+		printf("couldn't allocate move matrix\n");
+		return ALGO_ERROR;
+	}
+
+	algo_res_t res;
+	memset(&res, 0, sizeof(res));
+	int ret = nw(&sub, &res, &m);
+	if (ret == ALGO_OK) {
+		alignment_t* alignments = NULL;
+		int n = compute_alignments(&sub, &m, &alignments, 1);
+		if (n <= 0) {
+			ret = ALGO_ERROR;
+		}
+		else {
+			*al = alignments[0];
+			for (int i = 1; i < n; i++) {
+				alignment_wipe(alignments + i);
+			}
+			free(alignments);
+		}
+	}
+	if (score) {
+		*score = res.score;
+	}
+
+	matrix_wipe(&m);
+	return ret;
+}
+
+/* Align seq_a[x, x + w) with seq_b[y, y + h) the way the planner picks */
+static int __align_large_region(const algo_arg_t* args, int x, int y,
+				int w, int h, alignment_t* al)
+{
+	algo_arg_t sub = *args;
+	sub.seq_a = args->seq_a + x;
+	sub.seq_b = args->seq_b + y;
+	sub.len_a = w;
+	sub.len_b = h;
+	sub.prune = 0;
+	sub.xdrop = 0;
+
+	plan_cfg_t cfg;
+	plan_cfg_default(&cfg);
+	cfg.budget = __budget;
+	cfg.bound = 1;
+
+	plan_estimate_t estimates[PLAN_COUNT];
+	switch (plan_choose(&sub, &cfg, estimates)) {
+	    case PLAN_FULL:
+		return __align_region(args, x, y, w, h, MATRIX_ALLOC_DEFAULT,
+				      al, NULL);
+	    case PLAN_DISK:
+		return __align_region(args, x, y, w, h, MATRIX_ALLOC_FILE,
+				      al, NULL);
+	    case PLAN_LINEAR:
+		break;
+	    default:
+		return ALGO_ERROR;
+	}
+
+	algo_res_t res;
+	memset(&res, 0, sizeof(res));
+	int ret = nw_linear(&sub, &res, NULL);
+	if (ret == ALGO_OK) {
+		*al = res.alignments[0];
+		free(res.alignments);
+	}
+	return ret;
+}
+
+/* Align the gaps around the chain and put them together with its anchors */
+static int __fill_chain(const algo_arg_t* args, const anchor_t* anchors,
+			const int* chain, int len, alignment_t* al)
+{
+	int nregions = len + 1;
+	alignment_t* gaps = calloc(nregions, sizeof(alignment_t));
+	if (!gaps || alignment_init(al, args->len_a + args->len_b + 1)) {
+		printf("couldn't allocate gap alignments\n");
+		free(gaps);
+		return ALGO_ERROR;
+	}
+
+	/* Sub-problems don't report their progression */
+	int saved_verbose = verbose;
+	verbose = 0;
+
+	int ret = ALGO_OK;
+	#pragma omp parallel for schedule(dynamic)
+	for (int r = 0; r < nregions; r++) {
+		int failed;
+		#pragma omp atomic read
+		failed = ret;
+		if (failed != ALGO_OK) {
+			continue;
+		}
+		const anchor_t* prev = (r > 0) ? anchors + chain[r - 1] : NULL;
+		const anchor_t* next = (r < len) ? anchors + chain[r] : NULL;
+		int x = prev ? prev->x + prev->len : 0;
+		int y = prev ? prev->y + prev->len : 0;
+		int w = (next ? next->x : args->len_a) - x;
+		int h = (next ? next->y : args->len_b) - y;
+		if (w == 0 && h == 0) {
+			continue;
+		}
+		int r_ret;
+		if ((w + 1) * (size_t) (h + 1) > SEED_MAX_REGION_CASES) {
+			r_ret = __align_large_region(args, x, y, w, h,
+						     gaps + r);
+		}
+		else {
+			r_ret = __align_region(args, x, y, w, h,
+					       MATRIX_ALLOC_DEFAULT, gaps + r,
+					       NULL);
+		}
+		if (r_ret != ALGO_OK) {
+			#pragma omp atomic write
+			ret = r_ret;
+		}
+	}
+
+	verbose = saved_verbose;
+
+	size_t col = 0;
+	for (int r = 0; r < nregions; r++) {
+		if (ret == ALGO_OK && gaps[r].up) {
+			size_t n = strlen(gaps[r].up);
+			memcpy(al->up + col, gaps[r].up, n);
+			memcpy(al->down + col, gaps[r].down, n);
+			col += n;
+		}
+		if (ret == ALGO_OK && r < len) {
+			const anchor_t* anchor = anchors + chain[r];
+			memcpy(al->up + col, args->seq_a + anchor->x, anchor->len);
+			memcpy(al->down + col, args->seq_b + anchor->y,
+			       anchor->len);
+			col += anchor->len;
+		}
+		alignment_wipe(gaps + r);
+	}
+	al->up[col] = '\0';
+	al->down[col] = '\0';
+
+	free(gaps);
+	if (ret != ALGO_OK) {
+		alignment_wipe(al);
+	}
+	return ret;
+}
+
+int nw_seeded(const algo_arg_t* args, algo_res_t* res,
+	      matrix_t* move_matrix)
+{
+	(void) move_matrix;
+
+	kmer_index_t idx;
+	anchor_t* anchors = NULL;
+	int* chain = NULL;
+	int nanchors = 0;
+	int len = 0;
+	int coverage = 0;
+	int ret = ALGO_ERROR;
+	int shortest = min(args->len_a, args->len_b);
+
+	alignment_t* al = malloc(sizeof(alignment_t));
+	if (!al) {
+		printf("couldn't allocate alignment\n");
+		return ALGO_ERROR;
+	}
+	memset(al, 0, sizeof(*al));
+	memset(&idx, 0, sizeof(idx));
+
+	if (shortest < SEED_MIN_LENGTH) {
+		goto full;
+	}
+
+	if (__index_build(&idx, args->seq_a, args->len_a)
+	||  __find_anchors(args, &idx, &anchors, &nanchors))
+	{
+		goto end;
+	}
+	__index_wipe(&idx);
+
+	chain = malloc(max(nanchors, 1) * sizeof(int));
+	if (!chain) {
+		printf("couldn't allocate chain\n");
+		goto end;
+	}
+	len = (nanchors > 0) ? __chain(anchors, nanchors, chain, &coverage) : 0;
+	if (len < 0) {
+		goto end;
+	}
+	VERBOSE_FMT("%d anchors, chain of %d covering %d characters\n",
+		    nanchors, len, coverage);
+
+	if ((size_t) coverage * SEED_MIN_COVERAGE < (size_t) shortest) {
+		goto full;
+	}
+
+	ret = __fill_chain(args, anchors, chain, len, al);
+	if (ret == ALGO_OK) {
+		res->score = score_alignment(al, args->scoring);
+	}
+	goto end;
+
+    full:
+	VERBOSE("no chain covers the sequences, aligning them whole\n");
+	ret = __align_region(args, 0, 0, args->len_a, args->len_b,
+			     MATRIX_ALLOC_DEFAULT, al, &res->score);
+
+    end:
+	__index_wipe(&idx);
+	free(anchors);
+	free(chain);
+	if (ret != ALGO_OK) {
+		free(al);
+		return ret;
+	}
+	res->below = args->prune && res->score < args->min_score;
+	res->alignments = al;
+	res->count = 1;
+	return ALGO_OK;
+}
+
@@ -0,0 +1,43 @@
+#ifndef _seed_h_
+#define _seed_h_
+
+#include <stddef.h>
+
+#include "common.h"
+
+/* Seed and chain alignment of long, mostly collinear sequences.
+ *
+ * The k-mers of seq_a are hashed in an index, their exact matches in seq_b
+ * are extended to maximal exact matches (anchors), and the best collinear
+ * chain of anchors is kept. Only the gaps between consecutive anchors are
+ * aligned by `nw`, in parallel, each with a move matrix of its own size.
+ *
+ * Gaps of more than SEED_MAX_REGION_CASES cases are aligned the way the
+ * planner picks within the budget given to `seed_setup` (see plan.h): with
+ * a move matrix in memory or in a temporary file, or in linear space by
+ * `nw_linear` when gaps are linear.
+ *
+ * The result is the concatenation of the anchors and of the gap alignments,
+ * which is not always optimal. Short sequences, and sequences whose chain
+ * covers too little of them, are aligned by a full `nw`.
+ */
+
+#define SEED_K			15	/* k-mer size */
+#define SEED_MAX_OCC		32	/* more frequent k-mers are ignored */
+#define SEED_LOOKBACK		64	/* predecessors tried by the chaining */
+#define SEED_MIN_LENGTH		4096	/* shorter sequences are not seeded */
+#define SEED_MIN_COVERAGE	4	/* the chain covers at least 1/4 of
+					 * the shortest sequence */
+#define SEED_MAX_REGION_CASES	(256 << 20)	/* largest gap move matrix */
+
+/* Set the memory budget of the large gaps, 0 for the available memory */
+void seed_setup(size_t budget);
+
+/* The algorithm. It computes its single alignment itself, in
+ * res->alignments, and doesn't use `move_matrix`.
+ */
+int nw_seeded(const algo_arg_t* args, algo_res_t* res,
+	      matrix_t* move_matrix);
+
+#endif
+
@@ -0,0 +1,677 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "alignment.h"
+#include "protocol.h"
+#include "qgram.h"
+#include "server.h"
+#include "tiny.h"
+
+/* The server is made of:
+ *  - one thread accepting connections,
+ *  - one thread per connection reading requests and queuing jobs,
+ *  - a pool of workers, each owning a preallocated move matrix, running
+ *    jobs and streaming results back to the connection.
+ *
+ * Small jobs are taken from the queue by batches so a worker can run many of
+ * them without going back to sleep between each one, though never more than
+ * its share of the queue while other workers are idle.
+ */
+
+typedef struct connection {
+	int		fd;
+	int		refs;		/* protected by the server lock */
+	int		closed;		/* protected by write_lock */
+	pthread_mutex_t	write_lock;
+	struct connection*	prev;	/* list of the connections read */
+	struct connection*	next;
+} connection_t;
+
+typedef struct job {
+	connection_t*	conn;
+	uint32_t	id;
+	int		algorithm;
+	int		bound;
+	size_t		cells;
+	volatile int	cancel;
+	algo_arg_t	args;
+	nwp_frame_t	frame;		/* owns the sequences */
+	struct job*	next_queued;
+	struct job*	prev;		/* list of the jobs not finished */
+	struct job*	next;
+} job_t;
+
+typedef struct server {
+	const server_cfg_t*	cfg;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	pthread_cond_t		readers_cond;	/* a reader stopped */
+	job_t*			queue_head;
+	job_t*			queue_tail;
+	int			queued;
+	int			idle;		/* workers waiting for jobs */
+	job_t*			jobs;
+	connection_t*		conns;
+	int			stop;
+} server_t;
+
+typedef struct worker {
+	server_t*	server;
+	pthread_t	thread;
+	matrix_t	move_matrix;
+} worker_t;
+
+static volatile sig_atomic_t __stop_requested = 0;
+
+static void __on_signal(int sig) {
+	__stop_requested = 1;
+}
+
+/* Connections */
+
+/* Called with the server lock held */
+static void __connection_unlink(server_t* server, connection_t* conn) {
+	if (conn->prev) {
+		conn->prev->next = conn->next;
+	}
+	else {
+		server->conns = conn->next;
+	}
+	if (conn->next) {
+		conn->next->prev = conn->prev;
+	}
+}
+
+static void __connection_unref(server_t* server, connection_t* conn) {
+	pthread_mutex_lock(&server->lock);
+	int refs = --conn->refs;
+	pthread_mutex_unlock(&server->lock);
+
+	if (refs == 0) {
+		close(conn->fd);
+		pthread_mutex_destroy(&conn->write_lock);
+		free(conn);
+	}
+}
+
+static void __connection_send(connection_t* conn, uint8_t type, uint32_t id,
+			      const struct iovec* parts, int nparts)
+{
+	pthread_mutex_lock(&conn->write_lock);
+	if (!conn->closed && nwp_send(conn->fd, type, id, parts, nparts)) {
+		conn->closed = 1;
+	}
+	pthread_mutex_unlock(&conn->write_lock);
+}
+
+static void __send_done(connection_t* conn, uint32_t id,
+			uint8_t status, uint32_t count)
+{
+	uint8_t payload[5];
+	payload[0] = status;
+	nwp_put_u32(payload + 1, count);
+	struct iovec part = { payload, sizeof(payload) };
+	__connection_send(conn, NWP_DONE, id, &part, 1);
+}
+
+/* Jobs */
+
+static void __job_finish(server_t* server, job_t* job) {
+	pthread_mutex_lock(&server->lock);
+	if (job->prev) {
+		job->prev->next = job->next;
+	}
+	else {
+		server->jobs = job->next;
+	}
+	if (job->next) {
+		job->next->prev = job->prev;
+	}
+	pthread_mutex_unlock(&server->lock);
+
+	__connection_unref(server, job->conn);
+	nwp_frame_wipe(&job->frame);
+	free(job);
+}
+
+static void __send_alignments(job_t* job, const alignment_t* alignments,
+			      int nalignments)
+{
+	int sent = 0;
+	for (int i = 0; i < nalignments && !job->cancel; i++) {
+		uint32_t len = strlen(alignments[i].up);
+		uint8_t fields[8];
+		nwp_put_u32(fields, i);
+		nwp_put_u32(fields + 4, len);
+		struct iovec parts[3] = {
+			{ fields, sizeof(fields) },
+			{ alignments[i].up, len },
+			{ alignments[i].down, len },
+		};
+		__connection_send(job->conn, NWP_ALIGNMENT, job->id, parts, 3);
+		sent++;
+	}
+
+	__send_done(job->conn, job->id,
+		    job->cancel ? NWP_CANCELLED : NWP_OK, sent);
+}
+
+static void __send_score(job_t* job, int score) {
+	uint8_t payload[4];
+	nwp_put_u32(payload, score);
+	struct iovec part = { payload, sizeof(payload) };
+	__connection_send(job->conn, NWP_SCORE, job->id, &part, 1);
+}
+
+static void __free_alignments(alignment_t* alignments, int nalignments) {
+	for (int i = 0; i < nalignments; i++) {
+		alignment_wipe(alignments + i);
+	}
+	free(alignments);
+}
+
+static void __job_run(worker_t* worker, job_t* job) {
+	connection_t* conn = job->conn;
+	matrix_t* move_matrix = &worker->move_matrix;
+	cache_t* cache = worker->server->cfg->cache;
+	algo_res_t res;
+	alignment_t* alignments = NULL;
+	int nalignments = 0;
+
+	if (job->cancel) {
+		__send_done(conn, job->id, NWP_CANCELLED, 0);
+		return;
+	}
+
+	if (cache && cache_lookup(cache, &job->args, job->algorithm,
+				  job->bound, &res.score,
+				  (job->bound != 0) ? &alignments : NULL,
+				  &nalignments))
+	{
+		if (job->args.prune && res.score < job->args.min_score) {
+			__send_done(conn, job->id, NWP_BELOW, 0);
+		}
+		else {
+			__send_score(job, res.score);
+			__send_alignments(job, alignments, nalignments);
+		}
+		__free_alignments(alignments, nalignments);
+		return;
+	}
+
+	/* Tiny pairs skip the move matrix (see tiny.h) */
+	algo_func_t func = algorithms[job->algorithm].func;
+	if ((func == nw || func == nw_omp)
+	&&  (job->bound == 0 || job->bound == 1) && tiny_fits(&job->args))
+	{
+		tiny_alignment_t al;
+		int n = (job->bound != 0);
+		int score = tiny_align(&job->args, n ? &al : NULL);
+		if (job->args.prune && score < job->args.min_score) {
+			__send_done(conn, job->id, NWP_BELOW, 0);
+			return;
+		}
+		alignment_t view;
+		if (n != 0) {
+			view = tiny_alignment(&al);
+		}
+		__send_score(job, score);
+		if (cache) {
+			cache_store(cache, &job->args, job->algorithm,
+				    job->bound, score, &view, n);
+		}
+		__send_alignments(job, &view, n);
+		return;
+	}
+
+	int no_matrix = algorithms[job->algorithm].flags & ALGO_NO_MATRIX;
+	if (!no_matrix
+	&&  matrix_resize(move_matrix, job->args.len_a + 1,
+			  job->args.len_b + 1))
+	{
+		__send_done(conn, job->id, NWP_ERROR, 0);
+		return;
+	}
+
+	memset(&res, 0, sizeof(res));
+	int ret = algorithms[job->algorithm].func(&job->args, &res,
+						  move_matrix);
+	if (ret != ALGO_OK) {
+		__send_done(conn, job->id,
+			    (ret == ALGO_CANCELLED) ? NWP_CANCELLED
+			  : (ret == ALGO_TIMEOUT)   ? NWP_TIMEOUT
+			  : NWP_ERROR, 0);
+		return;
+	}
+	if (res.below
+	||  (job->args.prune && res.score < job->args.min_score))
+	{
+		if (no_matrix) {
+			__free_alignments(res.alignments, res.count);
+		}
+		__send_done(conn, job->id, NWP_BELOW, 0);
+		return;
+	}
+
+	__send_score(job, res.score);
+
+	if (no_matrix) {
+		alignments = res.alignments;
+		nalignments = res.count;
+		if (job->bound == 0) {
+			__free_alignments(alignments, nalignments);
+			alignments = NULL;
+			nalignments = 0;
+		}
+	}
+	else if (job->bound != 0) {
+		nalignments = compute_alignments(&job->args, move_matrix,
+						 &alignments, job->bound);
+		if (nalignments <= 0) {
+			__send_done(conn, job->id, NWP_ERROR, 0);
+			return;
+		}
+	}
+
+	if (cache) {
+		cache_store(cache, &job->args, job->algorithm, job->bound,
+			    res.score, alignments, nalignments);
+	}
+
+	__send_alignments(job, alignments, nalignments);
+	__free_alignments(alignments, nalignments);
+}
+
+/* Take the next job and, if it is small, following small jobs too, up to
+ * the share of the queue of this worker and the idle ones.
+ * Returns the number of jobs put in `batch`, 0 if the server stops.
+ */
+static int __take_batch(server_t* server, job_t** batch) {
+	const server_cfg_t* cfg = server->cfg;
+
+	pthread_mutex_lock(&server->lock);
+	while (!server->queue_head && !server->stop) {
+		server->idle++;
+		pthread_cond_wait(&server->cond, &server->lock);
+		server->idle--;
+	}
+
+	int share = (server->queued + server->idle) / (server->idle + 1);
+	int count = 0;
+	while (server->queue_head && count < min(cfg->batch_max, share)) {
+		job_t* job = server->queue_head;
+		if (count > 0 && job->cells > cfg->batch_cells) {
+			break;
+		}
+
+		server->queue_head = job->next_queued;
+		if (!server->queue_head) {
+			server->queue_tail = NULL;
+		}
+		server->queued--;
+		batch[count++] = job;
+
+		if (job->cells > cfg->batch_cells) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&server->lock);
+
+	return count;
+}
+
+static void* __worker_main(void* arg) {
+	worker_t* worker = arg;
+	server_t* server = worker->server;
+	job_t* batch[server->cfg->batch_max];
+
+	int count;
+	while ((count = __take_batch(server, batch)) > 0) {
+		VERBOSE_FMT("worker %lu: batch of %d request(s)\n",
+			    (unsigned long) worker->thread, count);
+		for (int i = 0; i < count; i++) {
+			__job_run(worker, batch[i]);
+			__job_finish(server, batch[i]);
+		}
+	}
+
+	return NULL;
+}
+
+/* Connection reader */
+
+typedef struct reader_arg {
+	server_t*	server;
+	connection_t*	conn;
+} reader_arg_t;
+
+static void __queue_align(server_t* server, connection_t* conn,
+			  nwp_frame_t* frame)
+{
+	nwp_align_t req;
+	if (nwp_decode_align(frame, &req)) {
+		__send_done(conn, frame->id, NWP_ERROR, 0);
+		return;
+	}
+
+	int algorithm = find_algo_id(req.algorithm);
+	if (algorithm < 0 || !algorithms[algorithm].func) {
+		__send_done(conn, frame->id, NWP_ERROR, 0);
+		return;
+	}
+	/* Alignments of score-only algorithms are the iterative one's */
+	if ((algorithms[algorithm].flags & ALGO_SCORE_ONLY) && req.bound != 0) {
+		algorithm = find_algo_id("iterative");
+	}
+
+	job_t* job = malloc(sizeof(job_t));
+	if (!job) {
+		__send_done(conn, frame->id, NWP_ERROR, 0);
+		return;
+	}
+	memset(job, 0, sizeof(job_t));
+
+	/* The job takes the frame payload ownership */
+	job->frame = *frame;
+	frame->payload = NULL;
+
+	job->conn = conn;
+	job->id = job->frame.id;
+	job->algorithm = algorithm;
+	job->bound = req.bound;
+	job->cells = (req.len_a + 1) * (size_t) (req.len_b + 1);
+	job->args.seq_a = (char*) req.seq_a;
+	job->args.seq_b = (char*) req.seq_b;
+	job->args.len_a = req.len_a;
+	job->args.len_b = req.len_b;
+	job->args.cancel = &job->cancel;
+	if (req.deadline_ms) {
+		clock_gettime(CLOCK_MONOTONIC, &job->args.deadline);
+		job->args.deadline.tv_sec += req.deadline_ms / 1000;
+		job->args.deadline.tv_nsec += (req.deadline_ms % 1000)
+					    * 1000000L;
+		if (job->args.deadline.tv_nsec >= 1000000000L) {
+			job->args.deadline.tv_sec++;
+			job->args.deadline.tv_nsec -= 1000000000L;
+		}
+	}
+
+	/* Only pairs which may reach the minimum score are queued */
+	job->args.scoring = server->cfg->scoring;
+	job->args.prune = server->cfg->prune;
+	job->args.min_score = server->cfg->min_score;
+	if (job->args.prune && qgram_reject(&job->args)) {
+		__send_done(conn, job->id, NWP_BELOW, 0);
+		nwp_frame_wipe(&job->frame);
+		free(job);
+		return;
+	}
+
+	pthread_mutex_lock(&server->lock);
+	conn->refs++;
+	job->next = server->jobs;
+	if (server->jobs) {
+		server->jobs->prev = job;
+	}
+	server->jobs = job;
+	if (server->queue_tail) {
+		server->queue_tail->next_queued = job;
+	}
+	else {
+		server->queue_head = job;
+	}
+	server->queue_tail = job;
+	server->queued++;
+	pthread_cond_signal(&server->cond);
+	pthread_mutex_unlock(&server->lock);
+}
+
+/* Cancel the jobs of `conn` with the given id, or all of them if `all` */
+static void __cancel_jobs(server_t* server, connection_t* conn,
+			  uint32_t id, int all)
+{
+	pthread_mutex_lock(&server->lock);
+	for (job_t* job = server->jobs; job; job = job->next) {
+		if (job->conn == conn && (all || job->id == id)) {
+			job->cancel = 1;
+		}
+	}
+	pthread_mutex_unlock(&server->lock);
+}
+
+static void* __reader_main(void* arg) {
+	reader_arg_t* rarg = arg;
+	server_t* server = rarg->server;
+	connection_t* conn = rarg->conn;
+	free(rarg);
+
+	nwp_frame_t frame;
+	while (nwp_recv(conn->fd, &frame) == 0) {
+		switch (frame.type) {
+		    case NWP_ALIGN:
+			__queue_align(server, conn, &frame);
+			break;
+
+		    case NWP_CANCEL:
+			__cancel_jobs(server, conn, frame.id, 0);
+			break;
+
+		    default:
+			__send_done(conn, frame.id, NWP_ERROR, 0);
+			break;
+		}
+		nwp_frame_wipe(&frame);
+	}
+
+	pthread_mutex_lock(&conn->write_lock);
+	conn->closed = 1;
+	pthread_mutex_unlock(&conn->write_lock);
+	__cancel_jobs(server, conn, 0, 1);
+
+	pthread_mutex_lock(&server->lock);
+	__connection_unlink(server, conn);
+	pthread_cond_signal(&server->readers_cond);
+	pthread_mutex_unlock(&server->lock);
+	__connection_unref(server, conn);
+
+	return NULL;
+}
+
+static int __accept_connection(server_t* server, int listen_fd) {
+	int fd = accept(listen_fd, NULL, NULL);
+	if (fd < 0) {
+		return (errno == EINTR || errno == EAGAIN) ? 0 : 1;
+	}
+
+	connection_t* conn = malloc(sizeof(connection_t));
+	reader_arg_t* rarg = malloc(sizeof(reader_arg_t));
+	if (!conn || !rarg) {
+		printf("couldn't allocate connection\n");
+		free(conn);
+		free(rarg);
+		close(fd);
+		return 0;
+	}
+	conn->fd = fd;
+	conn->refs = 1;
+	conn->closed = 0;
+	pthread_mutex_init(&conn->write_lock, NULL);
+	rarg->server = server;
+	rarg->conn = conn;
+
+	/* Linked before the reader starts, which unlinks it when it stops */
+	pthread_mutex_lock(&server->lock);
+	conn->prev = NULL;
+	conn->next = server->conns;
+	if (server->conns) {
+		server->conns->prev = conn;
+	}
+	server->conns = conn;
+	pthread_mutex_unlock(&server->lock);
+
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, &__reader_main, rarg)) {
+		printf("couldn't create connection thread\n");
+		pthread_mutex_lock(&server->lock);
+		__connection_unlink(server, conn);
+		pthread_mutex_unlock(&server->lock);
+		pthread_mutex_destroy(&conn->write_lock);
+		free(conn);
+		free(rarg);
+		close(fd);
+	}
+	pthread_attr_destroy(&attr);
+
+	return 0;
+}
+
+static int __listen(const char* path) {
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("socket path too long: %s\n", path);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		printf("couldn't create socket: %s\n", strerror(errno));
+		return -1;
+	}
+	unlink(path);
+	if (bind(fd, (struct sockaddr*) &addr, sizeof(addr))
+	||  listen(fd, 64))
+	{
+		printf("couldn't listen on %s: %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+void server_cfg_default(server_cfg_t* cfg) {
+	cfg->workers = 1;
+	cfg->matrix_cells = 1 << 20;
+	cfg->batch_max = 32;
+	cfg->batch_cells = 1 << 16;
+	cfg->cache = NULL;
+	cfg->scoring = NULL;
+	cfg->prune = 0;
+	cfg->min_score = 0;
+}
+
+int serve(const char* path, const server_cfg_t* cfg) {
+	server_t server;
+	memset(&server, 0, sizeof(server));
+	server.cfg = cfg;
+	pthread_mutex_init(&server.lock, NULL);
+	pthread_cond_init(&server.cond, NULL);
+	pthread_cond_init(&server.readers_cond, NULL);
+
+	int listen_fd = __listen(path);
+	if (listen_fd < 0) {
+		return 1;
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &__on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	worker_t* workers = malloc(cfg->workers * sizeof(worker_t));
+	if (!workers) {
+		printf("couldn't allocate workers\n");
+		goto error;
+	}
+
+	int nworkers = 0;
+	for (; nworkers < cfg->workers; nworkers++) {
+		worker_t* worker = workers + nworkers;
+		worker->server = &server;
+
+		/* Warm the matrix up now rather than on the first request */
+		if (matrix_init(&worker->move_matrix, 1, cfg->matrix_cells,
+				sizeof(char), MATRIX_ALLOC_DEFAULT,
+				MATRIX_LAYOUT_DIAGONAL))
+		{
+			goto error_workers;
+		}
+		memset(worker->move_matrix.v.v, 0, worker->move_matrix.size);
+
+		if (pthread_create(&worker->thread, NULL, &__worker_main,
+				   worker))
+		{
+			printf("couldn't create worker thread\n");
+			matrix_wipe(&worker->move_matrix);
+			goto error_workers;
+		}
+	}
+
+	VERBOSE_FMT("listening on %s with %d worker(s)\n", path, nworkers);
+	while (!__stop_requested) {
+		struct pollfd pfd = { listen_fd, POLLIN, 0 };
+		int n = poll(&pfd, 1, 200);
+		if (n > 0 && __accept_connection(&server, listen_fd)) {
+			printf("accept error: %s\n", strerror(errno));
+			break;
+		}
+	}
+	VERBOSE("stopping server\n");
+
+	int ret = 0;
+	goto stop;
+
+    error_workers:
+	ret = 1;
+    stop:
+	/* Readers use the server: wake them up and wait for them to stop,
+	 * then let the workers run what they queued, cancelled.
+	 */
+	pthread_mutex_lock(&server.lock);
+	for (connection_t* conn = server.conns; conn; conn = conn->next) {
+		shutdown(conn->fd, SHUT_RDWR);
+	}
+	while (server.conns) {
+		pthread_cond_wait(&server.readers_cond, &server.lock);
+	}
+	server.stop = 1;
+	for (job_t* job = server.jobs; job; job = job->next) {
+		job->cancel = 1;
+	}
+	pthread_cond_broadcast(&server.cond);
+	pthread_mutex_unlock(&server.lock);
+
+	for (int i = 0; i < nworkers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		matrix_wipe(&workers[i].move_matrix);
+	}
+	free(workers);
+	close(listen_fd);
+	unlink(path);
+	return ret;
+
+    error:
+	close(listen_fd);
+	unlink(path);
+	return 1;
+}
+
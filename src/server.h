@@ -0,0 +1,30 @@
+#ifndef _server_h_
+#define _server_h_
+
+#include <stddef.h>
+
+#include "cache.h"
+#include "scoring.h"
+
+/* Alignment server configuration.
+ */
+typedef struct server_cfg {
+	int	workers;	/* number of worker threads */
+	size_t	matrix_cells;	/* move matrix cells preallocated per worker */
+	int	batch_max;	/* max small requests run by a worker at once */
+	size_t	batch_cells;	/* a request is small below this many cells */
+	cache_t* cache;		/* results cache, can be NULL */
+	const scoring_t* scoring;	/* the historical one if NULL */
+	int	prune;		/* reject requests below min_score */
+	int	min_score;
+} server_cfg_t;
+
+void server_cfg_default(server_cfg_t* cfg);
+
+/* Listen on the unix socket `path` and serve alignment requests (see
+ * protocol.h) until SIGINT or SIGTERM.
+ */
+int serve(const char* path, const server_cfg_t* cfg);
+
+#endif
+
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "stream.h"
+
+static void __publish(stream_t* s, int available, int error) {
+	pthread_mutex_lock(&s->lock);
+	__atomic_store_n(&s->available, available, __ATOMIC_RELEASE);
+	s->error = error;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+}
+
+static void* __reader(void* arg) {
+	stream_t* s = arg;
+	int done = 0;
+
+	while (done < s->len) {
+		ssize_t n = read(s->fd, s->buf + done,
+				 min(s->len - done, STREAM_CHUNK));
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			__publish(s, done, 1);
+			return NULL;
+		}
+		done += n;
+		__publish(s, done, 0);
+	}
+	return NULL;
+}
+
+int stream_open(stream_t* s, const char* path, int len) {
+	memset(s, 0, sizeof(*s));
+
+	s->fd = open(path, O_RDONLY);
+	if (s->fd < 0) {
+		printf("couldn't open sequence file %s\n", path);
+		return 1;
+	}
+	if (len < 0) {
+		struct stat st;
+		if (fstat(s->fd, &st) || !S_ISREG(st.st_mode)) {
+			printf("%s isn't a regular file, its length is needed "
+			       "(--lengths)\n", path);
+			goto error;
+		}
+		if (st.st_size > INT_MAX) {
+			printf("sequence file %s is too long\n", path);
+			goto error;
+		}
+		len = st.st_size;
+	}
+
+	s->len = len;
+	s->buf = malloc(len + 1);
+	if (!s->buf) {
+		printf("couldn't allocate sequence\n");
+		goto error;
+	}
+	s->buf[len] = '\0';
+
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	if (pthread_create(&s->thread, NULL, __reader, s)) {
+		printf("couldn't start sequence reader\n");
+		pthread_mutex_destroy(&s->lock);
+		pthread_cond_destroy(&s->cond);
+		free(s->buf);
+		goto error;
+	}
+	s->running = 1;
+	return 0;
+
+    error:
+	close(s->fd);
+	return 1;
+}
+
+int stream_wait(stream_t* s, int n) {
+	if (__atomic_load_n(&s->available, __ATOMIC_ACQUIRE) >= n) {
+		return 0;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	while (s->available < n && !s->error) {
+		pthread_cond_wait(&s->cond, &s->lock);
+	}
+	int ret = s->available < n;
+	pthread_mutex_unlock(&s->lock);
+	return ret;
+}
+
+int stream_close(stream_t* s) {
+	if (!s->running) {
+		return s->error;
+	}
+	pthread_join(s->thread, NULL);
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->cond);
+	close(s->fd);
+	s->running = 0;
+	return s->error;
+}
+
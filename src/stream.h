@@ -0,0 +1,43 @@
+#ifndef _stream_h_
+#define _stream_h_
+
+#include <pthread.h>
+
+/* Streamed sequence files.
+ *
+ * A reader thread fills the sequence buffer by chunks, publishing how many
+ * characters are available, so that the algorithm starts before the files
+ * are loaded: diagonal d only needs the first d characters of each
+ * sequence (see `nw`). Lengths are the file sizes, or are given for pipes.
+ */
+
+#define STREAM_CHUNK	(1 << 20)
+
+typedef struct stream {
+	char*		buf;		/* len + 1 characters, kept on close */
+	int		len;
+	int		available;	/* atomic, readable characters */
+	int		error;		/* the file ended or failed early */
+
+	int		fd;
+	pthread_t	thread;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	int		running;
+} stream_t;
+
+/* Start reading `len` characters of `path`, the whole file if negative */
+int stream_open(stream_t* s, const char* path, int len);
+
+/* Wait until the first `n` characters are available.
+ * Returns non zero if they never will be.
+ */
+int stream_wait(stream_t* s, int n);
+
+/* Wait for the reader to finish, returns non zero if the file was short.
+ * The buffer stays, to be freed by the caller.
+ */
+int stream_close(stream_t* s);
+
+#endif
+
@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+#include "common.h"
+#include "striped.h"
+
+#ifdef __SSE2__
+
+static inline __m128i __max_epi32(__m128i a, __m128i b) {
+#ifdef __SSE4_1__
+	return _mm_max_epi32(a, b);
+#else
+	__m128i gt = _mm_cmpgt_epi32(a, b);
+	return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+#endif
+}
+
+#define KERNEL(f)	f##_16
+#define ELEM		int16_t
+#define LANES		8
+#define LANE_NONE	INT16_MIN
+#define VADD(a, b)	_mm_adds_epi16(a, b)
+#define VMAX(a, b)	_mm_max_epi16(a, b)
+#define VCMPGT(a, b)	_mm_cmpgt_epi16(a, b)
+#define VSET1(x)	_mm_set1_epi16(x)
+#include "striped_kernel.h"
+
+#define KERNEL(f)	f##_32
+#define ELEM		int32_t
+#define LANES		4
+#define LANE_NONE	SCORE_NONE
+#define VADD(a, b)	_mm_add_epi32(a, b)
+#define VMAX(a, b)	__max_epi32(a, b)
+#define VCMPGT(a, b)	_mm_cmpgt_epi32(a, b)
+#define VSET1(x)	_mm_set1_epi32(x)
+#include "striped_kernel.h"
+
+/* Returns 1 if some state of the alignment may leave int16. Every case
+ * is above the path of two gaps, and below the one of best substitutions
+ * only.
+ */
+static int __needs_wide(const score_alphabet_t* ab, const scoring_t* sc,
+			int len_a, int len_b)
+{
+	if (sc->gap_open > 0 || sc->gap_extend > 0) {
+		return 1;
+	}
+
+	int worst = 0;
+	int best = 0;
+	for (int a = 0; a < ab->size; a++) {
+		for (int b = 0; b < ab->size; b++) {
+			int s = scoring_substitute(sc, ab->chars[a],
+						   ab->chars[b]);
+			worst = min(worst, s);
+			best = max(best, s);
+		}
+	}
+
+	long long open = sc->gap_open + sc->gap_extend;
+	long long low = 2LL * sc->gap_open
+		      + (long long) (len_a + len_b) * sc->gap_extend
+		      + open + sc->gap_extend + worst;
+	long long high = (long long) (min(len_a, len_b) + 1) * best;
+	return low <= INT16_MIN + 1 || high >= INT16_MAX;
+}
+
+int striped_profile_init(striped_profile_t* p, const score_alphabet_t* ab,
+			 const scoring_t* sc, const char* query, int len,
+			 int max_subject)
+{
+	memset(p, 0, sizeof(*p));
+	p->len = len;
+	p->size = ab->size;
+	p->wide = __needs_wide(ab, sc, len, max_subject);
+
+	int lanes = p->wide ? 4 : 8;
+	p->seg = (len + lanes - 1) / lanes;
+	if (posix_memalign(&p->rows, sizeof(__m128i),
+			   max((size_t) p->size * p->seg, 1) * sizeof(__m128i)))
+	{
+		printf("couldn't allocate query profile\n");
+		p->rows = NULL;
+		return 1;
+	}
+
+	if (p->wide) {
+		__profile_32(p, ab, sc, query);
+	}
+	else {
+		__profile_16(p, ab, sc, query);
+	}
+	return 0;
+}
+
+void* striped_buffer(const striped_profile_t* p) {
+	void* buf;
+	if (posix_memalign(&buf, sizeof(__m128i),
+			   max(3 * (size_t) p->seg, 1) * sizeof(__m128i)))
+	{
+		return NULL;
+	}
+	return buf;
+}
+
+void striped_first_column(const striped_profile_t* p, const scoring_t* sc,
+			  void* buf)
+{
+	if (p->wide) {
+		__first_column_32(p, sc, buf);
+	}
+	else {
+		__first_column_16(p, sc, buf);
+	}
+}
+
+void striped_columns(const striped_profile_t* p, const scoring_t* sc,
+		     const uint8_t* subject, int first, int last, void* buf)
+{
+	if (p->len == 0) {
+		return;
+	}
+	if (p->wide) {
+		__columns_32(p, sc, subject, first, last, buf);
+	}
+	else {
+		__columns_16(p, sc, subject, first, last, buf);
+	}
+}
+
+int striped_score(const striped_profile_t* p, const scoring_t* sc, int j,
+		  const void* buf)
+{
+	if (p->len == 0) {
+		return scoring_gap(sc, j);
+	}
+	return p->wide ? __score_32(p, j, buf) : __score_16(p, j, buf);
+}
+
+#else
+
+/* Without SSE2, the scalar profile stands for the striped one: buffers
+ * are its rows of H and F.
+ */
+int striped_profile_init(striped_profile_t* p, const score_alphabet_t* ab,
+			 const scoring_t* sc, const char* query, int len,
+			 int max_subject)
+{
+	memset(p, 0, sizeof(*p));
+	p->len = len;
+	p->size = ab->size;
+	p->wide = 1;
+	return score_profile_init(&p->scalar, ab, sc, query, len);
+}
+
+void* striped_buffer(const striped_profile_t* p) {
+	return malloc(2 * (p->len + 1) * sizeof(int));
+}
+
+void striped_first_column(const striped_profile_t* p, const scoring_t* sc,
+			  void* buf)
+{
+	int* h = buf;
+	score_profile_first_row(&p->scalar, sc, h, h + p->len + 1);
+}
+
+void striped_columns(const striped_profile_t* p, const scoring_t* sc,
+		     const uint8_t* subject, int first, int last, void* buf)
+{
+	int* h = buf;
+	int* f = h + p->len + 1;
+	for (int j = first; j < last; j++) {
+		score_profile_row(&p->scalar, sc, subject[j - 1], j, h, f, h,
+				  f);
+	}
+}
+
+int striped_score(const striped_profile_t* p, const scoring_t* sc, int j,
+		  const void* buf)
+{
+	const int* h = buf;
+	return h[p->len];
+}
+
+#endif
+
+void striped_profile_wipe(striped_profile_t* p) {
+	free(p->rows);
+	p->rows = NULL;
+	score_profile_wipe(&p->scalar);
+}
+
+int striped_align(const striped_profile_t* p, const scoring_t* sc,
+		  const uint8_t* subject, int len, void* buf)
+{
+	striped_first_column(p, sc, buf);
+	striped_columns(p, sc, subject, 1, len + 1, buf);
+	return striped_score(p, sc, len, buf);
+}
+
+int nw_striped(const algo_arg_t* args, algo_res_t* res,
+	       matrix_t* move_matrix)
+{
+	const scoring_t* sc = args->scoring ? args->scoring : &scoring_default;
+	score_alphabet_t ab;
+	striped_profile_t p;
+	uint8_t* codes = NULL;
+	void* buf = NULL;
+	int ret = ALGO_ERROR;
+
+	if (score_check_scoring(sc)) {
+		printf("substitution scores must fit in 16 bits\n");
+		return ALGO_ERROR;
+	}
+
+	score_alphabet_init(&ab);
+	score_alphabet_add(&ab, args->seq_a, args->len_a);
+	score_alphabet_add(&ab, args->seq_b, args->len_b);
+	memset(&p, 0, sizeof(p));
+	codes = malloc(max(args->len_b, 1));
+	if (!codes) {
+		printf("couldn't allocate encoded sequence\n");
+		goto end;
+	}
+	score_encode(&ab, args->seq_b, args->len_b, codes);
+
+	if (striped_profile_init(&p, &ab, sc, args->seq_a, args->len_a,
+				 args->len_b))
+	{
+		goto end;
+	}
+	VERBOSE_FMT("%d-bit lanes, %d vectors per column\n",
+		    p.wide ? 32 : 16, p.seg);
+	buf = striped_buffer(&p);
+	if (!buf) {
+		printf("couldn't allocate score columns\n");
+		goto end;
+	}
+
+	striped_first_column(&p, sc, buf);
+	for (int j = 1; j <= args->len_b; j += STRIPED_ABORT_COLUMNS) {
+		int abort = algo_should_abort(args);
+		if (abort != ALGO_OK) {
+			ret = abort;
+			goto end;
+		}
+		striped_columns(&p, sc, codes, j,
+				min(j + STRIPED_ABORT_COLUMNS,
+				    args->len_b + 1), buf);
+	}
+	res->score = striped_score(&p, sc, args->len_b, buf);
+	res->count = 0;
+	res->alignments = NULL;
+	ret = ALGO_OK;
+
+    end:
+	striped_profile_wipe(&p);
+	free(codes);
+	free(buf);
+	return ret;
+}
+
+
+#ifdef TEST
+
+#include "matrix.h"
+
+int verbose = 0;
+
+/* Striped scores of random pairs are the ones of `nw`, for lengths around
+ * the switch from 16-bit to 32-bit lanes of the scoring.
+ */
+int test_scores(const scoring_t* sc, const char* name, int max_len) {
+	char a[max_len];
+	char b[max_len];
+	int lanes[2] = { 0, 0 };
+
+	for (int i = 0; i < 400; i++) {
+		int len_a = 1 + rand() % max_len;
+		int len_b = 1 + rand() % max_len;
+		for (int k = 0; k < max(len_a, len_b); k++) {
+			a[k] = "ACGT"[rand() % 4];
+			b[k] = (rand() % 4) ? a[k] : "ACGT"[rand() % 4];
+		}
+
+		algo_arg_t args;
+		memset(&args, 0, sizeof(args));
+		args.seq_a = a;
+		args.seq_b = b;
+		args.len_a = len_a;
+		args.len_b = len_b;
+		args.scoring = sc;
+
+		matrix_t m;
+		algo_res_t ref;
+		algo_res_t res;
+		memset(&ref, 0, sizeof(ref));
+		memset(&res, 0, sizeof(res));
+		if (matrix_init(&m, len_a + 1, len_b + 1, sizeof(char),
+				MATRIX_ALLOC_DEFAULT, MATRIX_LAYOUT_DIAGONAL)
+		||  nw(&args, &ref, &m) != ALGO_OK
+		||  nw_striped(&args, &res, NULL) != ALGO_OK)
+		{
+			printf("couldn't align %d x %d characters\n",
+			       len_a, len_b);
+			return 1;
+		}
+		matrix_wipe(&m);
+
+		if (res.score != ref.score) {
+			printf("striped error with %s scoring: %.*s %.*s "
+			       "score %d, nw %d\n", name, len_a, a, len_b, b,
+			       res.score, ref.score);
+			return 1;
+		}
+
+		score_alphabet_t ab;
+		striped_profile_t p;
+		score_alphabet_init(&ab);
+		score_alphabet_add(&ab, a, len_a);
+		score_alphabet_add(&ab, b, len_b);
+		if (striped_profile_init(&p, &ab, sc, a, len_a, len_b)) {
+			return 1;
+		}
+		lanes[p.wide] = 1;
+		striped_profile_wipe(&p);
+	}
+
+	if (!lanes[0] || !lanes[1]) {
+		printf("%s scoring only used %s lanes\n", name,
+		       lanes[0] ? "16-bit" : "32-bit");
+		return 1;
+	}
+	printf("striped scores of %s scoring are OK\n", name);
+	return 0;
+}
+
+int main(void) {
+	/* Gap penalties or matches large enough to leave int16 within a
+	 * hundred characters.
+	 */
+	scoring_t gaps = scoring_default;
+	gaps.match = 3;
+	gaps.mismatch = -400;
+	gaps.gap_extend = -400;
+	scoring_t affine = gaps;
+	affine.gap_open = -300;
+	affine.gap_extend = -200;
+	scoring_t matches = scoring_default;
+	matches.match = 600;
+	matches.mismatch = -2;
+	matches.gap_extend = -2;
+
+	srand(1);
+	return test_scores(&gaps, "linear", 100)
+	    || test_scores(&affine, "affine", 100)
+	    || test_scores(&matches, "match", 100);
+}
+
+#endif
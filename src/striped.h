@@ -0,0 +1,72 @@
+#ifndef _striped_h_
+#define _striped_h_
+
+#include <stdint.h>
+
+#include "common.h"
+#include "score.h"
+
+/* Striped score-only Needleman-Wunsch (Farrar).
+ *
+ * The query is cut in as many segments as a vector has lanes, vector k of
+ * a column holding row k of every segment. The query profile is laid out
+ * the same way, so a subject character costs `seg` aligned loads and
+ * vector operations, lanes being independent. Vertical gaps crossing from
+ * a segment to the next are missed by that pass: the lazy-F loop then
+ * carries them over, usually for a few vectors only.
+ *
+ * Lanes hold 16-bit scores (8 lanes) when the lengths and the scoring keep
+ * them within int16, 32-bit ones (4 lanes) otherwise. Without SSE2, the
+ * scalar profile of score.h is used.
+ */
+
+/* Columns computed between checks of the abort conditions */
+#define STRIPED_ABORT_COLUMNS	256
+
+typedef struct striped_profile {
+	int		len;		/* query length */
+	int		seg;		/* vectors per column */
+	int		wide;		/* 32-bit lanes */
+	int		size;		/* alphabet size */
+	void*		rows;		/* size rows of seg vectors */
+	score_profile_t	scalar;		/* without SSE2 */
+} striped_profile_t;
+
+/* Profile of `query`, for subjects of up to `max_subject` characters */
+int striped_profile_init(striped_profile_t* p, const score_alphabet_t* ab,
+			 const scoring_t* sc, const char* query, int len,
+			 int max_subject);
+
+void striped_profile_wipe(striped_profile_t* p);
+
+/* Columns of a run, one buffer per thread. Freed with free(). */
+void* striped_buffer(const striped_profile_t* p);
+
+/* Column 0 of the recurrences, in `buf` */
+void striped_first_column(const striped_profile_t* p, const scoring_t* sc,
+			  void* buf);
+
+/* Columns [first, last) of the encoded subject, `first` being 1 or the
+ * `last` of the previous call.
+ */
+void striped_columns(const striped_profile_t* p, const scoring_t* sc,
+		     const uint8_t* subject, int first, int last, void* buf);
+
+/* Score of the last row, in the column `j` computed last */
+int striped_score(const striped_profile_t* p, const scoring_t* sc, int j,
+		  const void* buf);
+
+/* Score of the global alignment of the profiled query with the encoded
+ * subject.
+ */
+int striped_align(const striped_profile_t* p, const scoring_t* sc,
+		  const uint8_t* subject, int len, void* buf);
+
+/* The algorithm. It only computes the score (ALGO_SCORE_ONLY), and
+ * doesn't use `move_matrix`.
+ */
+int nw_striped(const algo_arg_t* args, algo_res_t* res,
+	       matrix_t* move_matrix);
+
+#endif
+
@@ -0,0 +1,148 @@
+/* Striped kernel template, included by striped.c once per lane width.
+ *
+ * No include guard: the including file defines
+ *	KERNEL(f)	suffixes the names of the generated functions
+ *	ELEM		score type of a lane
+ *	LANES		lanes of a vector
+ *	LANE_NONE	score of unreachable states
+ *	VADD(a, b)	lanes additions, saturated if the width allows it
+ *	VMAX(a, b)	lanes maximums
+ *	VCMPGT(a, b)	lanes comparisons
+ *	VSET1(x)	vector of x in every lane
+ * and gets __shift, __profile, __first_column, __columns and __score
+ * specialized for them. Macros are undefined at the end of this file.
+ */
+
+/* The lanes of `v` moved up by one, `first` entering lane 0 */
+static inline __m128i KERNEL(__shift)(__m128i v, ELEM first) {
+	uint32_t bits = (uint32_t) first
+		      & (uint32_t) ((1ULL << (8 * sizeof(ELEM))) - 1);
+	return _mm_or_si128(_mm_slli_si128(v, sizeof(ELEM)),
+			    _mm_cvtsi32_si128(bits));
+}
+
+/* Lane l of vector k of a row is the score of query[l * seg + k], 0 past
+ * the end of the query.
+ */
+static void KERNEL(__profile)(striped_profile_t* p,
+			      const score_alphabet_t* ab,
+			      const scoring_t* sc, const char* query)
+{
+	ELEM* row = p->rows;
+	for (int c = 0; c < p->size; c++) {
+		for (int k = 0; k < p->seg; k++) {
+			for (int l = 0; l < LANES; l++) {
+				int i = l * p->seg + k;
+				*row++ = (i < p->len)
+				       ? scoring_substitute(sc, query[i],
+							    ab->chars[c])
+				       : 0;
+			}
+		}
+	}
+}
+
+/* Buffers are the H columns of even and odd subject positions, and the E
+ * states (horizontal gaps) entering the next column.
+ */
+static void KERNEL(__first_column)(const striped_profile_t* p,
+				   const scoring_t* sc, __m128i* buf)
+{
+	int seg = p->seg;
+	__m128i* h = buf;
+	__m128i* e = buf + 2 * seg;
+	__m128i v_open = VSET1(sc->gap_open + sc->gap_extend);
+	ELEM lanes[LANES];
+
+	for (int k = 0; k < seg; k++) {
+		for (int l = 0; l < LANES; l++) {
+			int i = l * seg + k + 1;
+			lanes[l] = (i <= p->len) ? scoring_gap(sc, i)
+						 : LANE_NONE;
+		}
+		h[k] = _mm_loadu_si128((const __m128i*) lanes);
+		e[k] = VADD(h[k], v_open);
+	}
+}
+
+static void KERNEL(__columns)(const striped_profile_t* p,
+			      const scoring_t* sc, const uint8_t* subject,
+			      int first, int last, __m128i* buf)
+{
+	int seg = p->seg;
+	int open = sc->gap_open + sc->gap_extend;
+	__m128i* e = buf + 2 * seg;
+	__m128i v_open = VSET1(open);
+	__m128i v_ext = VSET1(sc->gap_extend);
+	__m128i v_none = VSET1(LANE_NONE);
+
+	for (int j = first; j < last; j++) {
+		const __m128i* prof = (const __m128i*) p->rows
+				    + (size_t) subject[j - 1] * seg;
+		const __m128i* h_prev = buf + ((j - 1) & 1) * seg;
+		__m128i* h = buf + (j & 1) * seg;
+
+		/* The diagonal case of lane l is the last row of lane l - 1,
+		 * the first row for lane 0. Vertical gaps only start from the
+		 * first row in lane 0, the other lanes are left to lazy-F.
+		 */
+		__m128i v_h = KERNEL(__shift)(h_prev[seg - 1],
+					      scoring_gap(sc, j - 1));
+		__m128i v_f = KERNEL(__shift)(v_none,
+					      scoring_gap(sc, j) + open);
+
+		for (int k = 0; k < seg; k++) {
+			v_h = VADD(v_h, prof[k]);
+			v_h = VMAX(v_h, e[k]);
+			v_h = VMAX(v_h, v_f);
+			h[k] = v_h;
+
+			v_h = VADD(v_h, v_open);
+			e[k] = VMAX(VADD(e[k], v_ext), v_h);
+			v_f = VMAX(VADD(v_f, v_ext), v_h);
+			v_h = h_prev[k];
+		}
+
+		/* Lazy-F: the gaps leaving a lane go on in the next one, as
+		 * long as they beat what the cases already had.
+		 */
+		for (int l = 0; l < LANES; l++) {
+			int k;
+			v_f = KERNEL(__shift)(v_f, LANE_NONE);
+			for (k = 0; k < seg; k++) {
+				__m128i v_old = h[k];
+				h[k] = VMAX(v_old, v_f);
+				e[k] = VMAX(e[k], VADD(h[k], v_open));
+				v_f = VADD(v_f, v_ext);
+				if (!_mm_movemask_epi8(VCMPGT(v_f,
+							      VADD(v_old,
+								   v_open))))
+				{
+					break;
+				}
+			}
+			if (k < seg) {
+				break;
+			}
+		}
+	}
+}
+
+static int KERNEL(__score)(const striped_profile_t* p, int j,
+			   const __m128i* buf)
+{
+	ELEM lanes[LANES];
+	int i = p->len - 1;
+
+	_mm_storeu_si128((__m128i*) lanes, buf[(j & 1) * p->seg + i % p->seg]);
+	return lanes[i / p->seg];
+}
+
+#undef KERNEL
+#undef ELEM
+#undef LANES
+#undef LANE_NONE
+#undef VADD
+#undef VMAX
+#undef VCMPGT
+#undef VSET1
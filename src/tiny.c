@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "scoring.h"
+#include "tiny.h"
+
+/* Traceback states */
+enum {
+	ST_H,
+	ST_E,
+	ST_F,
+};
+
+/* Follows the moves of `compute_alignments` for its first alignment: the
+ * first way out of each case in the order vertical gap opening, horizontal
+ * gap opening, diagonal, vertical and horizontal gap extensions.
+ */
+static void __traceback(const algo_arg_t* args,
+			char moves[TINY_MAX + 1][TINY_MAX + 1],
+			tiny_alignment_t* al)
+{
+	char up[2 * TINY_MAX];
+	char down[2 * TINY_MAX];
+	int x = args->len_a;
+	int y = args->len_b;
+	int state = ST_H;
+	int n = 0;
+
+	while (x > 0 || y > 0) {
+		char move = moves[y][x];
+		int top = 0;
+		int left = 0;
+		int diag = 0;
+		if (state == ST_H) {
+			if (move & MOVE_TOP) {
+				top = move & (MOVE_F_OPEN | MOVE_F_EXT);
+				top = top ? top : MOVE_F_OPEN;
+			}
+			if (move & MOVE_LEFT) {
+				left = move & (MOVE_E_OPEN | MOVE_E_EXT);
+				left = left ? left : MOVE_E_OPEN;
+			}
+			diag = move & MOVE_TOP_LEFT;
+		}
+		else if (state == ST_F) {
+			top = move & (MOVE_F_OPEN | MOVE_F_EXT);
+		}
+		else {
+			left = move & (MOVE_E_OPEN | MOVE_E_EXT);
+		}
+
+		if (top & MOVE_F_OPEN) {
+			up[n] = '-';
+			down[n] = args->seq_b[--y];
+			state = ST_H;
+		}
+		else if (left & MOVE_E_OPEN) {
+			up[n] = args->seq_a[--x];
+			down[n] = '-';
+			state = ST_H;
+		}
+		else if (diag) {
+			up[n] = args->seq_a[--x];
+			down[n] = args->seq_b[--y];
+			state = ST_H;
+		}
+		else if (top) {
+			up[n] = '-';
+			down[n] = args->seq_b[--y];
+			state = ST_F;
+		}
+		else {
+			up[n] = args->seq_a[--x];
+			down[n] = '-';
+			state = ST_E;
+		}
+		n++;
+	}
+
+	al->len = n;
+	for (int i = 0; i < n; i++) {
+		al->up[i] = up[n - 1 - i];
+		al->down[i] = down[n - 1 - i];
+	}
+	al->up[n] = '\0';
+	al->down[n] = '\0';
+}
+
+/* Gotoh recurrences by rows of seq_b, with the boundaries and the moves of
+ * the kernels of `nw`. Linear gaps are the case of a zero gap_open.
+ */
+int tiny_align(const algo_arg_t* args, tiny_alignment_t* al) {
+	const scoring_t* sc = args->scoring ? args->scoring : &scoring_default;
+	char moves[TINY_MAX + 1][TINY_MAX + 1];
+	int rows[2][3][TINY_MAX + 1];
+	int open = sc->gap_open + sc->gap_extend;
+	int ext = sc->gap_extend;
+
+	int* h = rows[0][0];
+	int* e = rows[0][1];
+	int* f = rows[0][2];
+	for (int x = 0; x <= args->len_a; x++) {
+		h[x] = scoring_gap(sc, x);
+		e[x] = h[x];
+		f[x] = SCORE_NONE;
+		moves[0][x] = MOVE_LEFT | ((x == 1) ? MOVE_E_OPEN : MOVE_E_EXT);
+	}
+
+	for (int y = 1; y <= args->len_b; y++) {
+		const int* h_prev = rows[(y - 1) & 1][0];
+		const int* f_prev = rows[(y - 1) & 1][2];
+		char b = args->seq_b[y - 1];
+		h = rows[y & 1][0];
+		e = rows[y & 1][1];
+		f = rows[y & 1][2];
+
+		h[0] = scoring_gap(sc, y);
+		e[0] = SCORE_NONE;
+		f[0] = h[0];
+		moves[y][0] = MOVE_TOP | ((y == 1) ? MOVE_F_OPEN : MOVE_F_EXT);
+
+		for (int x = 1; x <= args->len_a; x++) {
+			int diag = h_prev[x - 1]
+				 + scoring_substitute(sc, args->seq_a[x - 1], b);
+			int e_open = h[x - 1] + open;
+			int e_ext = e[x - 1] + ext;
+			int f_open = h_prev[x] + open;
+			int f_ext = f_prev[x] + ext;
+			int ex = max(e_open, e_ext);
+			int fx = max(f_open, f_ext);
+			int best = max(diag, max(ex, fx));
+
+			h[x] = best;
+			e[x] = ex;
+			f[x] = fx;
+			moves[y][x] = (fx == best) * MOVE_TOP
+				    | (ex == best) * MOVE_LEFT
+				    | (diag == best) * MOVE_TOP_LEFT
+				    | (ex == e_open) * MOVE_E_OPEN
+				    | (ex == e_ext) * MOVE_E_EXT
+				    | (fx == f_open) * MOVE_F_OPEN
+				    | (fx == f_ext) * MOVE_F_EXT;
+		}
+	}
+
+	if (al) {
+		__traceback(args, moves, al);
+	}
+	return h[args->len_a];
+}
+
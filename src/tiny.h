@@ -0,0 +1,45 @@
+#ifndef _tiny_h_
+#define _tiny_h_
+
+#include "common.h"
+#include "alignment.h"
+
+/* Alignment of tiny pairs (primers, barcodes).
+ *
+ * For a few thousand cases, setting up `nw` (move matrix mapping, score
+ * diagonals, alignment tree nodes) costs far more than the recurrences.
+ * Pairs of at most TINY_MAX characters are instead aligned in arrays of
+ * the stack sized at compile time, row by row, and their best alignment is
+ * traced back directly into the caller's buffers: no allocation at all.
+ *
+ * Scores and moves are the ones of `nw`, and the alignment is the first
+ * one `compute_alignments` would give, so the iterative and parallelized
+ * algorithms take this path for tiny pairs whenever a single alignment (or
+ * none) is asked for.
+ */
+
+#define TINY_MAX	64
+
+typedef struct tiny_alignment {
+	int	len;
+	char	up[2 * TINY_MAX + 1];
+	char	down[2 * TINY_MAX + 1];
+} tiny_alignment_t;
+
+static inline int tiny_fits(const algo_arg_t* args) {
+	return args->len_a <= TINY_MAX && args->len_b <= TINY_MAX;
+}
+
+/* Score of the alignment of the sequences of `args`, which must fit, and
+ * its best alignment in `al` if not NULL.
+ */
+int tiny_align(const algo_arg_t* args, tiny_alignment_t* al);
+
+/* `al` seen as an alignment, valid as long as `al` */
+static inline alignment_t tiny_alignment(tiny_alignment_t* al) {
+	alignment_t view = { al->up, al->down, al->len + 1 };
+	return view;
+}
+
+#endif
+
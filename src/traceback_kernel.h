@@ -0,0 +1,102 @@
+/* Alignment tree template, included by alignment.c once per matrix layout.
+ *
+ * No include guard: the including file defines
+ *	KERNEL(f)		suffixes the names of the generated functions
+ *	OFFSET(m, x, y)		offset of case (x, y) in the move matrix
+ * and gets __altree_build_node specialized for them. Macros are undefined at
+ * the end of this file.
+ */
+
+/* Build a tree node, `bound` is the number of leaves we can still create */
+static altree_t* KERNEL(__altree_build_node)(const algo_arg_t* args,
+					     const matrix_t* move_matrix,
+					     int x, int y, int state,
+					     altree_t* parent,
+					     int* bound)
+{
+	if (x < 0 || y < 0 || *bound == 0) {
+		return NULL;
+	}
+
+	altree_t* node = altree_new(parent);
+	if (node == NULL) {
+		printf("error during node allocation\n");
+		return NULL;
+	}
+
+	if (x == 0 && y == 0) {
+		(*bound)--;
+		return node;
+	}
+
+	/* Ways to reach the gap states. Linear gaps have no gap state bits,
+	 * their gaps are always opened from the best score.
+	 */
+	char move = move_matrix->v.c[OFFSET(move_matrix, x, y)];
+	int top = 0;
+	int left = 0;
+	int diag = 0;
+	if (state == ST_H) {
+		if (move & MOVE_TOP) {
+			top = move & (MOVE_F_OPEN | MOVE_F_EXT);
+			top = top ? top : MOVE_F_OPEN;
+		}
+		if (move & MOVE_LEFT) {
+			left = move & (MOVE_E_OPEN | MOVE_E_EXT);
+			left = left ? left : MOVE_E_OPEN;
+		}
+		diag = move & MOVE_TOP_LEFT;
+	}
+	else if (state == ST_F) {
+		top = move & (MOVE_F_OPEN | MOVE_F_EXT);
+	}
+	else {
+		left = move & (MOVE_E_OPEN | MOVE_E_EXT);
+	}
+
+	if (top & MOVE_F_OPEN) {
+		node->up[AT_TOP]	= '-';
+		node->down[AT_TOP]	= args->seq_b[y - 1];
+		node->childs[AT_TOP]	=
+			KERNEL(__altree_build_node)(args, move_matrix,
+						    x, y - 1, ST_H,
+						    node, bound);
+	}
+	if (left & MOVE_E_OPEN) {
+		node->up[AT_LEFT]	= args->seq_a[x - 1];
+		node->down[AT_LEFT]	= '-';
+		node->childs[AT_LEFT]	=
+			KERNEL(__altree_build_node)(args, move_matrix,
+						    x - 1, y, ST_H,
+						    node, bound);
+	}
+	if (diag) {
+		node->up[AT_TOP_LEFT]	  = args->seq_a[x - 1];
+		node->down[AT_TOP_LEFT]	  = args->seq_b[y - 1];
+		node->childs[AT_TOP_LEFT] =
+			KERNEL(__altree_build_node)(args, move_matrix,
+						    x - 1, y - 1, ST_H,
+						    node, bound);
+	}
+	if (top & MOVE_F_EXT) {
+		node->up[AT_TOP_EXT]	 = '-';
+		node->down[AT_TOP_EXT]	 = args->seq_b[y - 1];
+		node->childs[AT_TOP_EXT] =
+			KERNEL(__altree_build_node)(args, move_matrix,
+						    x, y - 1, ST_F,
+						    node, bound);
+	}
+	if (left & MOVE_E_EXT) {
+		node->up[AT_LEFT_EXT]	  = args->seq_a[x - 1];
+		node->down[AT_LEFT_EXT]	  = '-';
+		node->childs[AT_LEFT_EXT] =
+			KERNEL(__altree_build_node)(args, move_matrix,
+						    x - 1, y, ST_E,
+						    node, bound);
+	}
+
+	return node;
+}
+
+#undef KERNEL
+#undef OFFSET
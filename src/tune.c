@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <omp.h>
+
+#include "common.h"
+#include "bench.h"
+#include "tune.h"
+
+/* Calibration sequences length of each class */
+static const int __class_lengths[TUNE_CLASSES] = {
+	[TUNE_SMALL]	= 512,
+	[TUNE_MEDIUM]	= 2048,
+	[TUNE_LARGE]	= 4096,
+};
+
+static const char* __class_names[TUNE_CLASSES] = {
+	[TUNE_SMALL]	= "small",
+	[TUNE_MEDIUM]	= "medium",
+	[TUNE_LARGE]	= "large",
+};
+
+static const int __cutoffs[] = { 0, 256, 1024, 4096 };
+static const int __chunks[] = { 0, 256, 1024, 4096 };
+
+void tune_params_default(tune_params_t* p) {
+	p->threads = omp_get_num_procs();
+	p->par_cutoff = 0;
+	p->omp_chunk = 0;
+	p->layout = MATRIX_LAYOUT_DIAGONAL;
+	p->nt_store = 0;
+}
+
+int tune_class(int len_a, int len_b) {
+	size_t cases = (len_a + 1) * (size_t) (len_b + 1);
+	if (cases <= (1 << 20)) {
+		return TUNE_SMALL;
+	}
+	if (cases <= (16 << 20)) {
+		return TUNE_MEDIUM;
+	}
+	return TUNE_LARGE;
+}
+
+/* Model name of the first cpu, without tabs */
+static void __cpu_model(char* model, size_t size) {
+	char line[512];
+	snprintf(model, size, "unknown");
+
+	FILE* f = fopen("/proc/cpuinfo", "r");
+	if (!f) {
+		return;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		char* colon = strchr(line, ':');
+		if (strncmp(line, "model name", 10) || !colon) {
+			continue;
+		}
+		snprintf(model, size, "%s", colon + 1 + (colon[1] == ' '));
+		model[strcspn(model, "\n")] = '\0';
+		for (char* c = model; *c; c++) {
+			*c = (*c == '\t') ? ' ' : *c;
+		}
+		break;
+	}
+	fclose(f);
+}
+
+/* Path of the tuning file, its directories being created if `create` */
+static int __tune_path(char* path, size_t size, int create) {
+	const char* xdg = getenv("XDG_CACHE_HOME");
+	const char* home = getenv("HOME");
+	int n;
+
+	if (xdg && xdg[0]) {
+		n = snprintf(path, size, "%s", xdg);
+	}
+	else if (home && home[0]) {
+		n = snprintf(path, size, "%s/.cache", home);
+	}
+	else {
+		return 1;
+	}
+	if (n >= size) {
+		return 1;
+	}
+	if (create && mkdir(path, 0755) && errno != EEXIST) {
+		return 1;
+	}
+
+	n += snprintf(path + n, size - n, "/nw");
+	if (n >= size) {
+		return 1;
+	}
+	if (create && mkdir(path, 0755) && errno != EEXIST) {
+		return 1;
+	}
+	return snprintf(path + n, size - n, "/tune") >= size - n;
+}
+
+/* Parse a line of the tuning file, returns non zero if it isn't one of
+ * this machine.
+ */
+static int __parse_line(const char* line, const char* model, int cpus,
+			int* class, tune_params_t* p)
+{
+	const char* tab = strchr(line, '\t');
+	if (!tab || tab - line != strlen(model)
+	||  strncmp(line, model, tab - line))
+	{
+		return 1;
+	}
+
+	int line_cpus;
+	char layout[32];
+	if (sscanf(tab + 1, "%d\t%d\t%d %d %d %31s %d", &line_cpus, class,
+		   &p->threads, &p->par_cutoff, &p->omp_chunk, layout,
+		   &p->nt_store) != 7
+	||  line_cpus != cpus || *class < 0 || *class >= TUNE_CLASSES)
+	{
+		return 1;
+	}
+	p->layout = matrix_find_layout(layout);
+	return p->layout < 0 || p->threads < 1;
+}
+
+int tune_load(int class, tune_params_t* p) {
+	char path[512];
+	char model[256];
+	char line[512];
+	int found = 0;
+
+	if (__tune_path(path, sizeof(path), 0)) {
+		return 1;
+	}
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		return 1;
+	}
+	__cpu_model(model, sizeof(model));
+	while (!found && fgets(line, sizeof(line), f)) {
+		int line_class;
+		tune_params_t params;
+		if (!__parse_line(line, model, omp_get_num_procs(), &line_class,
+				  &params) && line_class == class)
+		{
+			*p = params;
+			found = 1;
+		}
+	}
+	fclose(f);
+	return !found;
+}
+
+/* Replace the lines of this machine in the tuning file */
+static int __save(const tune_params_t params[TUNE_CLASSES]) {
+	char path[512];
+	char tmp[520];
+	char model[256];
+	char line[512];
+	int cpus = omp_get_num_procs();
+
+	if (__tune_path(path, sizeof(path), 1)) {
+		printf("couldn't create the tuning file directory\n");
+		return 1;
+	}
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	__cpu_model(model, sizeof(model));
+
+	FILE* out = fopen(tmp, "w");
+	if (!out) {
+		printf("couldn't open %s\n", tmp);
+		return 1;
+	}
+	FILE* in = fopen(path, "r");
+	while (in && fgets(line, sizeof(line), in)) {
+		int class;
+		tune_params_t p;
+		if (__parse_line(line, model, cpus, &class, &p)) {
+			fputs(line, out);
+		}
+	}
+	if (in) {
+		fclose(in);
+	}
+	for (int c = 0; c < TUNE_CLASSES; c++) {
+		const tune_params_t* p = params + c;
+		fprintf(out, "%s\t%d\t%d\t%d %d %d %s %d\n", model, cpus, c,
+			p->threads, p->par_cutoff, p->omp_chunk,
+			matrix_layout_names[p->layout], p->nt_store);
+	}
+	if (fclose(out) || rename(tmp, path)) {
+		printf("couldn't write %s\n", path);
+		unlink(tmp);
+		return 1;
+	}
+	printf("saved in %s\n", path);
+	return 0;
+}
+
+/* Best time of the candidate, -1 on error */
+static double __time(const algo_arg_t* sample, const tune_params_t* p) {
+	algo_arg_t args = *sample;
+	args.par_cutoff = p->par_cutoff;
+	args.omp_chunk = p->omp_chunk;
+	args.nt_store = p->nt_store;
+	omp_set_num_threads(p->threads);
+
+	double best = -1;
+	for (int r = 0; r < TUNE_REPEAT; r++) {
+		matrix_t m;
+		algo_res_t res;
+		bench_t b;
+		if (matrix_init(&m, args.len_a + 1, args.len_b + 1,
+				sizeof(char), MATRIX_ALLOC_DEFAULT, p->layout))
+		{
+			printf("couldn't allocate move matrix\n");
+			return -1;
+		}
+		memset(&res, 0, sizeof(res));
+
+		/* The kernel doesn't report the progression of each run */
+		int saved_verbose = verbose;
+		verbose = 0;
+		bench_start(&b, "tune");
+		int ret = (p->threads > 1) ? nw_omp(&args, &res, &m)
+					   : nw(&args, &res, &m);
+		bench_end(&b);
+		verbose = saved_verbose;
+		matrix_wipe(&m);
+		if (ret != ALGO_OK) {
+			return -1;
+		}
+		if (best < 0 || bench_diff_s(&b) < best) {
+			best = bench_diff_s(&b);
+		}
+	}
+	VERBOSE_FMT("threads %d cutoff %d chunk %d %s%s: %f s\n",
+		    p->threads, p->par_cutoff, p->omp_chunk,
+		    matrix_layout_names[p->layout],
+		    p->nt_store ? " nt-store" : "", best);
+	return best;
+}
+
+/* Time a candidate, keeping it if it beats the best one */
+static int __try(const algo_arg_t* sample, const tune_params_t* cand,
+		 tune_params_t* best, double* best_s)
+{
+	double s = __time(sample, cand);
+	if (s < 0) {
+		return 1;
+	}
+	if (*best_s < 0 || s < *best_s) {
+		*best = *cand;
+		*best_s = s;
+	}
+	return 0;
+}
+
+static int __tune_class(const algo_arg_t* sample, int max_threads,
+			tune_params_t* best)
+{
+	tune_params_t cand;
+	double best_s = -1;
+
+	tune_params_default(best);
+	best->threads = 1;
+
+	/* 1, 2, 4... and all of them */
+	for (int t = 1; ; t = min(2 * t, max_threads)) {
+		cand = *best;
+		cand.threads = t;
+		if (__try(sample, &cand, best, &best_s)) {
+			return 1;
+		}
+		if (t == max_threads) {
+			break;
+		}
+	}
+
+	/* Defaults (0, diagonal) are the ones timed first */
+	for (int i = 1; best->threads > 1 && i < countof(__cutoffs); i++) {
+		cand = *best;
+		cand.par_cutoff = __cutoffs[i];
+		if (__try(sample, &cand, best, &best_s)) {
+			return 1;
+		}
+	}
+	for (int i = 1; best->threads > 1 && i < countof(__chunks); i++) {
+		cand = *best;
+		cand.omp_chunk = __chunks[i];
+		if (__try(sample, &cand, best, &best_s)) {
+			return 1;
+		}
+	}
+
+	for (int layout = 1; layout < MATRIX_LAYOUT_COUNT; layout++) {
+		cand = *best;
+		cand.layout = layout;
+		if (__try(sample, &cand, best, &best_s)) {
+			return 1;
+		}
+	}
+	cand = *best;
+	cand.nt_store = !cand.nt_store;
+	return __try(sample, &cand, best, &best_s);
+}
+
+int tune_run(int max_threads) {
+	tune_params_t params[TUNE_CLASSES];
+	int len = __class_lengths[TUNE_CLASSES - 1];
+	char* a = malloc(len + 1);
+	char* b = malloc(len + 1);
+	unsigned int seed = 1;
+	int ret = 1;
+
+	if (!a || !b) {
+		printf("couldn't allocate calibration sequences\n");
+		goto end;
+	}
+	/* Related sequences, one case in ten being substituted */
+	for (int i = 0; i < len; i++) {
+		a[i] = "ACGT"[rand_r(&seed) % 4];
+		b[i] = (rand_r(&seed) % 10) ? a[i] : "ACGT"[rand_r(&seed) % 4];
+	}
+
+	if (max_threads <= 0) {
+		max_threads = omp_get_num_procs();
+	}
+
+	for (int c = 0; c < TUNE_CLASSES; c++) {
+		algo_arg_t sample;
+		memset(&sample, 0, sizeof(sample));
+		sample.seq_a = a;
+		sample.seq_b = b;
+		sample.len_a = __class_lengths[c];
+		sample.len_b = __class_lengths[c];
+
+		if (__tune_class(&sample, max_threads, params + c)) {
+			goto end;
+		}
+		const tune_params_t* p = params + c;
+		printf("%s: threads %d, cutoff %d, chunk %d, %s layout%s\n",
+		       __class_names[c], p->threads, p->par_cutoff,
+		       p->omp_chunk, matrix_layout_names[p->layout],
+		       p->nt_store ? ", non-temporal stores" : "");
+	}
+	ret = __save(params);
+
+    end:
+	free(a);
+	free(b);
+	return ret;
+}
+
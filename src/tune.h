@@ -0,0 +1,54 @@
+#ifndef _tune_h_
+#define _tune_h_
+
+#include "common.h"
+
+/* Kernel autotuning.
+ *
+ * `nw --tune` times calibration alignments of each size class, searching
+ * the parameters one after the other (coordinate descent): threads, the
+ * diagonal length under which the parallelized kernel stays on a single
+ * thread, the chunk of cases threads take, the matrix layout and the
+ * non-temporal stores. The winners are saved per CPU model in the tuning
+ * file, $XDG_CACHE_HOME/nw/tune or ~/.cache/nw/tune, one line per class:
+ *
+ *	<cpu model>\t<cpus>\t<class>\t<threads> <cutoff> <chunk> <layout> <nt>
+ *
+ * Runs of the iterative and parallelized algorithms load the parameters
+ * of the class of their sequences, unless given on the command line.
+ */
+
+/* Size classes, by cases of the matrix */
+enum {
+	TUNE_SMALL = 0,		/* up to 1M cases */
+	TUNE_MEDIUM,		/* up to 16M cases */
+	TUNE_LARGE,
+	TUNE_CLASSES,
+};
+
+#define TUNE_REPEAT	2	/* runs of each candidate, the best counts */
+
+typedef struct tune_params {
+	int	threads;
+	int	par_cutoff;	/* see algo_arg_t */
+	int	omp_chunk;
+	int	layout;
+	int	nt_store;
+} tune_params_t;
+
+void tune_params_default(tune_params_t* p);
+
+int tune_class(int len_a, int len_b);
+
+/* Load the parameters of a class for this machine.
+ * Returns non zero if it was never tuned.
+ */
+int tune_load(int class, tune_params_t* p);
+
+/* Tune every class with up to `max_threads` threads (all the cpus if 0),
+ * and save the results.
+ */
+int tune_run(int max_threads);
+
+#endif
+
@@ -1,38 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "score.h"
 #include "validate.h"
 
-int validate(char * validation_file, alignment_t* alignments,int nalignments)
+#define VALIDATE_SEED	0x76616c6964617465ULL
+
+/* Checks the columns spell args sequences, and computes the score and the
+ * hash of the run-length encoded operations in the same pass.
+ * Returns non zero if the alignment doesn't spell the sequences.
+ */
+static int __check(const algo_arg_t* args, const scoring_t* sc,
+		   const char* up, const char* down, int* score,
+		   uint64_t* hash)
 {
-	FILE * fichier = NULL;
-	fichier = fopen(validation_file,"r");
-	if (fichier == NULL)
-	{
-		printf("error open validation_file \n");
+	int x = 0;
+	int y = 0;
+	int s = 0;
+	int prev = -1;
+	size_t run = 0;
+	uint64_t h = VALIDATE_SEED;
+	size_t i;
+
+	for (i = 0; up[i] != '\0'; i++) {
+		int op;
+		if (down[i] == '\0') {
+			return 1;
+		}
+		if (up[i] == '-') {
+			if (down[i] == '-' || y >= args->len_b
+			||  down[i] != args->seq_b[y])
+			{
+				return 1;
+			}
+			op = AL_OP_INS;
+			s += sc->gap_extend + ((prev == op) ? 0 : sc->gap_open);
+			y++;
+		}
+		else if (down[i] == '-') {
+			if (x >= args->len_a || up[i] != args->seq_a[x]) {
+				return 1;
+			}
+			op = AL_OP_DEL;
+			s += sc->gap_extend + ((prev == op) ? 0 : sc->gap_open);
+			x++;
+		}
+		else {
+			if (x >= args->len_a || y >= args->len_b
+			||  up[i] != args->seq_a[x] || down[i] != args->seq_b[y])
+			{
+				return 1;
+			}
+			op = AL_OP_MATCH;
+			s += scoring_substitute(sc, up[i], down[i]);
+			x++;
+			y++;
+		}
+
+		if (op != prev && run > 0) {
+			h = hash64_mix(h, (run << 2) | prev);
+			run = 0;
+		}
+		prev = op;
+		run++;
+	}
+	if (down[i] != '\0' || x != args->len_a || y != args->len_b) {
+		return 1;
+	}
+	if (run > 0) {
+		h = hash64_mix(h, (run << 2) | prev);
+	}
+
+	*score = s;
+	*hash = h;
+	return 0;
+}
+
+/* Score of the global alignment, in linear space */
+static int __optimal_score(const algo_arg_t* args, const scoring_t* sc,
+			   int* score)
+{
+	score_alphabet_t ab;
+	score_profile_t p;
+	uint8_t* codes = NULL;
+	int* buf = NULL;
+	int ret = 1;
+
+	if (score_check_scoring(sc)) {
+		printf("substitution scores must fit in 16 bits\n");
+		return 1;
+	}
+	score_alphabet_init(&ab);
+	score_alphabet_add(&ab, args->seq_a, args->len_a);
+	score_alphabet_add(&ab, args->seq_b, args->len_b);
+	if (score_profile_init(&p, &ab, sc, args->seq_a, args->len_a)) {
+		return 1;
+	}
+
+	codes = malloc(max(args->len_b, 1));
+	buf = malloc(2 * (args->len_a + 1) * sizeof(int));
+	if (!codes || !buf) {
+		printf("couldn't allocate validation rows\n");
+		goto end;
+	}
+	score_encode(&ab, args->seq_b, args->len_b, codes);
+	*score = score_profile_align(&p, sc, codes, args->len_b, buf);
+	ret = 0;
+
+    end:
+	score_profile_wipe(&p);
+	free(codes);
+	free(buf);
+	return ret;
+}
+
+static void __chomp(char* line) {
+	size_t len = strlen(line);
+	while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+		line[--len] = '\0';
+	}
+}
+
+int validate(const char* validation_file, const algo_arg_t* args,
+	     const alignment_t* alignments, int nalignments)
+{
+	const scoring_t* sc = args->scoring ? args->scoring : &scoring_default;
+	char* up = NULL;
+	char* down = NULL;
+	size_t size_up = 0;
+	size_t size_down = 0;
+	int ok = 0;
+
+	FILE* f = fopen(validation_file, "r");
+	if (!f) {
+		printf("couldn't open validation file %s\n", validation_file);
 		return 0;
 	}
-	int taille = 1;
-	while ('\n' != fgetc(fichier))
-		taille++;
-	fseek(fichier, 0, SEEK_SET);
-	//char ligne1[taille]; //faire malloc si trop grand
-	//char ligne2[taille];
-
-	char *ligne1,*ligne2;
-	ligne1 = malloc(taille * sizeof(char));
-	ligne2 = malloc(taille * sizeof(char));
-
-	fgets(ligne1,taille+1,fichier);
-	fgets(ligne2,taille+1,fichier);
-	ligne1[taille - 1] = '\0';
-	ligne2[taille - 1] = '\0';
-	fclose(fichier);
-	//printf("%s\n",ligne1);
-	//printf("%s\n",ligne2);
-	for (int i=0 ; i < nalignments ; ++i)
+	if (getline(&up, &size_up, f) < 0
+	||  getline(&down, &size_down, f) < 0)
 	{
-		if ( (strcmp(ligne1,alignments[i].up)==0) && (strcmp(ligne2,alignments[i].down) == 0) )
-			return 1;
+		printf("validation file %s needs two lines\n", validation_file);
+		goto end;
 	}
-	return 0;
+	__chomp(up);
+	__chomp(down);
+
+	int optimal;
+	if (__optimal_score(args, sc, &optimal)) {
+		goto end;
+	}
+	VERBOSE_FMT("optimal score: %d\n", optimal);
+
+	int score;
+	uint64_t ref_hash;
+	if (__check(args, sc, up, down, &score, &ref_hash)) {
+		printf("reference alignment doesn't spell the sequences\n");
+		goto end;
+	}
+	if (score != optimal) {
+		printf("reference alignment scores %d, not %d\n", score,
+		       optimal);
+		goto end;
+	}
+
+	ok = 1;
+	int found = 0;
+	for (int i = 0; i < nalignments; i++) {
+		const alignment_t* al = alignments + i;
+		uint64_t hash;
+		if (__check(args, sc, al->up, al->down, &score, &hash)) {
+			printf("alignment %d doesn't spell the sequences\n",
+			       i + 1);
+			ok = 0;
+			continue;
+		}
+		if (score != optimal) {
+			printf("alignment %d scores %d, not %d\n", i + 1,
+			       score, optimal);
+			ok = 0;
+		}
+		if (!found && hash == ref_hash && !strcmp(al->up, up)
+		&&  !strcmp(al->down, down))
+		{
+			found = i + 1;
+		}
+	}
+	if (found) {
+		VERBOSE_FMT("reference alignment is alignment %d\n", found);
+	}
+	else {
+		VERBOSE("reference alignment isn't among the computed ones\n");
+	}
+
+    end:
+	free(up);
+	free(down);
+	fclose(f);
+	return ok;
+}
 
-	
-}
\ No newline at end of file
@@ -1,7 +1,24 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <string.h>
+#ifndef _validate_h_
+#define _validate_h_
+
+#include "common.h"
 #include "alignment.h"
 
-int validate(char * validation_file, alignment_t* alignments,int nalignments);
\ No newline at end of file
+/* Validation of computed alignments.
+ *
+ * The optimal score is computed in linear space by the score only kernel
+ * (score.h). Then a single pass over the columns of each alignment checks
+ * it spells the sequences, computes its score, and hashes its run-length
+ * encoded operations. The reference alignment, the two lines of
+ * `validation_file`, goes through the same pass and is found among the
+ * computed ones by its hash.
+ *
+ * Returns 1 if the reference and all the alignments spell the sequences
+ * and score the optimal score, whether the reference is among them or not
+ * (they are co-optimal), 0 otherwise.
+ */
+int validate(const char* validation_file, const algo_arg_t* args,
+	     const alignment_t* alignments, int nalignments);
+
+#endif
+